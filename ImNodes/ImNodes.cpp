@@ -24,7 +24,18 @@
 #   define IMGUI_DEFINE_MATH_OPERATORS
 #endif
 
+#ifdef IMNODES_USER_CONFIG
+#   include IMNODES_USER_CONFIG
+#endif
+#ifndef IMNODES_ZONE
+/// Scoped profiling zone, which the user config may define.
+#   define IMNODES_ZONE(name)
+#endif
+
 #include "ImNodes.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 
 namespace ImNodes
 {
@@ -78,9 +89,398 @@ struct _IgnoreSlot
     }
 };
 
+/// Side of the cells of the grid indexes, in canvas units.
+static const float _GridCellSize = 256.f;
+/// Nodes and connections this close to the visible area, in canvas units, are rendered, so that they do not pop in
+/// while scrolling.
+static const float _CullMargin = 32.f;
+
+/// Uniform grid over canvas space indexing the rectangles of items numbered from 0, so that culling, selection and
+/// hit tests look at the items of the cells they cover instead of every item.
+struct _GridIndex
+{
+    /// Cells covered by an item, max < min when the item is not in the index.
+    struct Span
+    {
+        int min_x = 0, min_y = 0, max_x = -1, max_y = -1;
+
+        bool operator==(const Span& other) const
+        {
+            return min_x == other.min_x && min_y == other.min_y && max_x == other.max_x && max_y == other.max_y;
+        }
+    };
+
+    std::vector<Span> spans;
+    std::unordered_map<ImU64, std::vector<int>> cells;
+
+    static ImU64 CellKey(int x, int y)
+    {
+        return ((ImU64)(ImU32)x << 32) | (ImU32)y;
+    }
+
+    static Span SpanOf(const ImRect& rect)
+    {
+        Span span;
+        span.min_x = (int)floorf(rect.Min.x / _GridCellSize);
+        span.min_y = (int)floorf(rect.Min.y / _GridCellSize);
+        span.max_x = (int)floorf(rect.Max.x / _GridCellSize);
+        span.max_y = (int)floorf(rect.Max.y / _GridCellSize);
+        return span;
+    }
+
+    bool IsIndexed(int item) const
+    {
+        return item < (int)spans.size() && spans[item].max_x >= spans[item].min_x;
+    }
+
+    void Remove(int item)
+    {
+        if (!IsIndexed(item))
+            return;
+        Span& span = spans[item];
+        for (int y = span.min_y; y <= span.max_y; y++)
+        {
+            for (int x = span.min_x; x <= span.max_x; x++)
+            {
+                auto it = cells.find(CellKey(x, y));
+                std::vector<int>& cell = it->second;
+                cell.erase(std::find(cell.begin(), cell.end(), item));
+                if (cell.empty())
+                    cells.erase(it);
+            }
+        }
+        span = Span();
+    }
+
+    /// Moves the item to `rect`, re-indexing it only when it changes cells.
+    void Place(int item, const ImRect& rect)
+    {
+        if (item >= (int)spans.size())
+            spans.resize(item + 1);
+        Span span = SpanOf(rect);
+        if (IsIndexed(item) && spans[item] == span)
+            return;
+        Remove(item);
+        spans[item] = span;
+        for (int y = span.min_y; y <= span.max_y; y++)
+            for (int x = span.min_x; x <= span.max_x; x++)
+                cells[CellKey(x, y)].push_back(item);
+    }
+
+    /// Calls `visit` with the items of the cells overlapping `rect`, possibly more than once.
+    template<typename Visit>
+    void Query(const ImRect& rect, Visit visit) const
+    {
+        Span span = SpanOf(rect);
+        // a view zoomed out over a sparse graph covers more cells than there are items
+        if ((ImS64)(span.max_x - span.min_x + 1) * (span.max_y - span.min_y + 1) > (ImS64)cells.size())
+        {
+            for (const auto& cell : cells)
+            {
+                int x = (int)(ImS32)(cell.first >> 32), y = (int)(ImS32)(cell.first & 0xffffffff);
+                if (x >= span.min_x && x <= span.max_x && y >= span.min_y && y <= span.max_y)
+                    for (int item : cell.second)
+                        visit(item);
+            }
+            return;
+        }
+        for (int y = span.min_y; y <= span.max_y; y++)
+        {
+            for (int x = span.min_x; x <= span.max_x; x++)
+            {
+                auto it = cells.find(CellKey(x, y));
+                if (it != cells.end())
+                    for (int item : it->second)
+                        visit(item);
+            }
+        }
+    }
+
+    void Clear()
+    {
+        spans.clear();
+        cells.clear();
+    }
+};
+
+/// Records of the nodes or connections of a canvas by key, with their rectangles in a grid index. Records of items
+/// that were not submitted during a frame are dropped at its end.
+template<typename Key, typename Record, typename Hash = std::hash<Key>>
+struct _ItemTable
+{
+    std::vector<Record> records;
+    std::unordered_map<Key, int, Hash> by_key;
+    _GridIndex grid;
+    /// Incremented when records are dropped, which renumbers the others.
+    int generation = 0;
+    /// Incremented when records are placed elsewhere or dropped.
+    int changes = 0;
+
+    Record& Get(const Key& key)
+    {
+        auto it = by_key.find(key);
+        if (it != by_key.end())
+            return records[it->second];
+        by_key[key] = (int)records.size();
+        records.emplace_back();
+        records.back().key = key;
+        return records.back();
+    }
+
+    /// Index of the record of `key`, -1 when there is none.
+    int Find(const Key& key) const
+    {
+        auto it = by_key.find(key);
+        return it != by_key.end() ? it->second : -1;
+    }
+
+    /// Returns `true` when the item has a record with a rectangle.
+    bool IsPlaced(int item) const
+    {
+        return item >= 0 && grid.IsIndexed(item);
+    }
+
+    bool IsIndexed(const Record& r) const
+    {
+        return grid.IsIndexed((int)(&r - records.data()));
+    }
+
+    void Place(Record& r, const ImRect& rect)
+    {
+        if (!(r.rect.Min == rect.Min) || !(r.rect.Max == rect.Max))
+            changes++;
+        r.rect = rect;
+        grid.Place((int)(&r - records.data()), rect);
+    }
+
+    /// Calls `visit` with the records overlapping `rect`, possibly more than once.
+    template<typename Visit>
+    void Query(const ImRect& rect, Visit visit)
+    {
+        grid.Query(rect, [&](int item) {
+            if (records[item].rect.Overlaps(rect))
+                visit(records[item]);
+        });
+    }
+
+    /// Returns `true` when records were dropped.
+    bool Prune(int frame)
+    {
+        bool stale = false;
+        for (const auto& r : records)
+            stale |= r.seen_frame != frame;
+        if (!stale)
+            return false;
+        std::vector<Record> kept;
+        std::vector<bool> indexed;
+        for (int i = 0; i < (int)records.size(); i++)
+        {
+            if (records[i].seen_frame != frame)
+                continue;
+            kept.push_back(std::move(records[i]));
+            indexed.push_back(grid.IsIndexed(i));
+        }
+        records.swap(kept);
+        by_key.clear();
+        grid.Clear();
+        for (int i = 0; i < (int)records.size(); i++)
+        {
+            by_key[records[i].key] = i;
+            if (indexed[i])
+                grid.Place(i, records[i].rect);
+        }
+        generation++;
+        changes++;
+        return true;
+    }
+};
+
+/// Draw commands of a node, recorded when its content was laid out and replayed while it would draw the same: its
+/// content version, the zoom, its selection and the sub-pixel part of its position are unchanged.
+struct _NodeGeometry
+{
+    struct Command
+    {
+        /// Relative to the layout origin, unless the command used the clip rectangle of the canvas.
+        ImVec4 clip_rect;
+        bool canvas_clip;
+        ImTextureID texture;
+        int elements;
+    };
+    /// Content version, 0 when nothing was recorded.
+    ImU32 version = 0;
+    float zoom = 0.f;
+    bool selected = false;
+    ImVec2 fraction{};
+    /// Vertices relative to the layout origin, and indices into them.
+    std::vector<ImDrawVert> vertices;
+    std::vector<ImDrawIdx> indices;
+    std::vector<Command> commands;
+};
+
+/// Last known placement of a node.
+struct _NodeRecord
+{
+    void* key = nullptr;
+    /// Node position when `rect` was measured.
+    ImVec2 pos{};
+    /// Node rectangle in canvas units, relative to the canvas origin. Not indexed until the node was laid out once.
+    ImRect rect{};
+    /// Frames on which the node was submitted, found in the visible area, and found under the selection rectangle.
+    int seen_frame = -1;
+    int visible_frame = -1;
+    int selectable_frame = -1;
+    /// Frames on which a curve of the node was hovered, which highlights its slots, and an item of its content was active.
+    int curve_hovered_frame = -1;
+    int active_frame = -1;
+    _NodeGeometry geometry;
+};
+
+/// A slot is identified by its node, the hash of its title and its side.
+struct _SlotKey
+{
+    void* node;
+    ImU32 title;
+    bool input;
+
+    bool operator==(const _SlotKey& other) const
+    {
+        return node == other.node && title == other.title && input == other.input;
+    }
+};
+
+struct _SlotKeyHash
+{
+    size_t operator()(const _SlotKey& key) const
+    {
+        return std::hash<void*>()(key.node) ^ (key.title * 2 + key.input);
+    }
+};
+
+/// Slots of the nodes of a canvas, numbered from 0. The fields that connections read every frame are stored in
+/// separate arrays indexed by the slot handle, so that rendering them does not hash anything.
+struct _SlotTable
+{
+    /// Node of each slot.
+    std::vector<void*> node;
+    /// Position of each slot relative to its node, in canvas units.
+    std::vector<float> x, y;
+    /// Last frame on which a connection of each slot was hovered.
+    std::vector<int> hovered_frame;
+    std::unordered_map<_SlotKey, int, _SlotKeyHash> by_key;
+    /// Incremented when slots are dropped, which renumbers the others.
+    int generation = 0;
+
+    static _SlotKey KeyOf(void* node_id, const char* title, bool input)
+    {
+        return _SlotKey{node_id, ImHashStr(title), input};
+    }
+
+    /// Handle of a slot, which is created at the node origin when it was never laid out.
+    int Get(void* node_id, const char* title, bool input)
+    {
+        _SlotKey key = KeyOf(node_id, title, input);
+        auto it = by_key.find(key);
+        if (it != by_key.end())
+            return it->second;
+        int slot = (int)node.size();
+        by_key[key] = slot;
+        node.push_back(node_id);
+        x.push_back(0.f);
+        y.push_back(0.f);
+        hovered_frame.push_back(-1);
+        return slot;
+    }
+
+    /// Drops the slots of the nodes that are not in `nodes` anymore.
+    template<typename Nodes>
+    void Prune(const Nodes& nodes)
+    {
+        int kept = 0;
+        std::vector<int> handles(node.size());
+        for (int i = 0; i < (int)node.size(); i++)
+        {
+            handles[i] = nodes.Find(node[i]) >= 0 ? kept : -1;
+            if (handles[i] < 0)
+                continue;
+            node[kept] = node[i];
+            x[kept] = x[i];
+            y[kept] = y[i];
+            hovered_frame[kept] = hovered_frame[i];
+            kept++;
+        }
+        if (kept == (int)node.size())
+            return;
+        node.resize(kept);
+        x.resize(kept);
+        y.resize(kept);
+        hovered_frame.resize(kept);
+        for (auto it = by_key.begin(); it != by_key.end();)
+        {
+            if (handles[it->second] < 0)
+                it = by_key.erase(it);
+            else
+            {
+                it->second = handles[it->second];
+                ++it;
+            }
+        }
+        generation++;
+    }
+};
+
+/// Slots at both ends of a connection. Titles are hashed like in the slot table, so that a title buffer reused for
+/// another slot does not keep the curve on the old one. Nodes come first so that the key has no padding to hash.
+struct _CurveKey
+{
+    void* input_node;
+    void* output_node;
+    ImU32 input_slot;
+    ImU32 output_slot;
+
+    static _CurveKey Of(void* input_node, const char* input_slot, void* output_node, const char* output_slot)
+    {
+        return _CurveKey{input_node, output_node, ImHashStr(input_slot), ImHashStr(output_slot)};
+    }
+
+    bool operator==(const _CurveKey& other) const
+    {
+        return input_node == other.input_node && input_slot == other.input_slot &&
+               output_node == other.output_node && output_slot == other.output_slot;
+    }
+};
+
+struct _CurveKeyHash
+{
+    size_t operator()(const _CurveKey& key) const
+    {
+        return ImHashData(&key, sizeof(key));
+    }
+};
+
+/// Tessellation of a connection, kept until its ends move or the zoom changes.
+struct _CurveRecord
+{
+    _CurveKey key{};
+    /// Ends of the curve in canvas units.
+    ImVec2 input_pos{}, output_pos{};
+    float zoom = 0.f;
+    /// Points of the curve in canvas units.
+    std::vector<ImVec2> points;
+    /// Bounds of the points inflated by the hover distance.
+    ImRect rect{};
+    /// Frames on which the connection was submitted, and found under the mouse by the index.
+    int seen_frame = -1;
+    int near_frame = -1;
+    /// Handles of the nodes and slots at both ends, valid while the generations of their tables match.
+    int input_node = -1, output_node = -1;
+    int input_slot = -1, output_slot = -1;
+    int node_generation = -1, slot_generation = -1;
+};
+
 struct _CanvasStateImpl
 {
-    /// Storage for various internal node/slot attributes.
+    /// Storage for various internal node attributes.
     ImGuiStorage cached_data{};
     /// Current node data.
     struct
@@ -91,12 +491,66 @@ struct _CanvasStateImpl
         ImVec2* pos = nullptr;
         /// User-provided node selection status.
         bool* selected = nullptr;
+        /// Set when the node is out of view and its content is not submitted.
+        bool culled = false;
+        /// Set when the canvas is zoomed out and the node is drawn as a summary instead of its content.
+        bool summarized = false;
+        /// Summary set by SetNodeSummary().
+        const char* summary_title = nullptr;
+        ImU32 summary_color = 0;
+        /// Screen position where the content of the node is laid out.
+        ImVec2 layout_origin{};
+        /// Content version set by SetNextNodeVersion(), 0 when the geometry of the node is not recorded.
+        ImU32 version = 0;
+        /// Set when the node may draw differently from its recorded geometry, which is then neither replayed nor recorded.
+        bool interactive = false;
+        /// Set when the recorded geometry of the node was replayed instead of laying out its content.
+        bool replayed = false;
+        /// Set while the draw list is split for the content of the node, see Connection().
+        bool laid_out = false;
+        /// Draw list sizes and clip rectangle at BeginNode(), where the geometry of the node starts.
+        int vtx_start = 0;
+        int idx_start = 0;
+        int cmd_start = 0;
+        int cmd_elements = 0;
+        ImVec4 clip_rect{};
     } node;
+    /// Version of the next node, see SetNextNodeVersion().
+    ImU32 next_node_version = 0;
+    /// Set when a popup opened from the canvas window is open. Nodes may have opened it and are laid out.
+    bool popup_open = false;
+    /// Scratch buffer of RecordNodeGeometry().
+    std::vector<int> vertex_remap;
+    /// Overview drawn by Minimap().
+    struct
+    {
+        /// Changes of the node and curve tables when `geometry` was built.
+        int node_changes = -1;
+        int curve_changes = -1;
+        ImVec2 size{};
+        /// Canvas area shown, and pixels per canvas unit.
+        ImRect bounds{};
+        float scale = 0.f;
+        /// Node rectangles and connections relative to the minimap corner.
+        _NodeGeometry geometry;
+        /// Distance from the mouse to the center of the visible area when dragging started.
+        ImVec2 grab{};
+    } minimap;
+    /// Placement of the nodes.
+    _ItemTable<void*, _NodeRecord> nodes{};
+    /// Positions and hover state of the slots.
+    _SlotTable slots{};
+    /// Tessellations of the connections.
+    _ItemTable<_CurveKey, _CurveRecord, _CurveKeyHash> curves{};
+    /// Visible area in canvas units, with a margin.
+    ImRect view{};
     /// Current slot data.
     struct
     {
         int kind = 0;
         const char* title = nullptr;
+        /// Handle in `slots`.
+        int handle = -1;
     } slot{};
     /// Node id which will be positioned at the mouse cursor on next frame.
     void* auto_position_node_id = nullptr;
@@ -153,15 +607,33 @@ CanvasState::~CanvasState()
     delete _impl;
 }
 
-ImU32 MakeSlotDataID(const char* data, const char* slot_title, void* node_id, bool input_slot)
+/// Returns `true` when nodes are drawn as summaries at the current zoom.
+bool IsCanvasSummarized(const CanvasState* canvas)
 {
-    ImU32 slot_id = ImHashStr(slot_title, 0, ImHashData(&node_id, sizeof(node_id)));
-    if (input_slot)
-    {
-        // Ensure that input and output slots with same name have different ids.
-        slot_id ^= ~0U;
-    }
-    return ImHashStr(data, 0, slot_id);
+    return canvas->zoom < canvas->style.detail_zoom;
+}
+
+/// Screen position of a slot from the handles of the slot and its node. Slots are stored relative to their node in
+/// canvas units, which keeps them valid when the node is out of view and not laid out. Summarized nodes have one point
+/// in the middle of each side.
+ImVec2 GetSlotPosition(_CanvasStateImpl* impl, int slot, int node, bool input_slot)
+{
+    const _NodeRecord& record = impl->nodes.records[node];
+    ImVec2 canvas_pos;
+    if (IsCanvasSummarized(gCanvas))
+        canvas_pos = ImVec2{input_slot ? record.rect.Min.x : record.rect.Max.x, record.rect.GetCenter().y};
+    else
+        canvas_pos = record.pos + ImVec2{impl->slots.x[slot], impl->slots.y[slot]};
+    return ImGui::GetWindowPos() + gCanvas->offset + canvas_pos * gCanvas->zoom;
+}
+
+/// Screen position of a slot.
+ImVec2 GetSlotPosition(_CanvasStateImpl* impl, const char* slot_title, void* node_id, bool input_slot)
+{
+    int node = impl->nodes.Find(node_id);
+    if (node < 0)
+        return ImGui::GetWindowPos() + gCanvas->offset;
+    return GetSlotPosition(impl, impl->slots.Get(node_id, slot_title, input_slot), node, input_slot);
 }
 
 // Based on http://paulbourke.net/geometry/pointlineplane/
@@ -181,28 +653,129 @@ float GetDistanceToLineSquared(const ImVec2& point, const ImVec2& a, const ImVec
     return tx * tx + ty * ty;
 }
 
+/// Segments of the curves of a canvas zoomed out below the detail zoom, where their shape is barely visible.
+static const int _SummaryCurveSegments = 4;
+/// Height of the status bar of summarized nodes, in pixels.
+static const float _SummaryStatusHeight = 3.f;
+/// Distance around a node within which the mouse may hover its content, slots stick out of its border. Canvas units.
+static const float _HoverMargin = 16.f;
+
+/// Copies the geometry of the node that was just laid out, `elements` indices from where BeginNode() started, into
+/// `geometry`. Returns `false` when it can not be replayed.
+bool RecordNodeGeometry(_CanvasStateImpl* impl, ImDrawList* draw_list, int elements, _NodeGeometry& geometry)
+{
+    const ImVec2 origin = impl->node.layout_origin;
+    const ImVec4& canvas_clip = impl->node.clip_rect;
+    geometry.vertices.clear();
+    geometry.indices.clear();
+    geometry.commands.clear();
+
+    // Curves submitted inside the node were drawn between its vertices, only the referenced vertices are kept
+    std::vector<int>& remap = impl->vertex_remap;
+    remap.assign(draw_list->VtxBuffer.Size - impl->node.vtx_start, -1);
+    int idx = impl->node.idx_start;
+    int skip = impl->node.cmd_elements;
+    for (int i = impl->node.cmd_start; i < draw_list->CmdBuffer.Size && elements > 0; i++, skip = 0)
+    {
+        const ImDrawCmd& cmd = draw_list->CmdBuffer[i];
+        int count = ImMin((int)cmd.ElemCount - skip, elements);
+        if (count <= 0)
+            continue;
+        if (cmd.UserCallback != nullptr)
+            return false;
+
+        _NodeGeometry::Command command;
+        command.canvas_clip = cmd.ClipRect.x == canvas_clip.x && cmd.ClipRect.y == canvas_clip.y &&
+                              cmd.ClipRect.z == canvas_clip.z && cmd.ClipRect.w == canvas_clip.w;
+        command.clip_rect = cmd.ClipRect;
+        if (!command.canvas_clip)
+            command.clip_rect = ImVec4{cmd.ClipRect.x - origin.x, cmd.ClipRect.y - origin.y,
+                                       cmd.ClipRect.z - origin.x, cmd.ClipRect.w - origin.y};
+        command.texture = cmd.TextureId;
+        command.elements = count;
+        geometry.commands.push_back(command);
+
+        for (int k = 0; k < count; k++, idx++)
+        {
+            int vtx = (int)draw_list->IdxBuffer[idx] - impl->node.vtx_start;
+            if (remap[vtx] < 0)
+            {
+                remap[vtx] = (int)geometry.vertices.size();
+                ImDrawVert vert = draw_list->VtxBuffer[impl->node.vtx_start + vtx];
+                vert.pos -= origin;
+                geometry.vertices.push_back(vert);
+            }
+            geometry.indices.push_back((ImDrawIdx)remap[vtx]);
+        }
+        elements -= count;
+    }
+    return true;
+}
+
+/// Appends recorded geometry, relative to `layout_origin`, to the draw list.
+void ReplayGeometry(ImDrawList* draw_list, const _NodeGeometry& geometry, const ImVec2& layout_origin)
+{
+    unsigned int base = draw_list->_VtxCurrentIdx;
+    draw_list->PrimReserve(0, (int)geometry.vertices.size());
+    for (const ImDrawVert& vert : geometry.vertices)
+    {
+        draw_list->_VtxWritePtr->pos = vert.pos + layout_origin;
+        draw_list->_VtxWritePtr->uv = vert.uv;
+        draw_list->_VtxWritePtr->col = vert.col;
+        draw_list->_VtxWritePtr++;
+    }
+    draw_list->_VtxCurrentIdx += (unsigned int)geometry.vertices.size();
+
+    const ImDrawIdx* idx = geometry.indices.data();
+    for (const _NodeGeometry::Command& command : geometry.commands)
+    {
+        if (!command.canvas_clip)
+        {
+            const ImVec4& clip = command.clip_rect;
+            draw_list->PushClipRect(layout_origin + ImVec2{clip.x, clip.y}, layout_origin + ImVec2{clip.z, clip.w}, true);
+        }
+        draw_list->PushTextureID(command.texture);
+        draw_list->PrimReserve(command.elements, 0);
+        for (int i = 0; i < command.elements; i++)
+            *draw_list->_IdxWritePtr++ = (ImDrawIdx)(base + *idx++);
+        draw_list->PopTextureID();
+        if (!command.canvas_clip)
+            draw_list->PopClipRect();
+    }
+}
+
+/// Appends the points of the curve between two slots to the path of `draw_list`.
+void TessellateConnection(ImDrawList* draw_list, const ImVec2& input_pos, const ImVec2& output_pos)
+{
+    ImVec2 p2 = input_pos - ImVec2{100 * gCanvas->zoom, 0};
+    ImVec2 p3 = output_pos + ImVec2{100 * gCanvas->zoom, 0};
+    draw_list->PathLineTo(input_pos);
+    draw_list->PathBezierCurveTo(p2, p3, output_pos, IsCanvasSummarized(gCanvas) ? _SummaryCurveSegments : 0);
+}
+
+/// Minimum distance from `point` to the polyline, squared.
+float GetDistanceToPathSquared(const ImVec2& point, const ImVec2* points, int count)
+{
+    float min_square_distance = FLT_MAX;
+    for (int i = 0; i < count - 1; i++)
+        min_square_distance = ImMin(min_square_distance, GetDistanceToLineSquared(point, points[i], points[i + 1]));
+    return min_square_distance;
+}
+
+/// Renders the curve of a connection that is being made. Returns `true` when it is hovered.
 bool RenderConnection(const ImVec2& input_pos, const ImVec2& output_pos, float thickness)
 {
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
     CanvasState* canvas = gCanvas;
-    const ImGuiStyle& style = ImGui::GetStyle();
 
     thickness *= canvas->zoom;
 
-    ImVec2 p2 = input_pos - ImVec2{100 * canvas->zoom, 0};
-    ImVec2 p3 = output_pos + ImVec2{100 * canvas->zoom, 0};
-
     // Assemble segments for path
-    draw_list->PathLineTo(input_pos);
-    draw_list->PathBezierCurveTo(p2, p3, output_pos, 0);
+    TessellateConnection(draw_list, input_pos, output_pos);
 
     // Check each segment and determine if mouse is hovering curve that is to be drawn
-    float min_square_distance = FLT_MAX;
-    for (int i = 0; i < draw_list->_Path.size() - 1; i++)
-    {
-        min_square_distance = ImMin(min_square_distance,
-            GetDistanceToLineSquared(ImGui::GetMousePos(), draw_list->_Path[i], draw_list->_Path[i + 1]));
-    }
+    float min_square_distance = GetDistanceToPathSquared(ImGui::GetMousePos(), draw_list->_Path.Data,
+                                                         draw_list->_Path.Size);
 
     // Draw curve, change when it is hovered
     bool is_close = min_square_distance <= thickness * thickness;
@@ -210,8 +783,67 @@ bool RenderConnection(const ImVec2& input_pos, const ImVec2& output_pos, float t
     return is_close;
 }
 
+/// Renders the curve of a connection between slots at `input_pos` and `output_pos`, on screen. The curve is tessellated
+/// in canvas units once until its ends move or the zoom changes, hit-tested only when the index found it under the
+/// mouse, and not drawn out of view. Returns `true` when it is hovered.
+bool RenderCachedConnection(_CurveRecord& curve, const ImVec2& input_pos, const ImVec2& output_pos, float thickness)
+{
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    CanvasState* canvas = gCanvas;
+    auto* impl = canvas->_impl;
+    const ImVec2 origin = ImGui::GetWindowPos() + canvas->offset;
+    const ImVec2 mouse = (ImGui::GetMousePos() - origin) / canvas->zoom;
+    int frame = ImGui::GetCurrentContext()->FrameCount;
+
+    // Ends are compared with a tolerance, as the round trip through screen coordinates changes them while scrolling
+    ImVec2 input_canvas = (input_pos - origin) / canvas->zoom;
+    ImVec2 output_canvas = (output_pos - origin) / canvas->zoom;
+    auto differs = [](const ImVec2& a, const ImVec2& b) { return ImFabs(a.x - b.x) > 0.01f || ImFabs(a.y - b.y) > 0.01f; };
+    bool moved = differs(input_canvas, curve.input_pos) || differs(output_canvas, curve.output_pos) ||
+                 canvas->zoom != curve.zoom;
+    if (moved)
+    {
+        TessellateConnection(draw_list, input_pos, output_pos);
+        curve.points.resize(draw_list->_Path.Size);
+        ImRect bounds{FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for (int i = 0; i < draw_list->_Path.Size; i++)
+        {
+            curve.points[i] = (draw_list->_Path[i] - origin) / canvas->zoom;
+            bounds.Add(curve.points[i]);
+        }
+        draw_list->PathClear();
+        bounds.Expand(thickness);
+        curve.input_pos = input_canvas;
+        curve.output_pos = output_canvas;
+        curve.zoom = canvas->zoom;
+        impl->curves.Place(curve, bounds);
+    }
+
+    // The index marked the curves under the mouse in BeginCanvas(), before this one moved
+    bool is_close = false;
+    if (curve.near_frame == frame || (moved && curve.rect.Contains(mouse)))
+        is_close = GetDistanceToPathSquared(mouse, curve.points.data(), (int)curve.points.size()) <= thickness * thickness;
+
+    if (curve.rect.Overlaps(impl->view))
+    {
+        ImU32 color = is_close ? canvas->colors[ColConnectionActive] : canvas->colors[ColConnection];
+        for (const ImVec2& p : curve.points)
+            draw_list->PathLineTo(origin + p * canvas->zoom);
+        draw_list->PathStroke(color, false, thickness * canvas->zoom);
+        if (IsCanvasSummarized(canvas))
+        {
+            // Slots of summarized nodes are points
+            ImVec2 radius{thickness * canvas->zoom, thickness * canvas->zoom};
+            draw_list->AddRectFilled(input_pos - radius, input_pos + radius, color);
+            draw_list->AddRectFilled(output_pos - radius, output_pos + radius, color);
+        }
+    }
+    return is_close;
+}
+
 void BeginCanvas(CanvasState* canvas)
 {
+    IMNODES_ZONE("ImNodes::BeginCanvas");
     canvas->_impl->prev_canvas = gCanvas;
     gCanvas = canvas;
     const ImGuiWindow* w = ImGui::GetCurrentWindow();
@@ -259,11 +891,36 @@ void BeginCanvas(CanvasState* canvas)
         y += grid;
     }
 
+    // Nodes near the visible area are laid out, the others are culled. Selection only looks at the nodes under the
+    // selection rectangle.
+    auto* impl = canvas->_impl;
+    int frame = ImGui::GetCurrentContext()->FrameCount;
+    ImVec2 origin = pos + canvas->offset;
+    ImRect view{(pos - origin) / canvas->zoom, (pos + size - origin) / canvas->zoom};
+    view.Expand(_CullMargin);
+    impl->nodes.Query(view, [frame](_NodeRecord& r) { r.visible_frame = frame; });
+    impl->view = view;
+    ImVec2 mouse = (ImGui::GetMousePos() - origin) / canvas->zoom;
+    impl->curves.Query(ImRect{mouse, mouse}, [frame](_CurveRecord& r) { r.near_frame = frame; });
+    if (impl->state == State_Select)
+    {
+        ImRect selection{ImMin(impl->selection_start, ImGui::GetMousePos()),
+                         ImMax(impl->selection_start, ImGui::GetMousePos())};
+        selection.Min = (selection.Min - origin) / canvas->zoom;
+        selection.Max = (selection.Max - origin) / canvas->zoom;
+        impl->nodes.Query(selection, [frame](_NodeRecord& r) { r.selectable_frame = frame; });
+    }
+
+    impl->popup_open = false;
+    for (const ImGuiPopupData& popup : ImGui::GetCurrentContext()->OpenPopupStack)
+        impl->popup_open |= popup.SourceWindow != nullptr && popup.SourceWindow->RootWindow == w->RootWindow;
+
     ImGui::SetWindowFontScale(canvas->zoom);
 }
 
 void EndCanvas()
 {
+    IMNODES_ZONE("ImNodes::EndCanvas");
     assert(gCanvas != nullptr);     // Did you forget calling BeginCanvas()?
 
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
@@ -278,12 +935,8 @@ void EndCanvas()
         if (strncmp(payload->DataType, data_type_fragment, sizeof(data_type_fragment) - 1) == 0)
         {
             auto* drag_data = (_DragConnectionPayload*)payload->Data;
-            ImVec2 slot_pos{
-                impl->cached_data.GetFloat(MakeSlotDataID("x", drag_data->slot_title, drag_data->node_id,
-                    IsInputSlotKind(drag_data->slot_kind))),
-                impl->cached_data.GetFloat(MakeSlotDataID("y", drag_data->slot_title, drag_data->node_id,
-                    IsInputSlotKind(drag_data->slot_kind))),
-            };
+            ImVec2 slot_pos = GetSlotPosition(impl, drag_data->slot_title, drag_data->node_id,
+                                              IsInputSlotKind(drag_data->slot_kind));
 
             float connection_indent = canvas->style.connection_indent * canvas->zoom;
 
@@ -367,6 +1020,10 @@ void EndCanvas()
     }
     }
 
+    if (impl->nodes.Prune(ImGui::GetCurrentContext()->FrameCount))
+        impl->slots.Prune(impl->nodes);
+    impl->curves.Prune(ImGui::GetCurrentContext()->FrameCount);
+
     ImGui::SetWindowFontScale(1.f);
     ImGui::PopID();     // canvas
     gCanvas = impl->prev_canvas;
@@ -387,9 +1044,68 @@ bool BeginNode(void* node_id, ImVec2* pos, bool* selected)
     impl->node.pos = pos;
     impl->node.selected = selected;
 
-    // 0 - node rect, curves
+    // Nodes out of view keep their last size, they are only moved and selected
+    _NodeRecord& record = impl->nodes.Get(node_id);
+    int frame = ImGui::GetCurrentContext()->FrameCount;
+    record.seen_frame = frame;
+    if (!impl->nodes.IsIndexed(record))
+    {
+        // Size is unknown until the node is laid out in view
+        record.pos = *pos;
+        impl->nodes.Place(record, ImRect{*pos, *pos});
+        if (impl->view.Contains(*pos))
+            record.visible_frame = frame;
+    }
+    impl->node.culled = record.visible_frame != frame && node_id != impl->auto_position_node_id;
+    impl->node.summarized = !impl->node.culled && IsCanvasSummarized(canvas) && node_id != impl->auto_position_node_id;
+    impl->node.summary_title = nullptr;
+    impl->node.summary_color = 0;
+    impl->node.version = impl->next_node_version;
+    impl->next_node_version = 0;
+    impl->node.replayed = false;
+    if (impl->node.culled)
+        return false;
+    if (impl->node.summarized)
+    {
+        // Content is not laid out, EndNode() draws the summary
+        ImGui::PushID(node_id);
+        return false;
+    }
+
+    // The recorded geometry is replayed until the node may draw differently: it is under the mouse, its slots are
+    // highlighted, its content is active, or a popup or a connection is in progress
+    ImVec2 layout_origin = ImGui::GetWindowPos() + (*pos) * canvas->zoom + canvas->offset;
+    ImRect hover_rect = record.rect;
+    hover_rect.Translate(*pos - record.pos);
+    hover_rect.Expand(_HoverMargin);
+    ImVec2 mouse = (ImGui::GetMousePos() - ImGui::GetWindowPos() - canvas->offset) / canvas->zoom;
+    impl->node.interactive = hover_rect.Contains(mouse) || record.curve_hovered_frame >= frame - 1 ||
+                             record.active_frame >= frame - 1 || impl->popup_open ||
+                             ImGui::GetDragDropPayload() != nullptr || node_id == impl->auto_position_node_id;
+    const _NodeGeometry& geometry = record.geometry;
+    if (impl->node.version != 0 && !impl->node.interactive && geometry.version == impl->node.version &&
+        geometry.zoom == canvas->zoom && geometry.selected == *selected &&
+        geometry.fraction == layout_origin - ImFloor(layout_origin))
+    {
+        // Drawn now, under the curves submitted before EndNode()
+        ReplayGeometry(draw_list, geometry, layout_origin);
+        impl->node.replayed = true;
+        ImGui::PushID(node_id);
+        return false;
+    }
+
+    // Where the geometry of the node starts, in case it is recorded
+    impl->node.vtx_start = draw_list->VtxBuffer.Size;
+    impl->node.idx_start = draw_list->IdxBuffer.Size;
+    impl->node.cmd_start = draw_list->CmdBuffer.Size - 1;
+    impl->node.cmd_elements = (int)draw_list->CmdBuffer.back().ElemCount;
+    impl->node.clip_rect = draw_list->_ClipRectStack.back();
+
+    // 0 - node rect
     // 1 - node content
-    draw_list->ChannelsSplit(2);
+    // 2 - curves submitted before EndNode(), not part of the node geometry
+    draw_list->ChannelsSplit(3);
+    impl->node.laid_out = true;
 
     if (node_id == impl->auto_position_node_id)
     {
@@ -402,6 +1118,9 @@ bool BeginNode(void* node_id, ImVec2* pos, bool* selected)
         ImGui::SetCursorScreenPos(ImGui::GetWindowPos() + (*pos) * canvas->zoom + canvas->offset);
     }
 
+    impl->node.layout_origin = ImGui::GetCursorScreenPos();
+    record.pos = *pos;
+
     ImGui::PushID(node_id);
 
     ImGui::BeginGroup();    // Slots and content group
@@ -421,31 +1140,93 @@ void EndNode()
 
     bool& node_selected = *impl->node.selected;
     ImVec2& node_pos = *impl->node.pos;
+    bool culled = impl->node.culled;
+    bool summarized = impl->node.summarized;
+    bool replayed = impl->node.replayed;
+    bool content_active = false;
+    bool frame_selected = node_selected;
+    _NodeRecord& record = impl->nodes.Get(node_id);
+    int frame = ImGui::GetCurrentContext()->FrameCount;
+    const ImVec2 origin = ImGui::GetWindowPos() + canvas->offset;
+
+    // Last known rectangle of a node that is not laid out, in canvas units
+    const ImVec2 start_pos = node_pos;
+    ImRect canvas_rect = record.rect;
+    canvas_rect.Translate(node_pos - record.pos);
+    if (summarized && canvas_rect.GetWidth() <= 0.f)
+    {
+        // Never laid out, size the summary after its title
+        const char* title = impl->node.summary_title ? impl->node.summary_title : "";
+        canvas_rect.Max = canvas_rect.Min + ImGui::CalcTextSize(title) / canvas->zoom + style.ItemInnerSpacing * 2;
+    }
 
-    ImGui::EndGroup();    // Slots and content group
+    ImRect node_rect;
+    bool node_hovered = false;
+    bool node_active = false;
+    if (culled || summarized || replayed)
+    {
+        node_rect.Min = origin + canvas_rect.Min * canvas->zoom;
+        node_rect.Max = origin + canvas_rect.Max * canvas->zoom;
+    }
+    else
+    {
+        ImGui::EndGroup();    // Slots and content group
+        content_active = ImGui::IsItemActive();
+        if (content_active)
+            record.active_frame = frame;
 
-    ImRect node_rect{
-        ImGui::GetItemRectMin() - style.ItemInnerSpacing * canvas->zoom,
-        ImGui::GetItemRectMax() + style.ItemInnerSpacing * canvas->zoom
-    };
+        node_rect.Min = ImGui::GetItemRectMin() - style.ItemInnerSpacing * canvas->zoom;
+        node_rect.Max = ImGui::GetItemRectMax() + style.ItemInnerSpacing * canvas->zoom;
+    }
 
-    // Render frame
-    draw_list->ChannelsSetCurrent(0);
+    if (summarized)
+    {
+        // Flat rectangle with the status on top and the title at a readable size, clipped to the node
+        ImColor node_color = canvas->colors[node_selected ? ColNodeActiveBg : ColNodeBg];
+        draw_list->AddRectFilled(node_rect.Min, node_rect.Max, node_color);
+        draw_list->AddRect(node_rect.Min, node_rect.Max, canvas->colors[ColNodeBorder]);
+        float status_height = 0.f;
+        if (impl->node.summary_color)
+        {
+            status_height = ImMin(_SummaryStatusHeight, node_rect.GetHeight());
+            draw_list->AddRectFilled(node_rect.Min, ImVec2{node_rect.Max.x, node_rect.Min.y + status_height},
+                                     impl->node.summary_color);
+        }
+        if (impl->node.summary_title)
+        {
+            ImVec4 clip{node_rect.Min.x, node_rect.Min.y, node_rect.Max.x, node_rect.Max.y};
+            draw_list->AddText(ImGui::GetFont(), ImGui::GetFontSize() / canvas->zoom,
+                               node_rect.Min + ImVec2{style.ItemInnerSpacing.x * canvas->zoom, status_height},
+                               ImGui::GetColorU32(ImGuiCol_Text), impl->node.summary_title, nullptr, 0.f, &clip);
+        }
+    }
+    else if (!culled && !replayed)
+    {
+        // Render frame
+        draw_list->ChannelsSetCurrent(0);
 
-    ImColor node_color = canvas->colors[node_selected ? ColNodeActiveBg : ColNodeBg];
-    draw_list->AddRectFilled(node_rect.Min, node_rect.Max, node_color, style.FrameRounding);
-    draw_list->AddRect(node_rect.Min, node_rect.Max, canvas->colors[ColNodeBorder], style.FrameRounding);
+        ImColor node_color = canvas->colors[node_selected ? ColNodeActiveBg : ColNodeBg];
+        draw_list->AddRectFilled(node_rect.Min, node_rect.Max, node_color, style.FrameRounding);
+        draw_list->AddRect(node_rect.Min, node_rect.Max, canvas->colors[ColNodeBorder], style.FrameRounding);
 
-    // Create node item
-    ImGuiID node_item_id = ImGui::GetID(node_id);
-    ImGui::ItemSize(node_rect.GetSize());
-    ImGui::ItemAdd(node_rect, node_item_id);
+        ImGui::ItemSize(node_rect.GetSize());
+    }
 
-    // Node is active when being dragged
-    if (ImGui::IsMouseDown(0) && !ImGui::IsAnyItemActive() && ImGui::IsItemHovered())
-        ImGui::SetActiveID(node_item_id, ImGui::GetCurrentWindow());
-    else if (!ImGui::IsMouseDown(0) && ImGui::IsItemActive())
-        ImGui::ClearActiveID();
+    if (!culled)
+    {
+        // Create node item
+        ImGuiID node_item_id = ImGui::GetID(node_id);
+        ImGui::ItemAdd(node_rect, node_item_id);
+
+        // Node is active when being dragged
+        if (ImGui::IsMouseDown(0) && !ImGui::IsAnyItemActive() && ImGui::IsItemHovered())
+            ImGui::SetActiveID(node_item_id, ImGui::GetCurrentWindow());
+        else if (!ImGui::IsMouseDown(0) && ImGui::IsItemActive())
+            ImGui::ClearActiveID();
+
+        node_hovered = ImGui::IsItemHovered();
+        node_active = ImGui::IsItemActive();
+    }
 
     // Save last selection state in case we are about to start dragging multiple selected nodes
     if (ImGui::IsMouseClicked(0))
@@ -470,7 +1251,7 @@ void EndNode()
             // Unselect other nodes when some node was left-clicked.
             node_selected = impl->single_selected_node == node_id;
         }
-        else if (ImGui::IsMouseClicked(0) && ImGui::IsItemHovered() && !ImGui::IsAnyItemActive())
+        else if (ImGui::IsMouseClicked(0) && node_hovered && !ImGui::IsAnyItemActive())
         {
             node_selected ^= true;
             if (!io.KeyCtrl && node_selected)
@@ -479,7 +1260,7 @@ void EndNode()
                 impl->do_selections_frame = ImGui::GetCurrentContext()->FrameCount + 1;
             }
         }
-        else if (ImGui::IsItemActive() && ImGui::IsMouseDragging(0))
+        else if (node_active && ImGui::IsMouseDragging(0))
         {
             impl->state = State_Drag;
             if (impl->drag_node == nullptr)
@@ -504,7 +1285,7 @@ void EndNode()
         if (ImGui::IsMouseDown(0))
         {
             // Node dragging behavior. Drag node under mouse and other selected nodes if current node is selected.
-            if ((ImGui::IsItemActive() || (impl->drag_node && impl->drag_node_selected && node_selected)))
+            if ((node_active || (impl->drag_node && impl->drag_node_selected && node_selected)))
                 node_pos += ImGui::GetIO().MouseDelta / canvas->zoom;
         }
         break;
@@ -518,10 +1299,13 @@ void EndNode()
         selection_rect.Max.y = ImMax(impl->selection_start.y, ImGui::GetMousePos().y);
 
         ImGuiID prev_selected_id = ImHashStr("prev-selected", 0, ImHashData(&impl->node.id, sizeof(impl->node.id)));
+        // The index found the nodes overlapping the selection rectangle in BeginCanvas()
+        bool contained = record.selectable_frame == ImGui::GetCurrentContext()->FrameCount &&
+                         selection_rect.Contains(node_rect);
         if (io.KeyShift)
         {
             // Append selection
-            if (selection_rect.Contains(node_rect))
+            if (contained)
                 node_selected = true;
             else
                 node_selected = impl->cached_data.GetBool(prev_selected_id);
@@ -529,7 +1313,7 @@ void EndNode()
         else if (io.KeyCtrl)
         {
             // Subtract from selection
-            if (selection_rect.Contains(node_rect))
+            if (contained)
                 node_selected = false;
             else
                 node_selected = impl->cached_data.GetBool(prev_selected_id);
@@ -537,17 +1321,83 @@ void EndNode()
         else
         {
             // Assign selection
-            node_selected = selection_rect.Contains(node_rect);
+            node_selected = contained;
         }
         break;
     }
     }
 
-    draw_list->ChannelsMerge();
+    // Index the node where it is now, after it was dragged or auto-positioned
+    if (culled || summarized || replayed)
+    {
+        canvas_rect.Translate(node_pos - start_pos);
+    }
+    else
+    {
+        canvas_rect.Min = node_pos + (node_rect.Min - impl->node.layout_origin) / canvas->zoom;
+        canvas_rect.Max = node_pos + (node_rect.Max - impl->node.layout_origin) / canvas->zoom;
+    }
+    record.pos = node_pos;
+    impl->nodes.Place(record, canvas_rect);
+
+    if (culled)
+        return;
+
+    if (impl->node.laid_out)
+    {
+        // Recorded when the content is entirely in view, as items and text out of view are not drawn
+        draw_list->ChannelsSetCurrent(0);
+        int elements = draw_list->IdxBuffer.Size - impl->node.idx_start + draw_list->_Channels[1].IdxBuffer.Size;
+        draw_list->ChannelsMerge();
+        impl->node.laid_out = false;
+
+        ImRect content_rect = node_rect;
+        content_rect.Expand(_HoverMargin * canvas->zoom);
+        _NodeGeometry& geometry = record.geometry;
+        geometry.version = 0;
+        if (impl->node.version != 0 && !impl->node.interactive && !content_active &&
+            ImRect(impl->node.clip_rect).Contains(content_rect) &&
+            RecordNodeGeometry(impl, draw_list, elements, geometry))
+        {
+            geometry.version = impl->node.version;
+            geometry.zoom = canvas->zoom;
+            geometry.selected = frame_selected;
+            geometry.fraction = impl->node.layout_origin - ImFloor(impl->node.layout_origin);
+        }
+    }
 
     ImGui::PopID();     // id
 }
 
+bool IsNodeSummarized()
+{
+    assert(gCanvas != nullptr);
+    return gCanvas->_impl->node.summarized;
+}
+
+bool IsNodeVisible(void* node_id)
+{
+    assert(gCanvas != nullptr);
+    auto* impl = gCanvas->_impl;
+    int node = impl->nodes.Find(node_id);
+    return !impl->nodes.IsPlaced(node) ||
+           impl->nodes.records[node].visible_frame == ImGui::GetCurrentContext()->FrameCount;
+}
+
+void SetNextNodeVersion(ImU32 version)
+{
+    assert(gCanvas != nullptr);
+    gCanvas->_impl->next_node_version = version;
+}
+
+void SetNodeSummary(const char* title, ImU32 status_color)
+{
+    assert(gCanvas != nullptr);
+    auto* impl = gCanvas->_impl;
+    impl->node.summary_title = title;
+    impl->node.summary_color = status_color;
+}
+
 bool GetNewConnection(void** input_node, const char** input_slot_title, void** output_node, const char** output_slot_title)
 {
     assert(gCanvas != nullptr);
@@ -611,30 +1461,55 @@ bool Connection(void* input_node, const char* input_slot, void* output_node, con
         // Do not render connection to newly added output node because node is rendered outside of screen on the first frame and will be repositioned.
         return is_connected;
 
-    ImVec2 input_slot_pos{
-        impl->cached_data.GetFloat(MakeSlotDataID("x", input_slot, input_node, true)),
-        impl->cached_data.GetFloat(MakeSlotDataID("y", input_slot, input_node, true)),
-    };
+    // Handles of the ends are looked up again only after nodes or slots were dropped
+    int frame = ImGui::GetCurrentContext()->FrameCount;
+    _CurveRecord& curve = impl->curves.Get(_CurveKey::Of(input_node, input_slot, output_node, output_slot));
+    curve.seen_frame = frame;
+    if (curve.node_generation != impl->nodes.generation || curve.slot_generation != impl->slots.generation)
+    {
+        curve.input_node = impl->nodes.Find(input_node);
+        curve.output_node = impl->nodes.Find(output_node);
+        curve.input_slot = impl->slots.Get(input_node, input_slot, true);
+        curve.output_slot = impl->slots.Get(output_node, output_slot, false);
+        // Nodes that were not submitted yet get their handle later in the frame
+        bool found = curve.input_node >= 0 && curve.output_node >= 0;
+        curve.node_generation = found ? impl->nodes.generation : -1;
+        curve.slot_generation = impl->slots.generation;
+    }
 
-    ImVec2 output_slot_pos{
-        impl->cached_data.GetFloat(MakeSlotDataID("x", output_slot, output_node, false)),
-        impl->cached_data.GetFloat(MakeSlotDataID("y", output_slot, output_node, false)),
-    };
+    if (!impl->nodes.IsPlaced(curve.input_node) || !impl->nodes.IsPlaced(curve.output_node))
+        // Position of a node that was not submitted yet is unknown.
+        return is_connected;
+
+    ImVec2 input_slot_pos = GetSlotPosition(impl, curve.input_slot, curve.input_node, true);
+    ImVec2 output_slot_pos = GetSlotPosition(impl, curve.output_slot, curve.output_node, false);
 
     // Indent connection a bit into slot widget.
     float connection_indent = canvas->style.connection_indent * canvas->zoom;
     input_slot_pos.x += connection_indent;
     output_slot_pos.x -= connection_indent;
 
-    bool curve_hovered = RenderConnection(input_slot_pos, output_slot_pos, canvas->style.curve_thickness);
+    // Curves submitted inside a laid out node are drawn above its content, apart from its geometry
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    int channel = draw_list->_ChannelsCurrent;
+    if (impl->node.laid_out)
+        draw_list->ChannelsSetCurrent(2);
+    bool curve_hovered = RenderCachedConnection(curve, input_slot_pos, output_slot_pos, canvas->style.curve_thickness);
+    if (impl->node.laid_out)
+        draw_list->ChannelsSetCurrent(channel);
     if (curve_hovered && ImGui::IsWindowHovered())
     {
         if (ImGui::IsMouseDoubleClicked(0))
             is_connected = false;
     }
 
-    impl->cached_data.SetFloat(MakeSlotDataID("hovered", input_slot, input_node, true), curve_hovered && is_connected);
-    impl->cached_data.SetFloat(MakeSlotDataID("hovered", output_slot, output_node, false), curve_hovered && is_connected);
+    if (curve_hovered && is_connected)
+    {
+        impl->slots.hovered_frame[curve.input_slot] = frame;
+        impl->slots.hovered_frame[curve.output_slot] = frame;
+        impl->nodes.records[curve.input_node].curve_hovered_frame = frame;
+        impl->nodes.records[curve.output_node].curve_hovered_frame = frame;
+    }
 
     void* pending_node_id;
     const char* pending_slot_title;
@@ -682,6 +1557,7 @@ bool BeginSlot(const char* title, int kind)
 
     impl->slot.title = title;
     impl->slot.kind = kind;
+    impl->slot.handle = impl->slots.Get(impl->node.id, title, IsInputSlotKind(kind));
 
     ImGui::BeginGroup();
     return true;
@@ -717,9 +1593,10 @@ void EndSlot()
         else
             x = slot_rect.Max.x;
 
-        impl->cached_data.SetFloat(MakeSlotDataID("x", impl->slot.title, impl->node.id, IsInputSlotKind(impl->slot.kind)), x);
-        impl->cached_data.SetFloat(MakeSlotDataID("y", impl->slot.title, impl->node.id, IsInputSlotKind(impl->slot.kind)),
-            slot_rect.Max.y - slot_rect.GetHeight() / 2);
+        // Relative to the node in canvas units, see GetSlotPosition()
+        ImVec2 offset = (ImVec2{x, slot_rect.Max.y - slot_rect.GetHeight() / 2} - impl->node.layout_origin) / canvas->zoom;
+        impl->slots.x[impl->slot.handle] = offset.x;
+        impl->slots.y[impl->slot.handle] = offset.y;
     }
 
     if (ImGui::BeginDragDropSource())
@@ -783,6 +1660,130 @@ void EndSlot()
     ImGui::PopID(); // name
 }
 
+/// Appends a quad of a solid color to the geometry of the minimap.
+void AddMinimapQuad(_NodeGeometry& geometry, const ImVec2& a, const ImVec2& b, const ImVec2& c, const ImVec2& d, ImU32 color)
+{
+    const ImVec2 uv = ImGui::GetDrawListSharedData()->TexUvWhitePixel;
+    unsigned int base = (unsigned int)geometry.vertices.size();
+    geometry.vertices.push_back(ImDrawVert{a, uv, color});
+    geometry.vertices.push_back(ImDrawVert{b, uv, color});
+    geometry.vertices.push_back(ImDrawVert{c, uv, color});
+    geometry.vertices.push_back(ImDrawVert{d, uv, color});
+    const unsigned int quad[6] = {0, 1, 2, 0, 2, 3};
+    for (unsigned int i : quad)
+        geometry.indices.push_back((ImDrawIdx)(base + i));
+}
+
+/// Fits the placed nodes and connections into a minimap of `size` and tessellates them: nodes are rectangles of at
+/// least two pixels, connections are straight lines between their ends.
+void BuildMinimap(_CanvasStateImpl* impl, const CanvasState* canvas, const ImVec2& size, ImTextureID texture)
+{
+    IMNODES_ZONE("ImNodes::BuildMinimap");
+    auto& minimap = impl->minimap;
+    ImRect bounds{FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < (int)impl->nodes.records.size(); i++)
+    {
+        if (impl->nodes.IsPlaced(i))
+            bounds.Add(impl->nodes.records[i].rect);
+    }
+    if (bounds.Min.x > bounds.Max.x)
+        bounds = ImRect{0, 0, 1, 1};
+
+    // Same aspect as the minimap, with a margin
+    bounds.Expand(ImMax(bounds.GetWidth(), bounds.GetHeight()) * 0.05f);
+    float scale = ImMin(size.x / bounds.GetWidth(), size.y / bounds.GetHeight());
+    bounds.Expand((size / scale - bounds.GetSize()) / 2);
+    minimap.bounds = bounds;
+    minimap.scale = scale;
+
+    _NodeGeometry& geometry = minimap.geometry;
+    geometry.vertices.clear();
+    geometry.indices.clear();
+    geometry.commands.clear();
+    ImU32 node_color = canvas->colors[ColNodeBorder];
+    for (int i = 0; i < (int)impl->nodes.records.size(); i++)
+    {
+        if (!impl->nodes.IsPlaced(i))
+            continue;
+        const ImRect& rect = impl->nodes.records[i].rect;
+        ImVec2 min = (rect.Min - bounds.Min) * scale;
+        ImVec2 max = ImMax((rect.Max - bounds.Min) * scale, min + ImVec2{2.f, 2.f});
+        AddMinimapQuad(geometry, min, ImVec2{max.x, min.y}, max, ImVec2{min.x, max.y}, node_color);
+    }
+    ImU32 curve_color = canvas->colors[ColConnection];
+    for (const _CurveRecord& curve : impl->curves.records)
+    {
+        if (curve.zoom == 0.f)
+            continue;   // Never tessellated
+        ImVec2 a = (curve.input_pos - bounds.Min) * scale;
+        ImVec2 b = (curve.output_pos - bounds.Min) * scale;
+        ImVec2 d = b - a;
+        float length = ImSqrt(d.x * d.x + d.y * d.y);
+        ImVec2 normal = length > 0.f ? ImVec2{-d.y, d.x} * (0.5f / length) : ImVec2{0.f, 0.5f};
+        AddMinimapQuad(geometry, a + normal, b + normal, b - normal, a - normal, curve_color);
+    }
+
+    _NodeGeometry::Command command{};
+    command.canvas_clip = true;
+    command.texture = texture;
+    command.elements = (int)geometry.indices.size();
+    geometry.commands.push_back(command);
+    minimap.size = size;
+    minimap.node_changes = impl->nodes.changes;
+    minimap.curve_changes = impl->curves.changes;
+}
+
+void Minimap(const ImVec2& size)
+{
+    assert(gCanvas != nullptr);
+    auto* canvas = gCanvas;
+    auto* impl = canvas->_impl;
+    auto& minimap = impl->minimap;
+    const ImGuiStyle& style = ImGui::GetStyle();
+    const ImVec2 window_pos = ImGui::GetWindowPos();
+    const ImVec2 window_size = ImGui::GetWindowSize();
+    const ImVec2 origin = window_pos + canvas->offset;
+
+    // A child window in the bottom-right corner, which takes the mouse from the nodes under it
+    const ImVec2 cursor = ImGui::GetCursorScreenPos();
+    ImGui::SetCursorScreenPos(window_pos + window_size - size - style.WindowPadding);
+    ImGui::PushStyleColor(ImGuiCol_ChildBg, canvas->colors[ColNodeBg].Value);
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2{0.f, 0.f});
+    ImGui::BeginChild("minimap", size, true, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+    ImGui::PopStyleVar();
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    const ImVec2 map_pos = ImGui::GetWindowPos();
+
+    // Tessellated again only when nodes or connections moved
+    if (minimap.node_changes != impl->nodes.changes || minimap.curve_changes != impl->curves.changes ||
+        !(minimap.size == size))
+        BuildMinimap(impl, canvas, size, draw_list->_TextureIdStack.back());
+    ReplayGeometry(draw_list, minimap.geometry, map_pos);
+
+    // Visible area of the canvas
+    ImRect view{(window_pos - origin) / canvas->zoom, (window_pos + window_size - origin) / canvas->zoom};
+    ImRect view_rect{map_pos + (view.Min - minimap.bounds.Min) * minimap.scale,
+                     map_pos + (view.Max - minimap.bounds.Min) * minimap.scale};
+    draw_list->AddRectFilled(view_rect.Min, view_rect.Max, canvas->colors[ColSelectBg]);
+    draw_list->AddRect(view_rect.Min, view_rect.Max, canvas->colors[ColSelectBorder]);
+
+    // Clicking centers the view on the clicked point, dragging moves the visible area
+    ImGui::SetCursorScreenPos(map_pos);
+    ImGui::InvisibleButton("view", size);
+    const ImVec2 mouse = ImGui::GetMousePos();
+    if (ImGui::IsItemActivated())
+        minimap.grab = view_rect.Contains(mouse) ? mouse - view_rect.GetCenter() : ImVec2{};
+    if (ImGui::IsItemActive())
+    {
+        ImVec2 center = minimap.bounds.Min + (mouse - minimap.grab - map_pos) / minimap.scale;
+        canvas->offset = window_size / 2 - center * canvas->zoom;
+    }
+
+    ImGui::EndChild();
+    ImGui::PopStyleColor();
+    ImGui::SetCursorScreenPos(cursor);
+}
+
 void AutoPositionNode(void* node_id)
 {
     assert(gCanvas != nullptr);
@@ -805,9 +1806,9 @@ bool IsSlotCurveHovered()
                slot_kind == impl->slot.kind;
     }
 
-    // Actual curve is hovered
-    return impl->cached_data.GetBool(MakeSlotDataID("hovered", impl->slot.title, impl->node.id,
-           IsInputSlotKind(impl->slot.kind)));
+    // Actual curve is hovered. Connections may be rendered before or after their slots, so this is the state of the
+    // current or the previous frame.
+    return impl->slots.hovered_frame[impl->slot.handle] >= ImGui::GetCurrentContext()->FrameCount - 1;
 }
 
 bool IsConnectingCompatibleSlot()
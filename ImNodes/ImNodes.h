@@ -68,6 +68,9 @@ struct IMGUI_API CanvasState
         /// Indent connection into slot widget a little. Useful when slot content covers connection end with some kind
         /// of icon (like a circle) and then no seam between icon and connection end is visible.
         float connection_indent = 1.f;
+        /// Below this zoom nodes are drawn as rectangles with a title and a status color (see SetNodeSummary()) instead
+        /// of their content, the slots of each side of a node meet at one point and connections have few segments.
+        float detail_zoom = 0.5f;
     } style{};
     /// Implementation detail.
     _CanvasStateImpl* _impl = nullptr;
@@ -80,10 +83,29 @@ struct IMGUI_API CanvasState
 IMGUI_API void BeginCanvas(CanvasState* canvas);
 /// Terminate a node graph canvas that was created by calling BeginCanvas().
 IMGUI_API void EndCanvas();
-/// Begin rendering of node in a graph. Render node content when returns `true`.
+/// Returns `true` when the node is near the visible area, or was never submitted. Other nodes are culled by BeginNode().
+IMGUI_API bool IsNodeVisible(void* node_id);
+/// Sets the content version of the next node, which must change whenever its content would draw differently. While
+/// it is unchanged, the node is not interacted with and the zoom stays the same, BeginNode() returns `false` and the
+/// geometry drawn at the last layout of the content is replayed instead. 0, the default, lays the content out every frame.
+IMGUI_API void SetNextNodeVersion(ImU32 version);
+/// Begin rendering of node in a graph. Render node content when returns `true`. Returns `false` when the content is
+/// not needed: the node is out of view, summarized (see IsNodeSummarized()) or replayed (see SetNextNodeVersion()).
+/// Either way, GetNewConnection() and Connection() of the node are called next, as connections may cross the view,
+/// and then EndNode().
 IMGUI_API bool BeginNode(void* node_id, ImVec2* pos, bool* selected);
-/// Terminates current node. Should be called regardless of BeginNode() returns value.
+/// Terminates current node. Must be called regardless of BeginNode() return value.
 IMGUI_API void EndNode();
+/// Returns `true` when the current node is drawn as a summary because the canvas is zoomed out. BeginNode() returned
+/// `false` and SetNodeSummary() should be called instead of rendering content.
+IMGUI_API bool IsNodeSummarized();
+/// Sets the title and status color of the summary of the current node. Color 0 means no status. `title` must stay
+/// valid until EndNode().
+IMGUI_API void SetNodeSummary(const char* title, ImU32 status_color = 0);
+/// Draws an overview of the nodes and connections in the bottom-right corner of the canvas, with the visible area as a
+/// rectangle which can be dragged. Clicking elsewhere centers the view. The overview is tessellated again only when
+/// nodes or connections moved. Call after the nodes, before EndCanvas().
+IMGUI_API void Minimap(const ImVec2& size = ImVec2{200.f, 150.f});
 /// Specified node will be positioned at the mouse cursor on next frame. Call when new node is created.
 IMGUI_API void AutoPositionNode(void* node_id);
 /// Returns `true` when new connection is made. Connection information is returned into `connection` parameter. Must be
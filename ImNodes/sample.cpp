@@ -89,8 +89,9 @@ struct BaseNode
     /// Renders a single node and it's connections.
     void RenderNode()
     {
-        // Start rendering node
-        if (ImNodes::BeginNode(this, &pos, &selected))
+        // Start rendering node. Content is skipped when the node is out of view or drawn without it.
+        bool visible = ImNodes::BeginNode(this, &pos, &selected);
+        if (visible)
         {
             // Here goes node content
 
@@ -106,40 +107,41 @@ struct BaseNode
 
             // Render node-specific slots
             RenderNodeSlots();
+        }
 
-            // Store new connections when they are created
-            Connection new_connection;
-            if (ImNodes::GetNewConnection(&new_connection.input_node, &new_connection.input_slot,
-                &new_connection.output_node, &new_connection.output_slot))
-            {
-                ((BaseNode*) new_connection.input_node)->connections.push_back(new_connection);
-                ((BaseNode*) new_connection.output_node)->connections.push_back(new_connection);
-            }
+        // Store new connections when they are created
+        Connection new_connection;
+        if (ImNodes::GetNewConnection(&new_connection.input_node, &new_connection.input_slot,
+            &new_connection.output_node, &new_connection.output_slot))
+        {
+            ((BaseNode*) new_connection.input_node)->connections.push_back(new_connection);
+            ((BaseNode*) new_connection.output_node)->connections.push_back(new_connection);
+        }
 
-            // Render output connections of this node
-            for (const Connection& connection : connections)
+        // Render output connections of this node, which may cross the view even when the node is out of it
+        for (const Connection& connection : connections)
+        {
+            // Node contains all it's connections (both from output and to input slots). This means that multiple
+            // nodes will have same connection. We render only output connections and ensure that each connection
+            // will be rendered once.
+            if (connection.output_node != this)
+                continue;
+
+            if (!ImNodes::Connection(connection.input_node, connection.input_slot, connection.output_node,
+                connection.output_slot))
             {
-                // Node contains all it's connections (both from output and to input slots). This means that multiple
-                // nodes will have same connection. We render only output connections and ensure that each connection
-                // will be rendered once.
-                if (connection.output_node != this)
-                    continue;
-
-                if (!ImNodes::Connection(connection.input_node, connection.input_slot, connection.output_node,
-                    connection.output_slot))
-                {
-                    // Remove deleted connections
-                    ((BaseNode*) connection.input_node)->DeleteConnection(connection);
-                    ((BaseNode*) connection.output_node)->DeleteConnection(connection);
-                }
+                // Remove deleted connections
+                ((BaseNode*) connection.input_node)->DeleteConnection(connection);
+                ((BaseNode*) connection.output_node)->DeleteConnection(connection);
             }
+        }
 
-            // Node rendering is done. This call will render node background based on size of content inside node.
-            ImNodes::EndNode();
+        // Node rendering is done. This call will render node background based on size of content inside node.
+        ImNodes::EndNode();
 
-            // Store node width which is needed for centering title.
+        // Store node width which is needed for centering title.
+        if (visible)
             node_width = ImGui::GetItemRectSize().x;
-        }
     }
 
     /// Renders custom node content (slots, widgets)
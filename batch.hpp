@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glob.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// Batch execution: the same graph is run over many inputs, with a bounded number of graph instances at once.
+//
+// The scheduler is polled with Update(), from the GUI loop or from the headless loop of `vpe --batch`, so that graph
+// instances are only ever prepared and launched from one thread.
+
+/// Expands a job list: `@file` reads one input per line, anything else is a glob pattern (or a plain path).
+inline std::vector<std::string> ExpandJobList(const std::vector<std::string>& specs)
+{
+    std::vector<std::string> inputs;
+    for (const auto& spec : specs)
+    {
+        if (spec.empty())
+            continue;
+        if (spec[0] == '@')
+        {
+            FILE* file = fopen(spec.c_str() + 1, "r");
+            if (!file)
+            {
+                perror(spec.c_str() + 1);
+                continue;
+            }
+            char line[4096];
+            while (fgets(line, sizeof(line), file))
+            {
+                line[strcspn(line, "\r\n")] = 0;
+                if (line[0] && line[0] != '#')
+                    inputs.push_back(line);
+            }
+            fclose(file);
+            continue;
+        }
+        glob_t g;
+        if (glob(spec.c_str(), GLOB_NOCHECK | GLOB_TILDE, nullptr, &g) == 0)
+        {
+            for (size_t i = 0; i < g.gl_pathc; i++)
+                inputs.push_back(g.gl_pathv[i]);
+        }
+        globfree(&g);
+    }
+    return inputs;
+}
+
+struct BatchJob
+{
+    int index = 0;
+    std::string input;
+    int attempt = 0;
+};
+
+/// One running instance of the graph.
+class BatchInstance
+{
+public:
+
+    virtual ~BatchInstance()
+    {
+    }
+
+    /// Polls the instance, called by the scheduler before the other functions.
+    virtual void Update() = 0;
+    virtual bool IsRunning() = 0;
+    /// Whether some block of the instance failed, valid once it stopped running.
+    virtual bool HasFailed() = 0;
+    virtual void Stop() = 0;
+    /// Console output of the instance, for the job log.
+    virtual std::string GetLog() = 0;
+};
+
+struct BatchOptions
+{
+    /// Maximum number of instances at once, 0 to derive it from the core count and the measured CPU usage of the
+    /// commands, up to one instance per core.
+    int instances = 0;
+    /// Attempts after the first failure of a job.
+    int retries = 1;
+    /// Directory of the per-job logs, none if empty.
+    std::string log_dir = "logs";
+};
+
+class BatchScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    /// Launches an instance for `job`. Returns nullptr and fills `error` when the graph cannot be prepared.
+    typedef std::function<BatchInstance*(const BatchJob& job, std::string& error)> Launcher;
+
+private:
+    struct Running
+    {
+        BatchJob job;
+        std::unique_ptr<BatchInstance> instance;
+        Clock::time_point start;
+    };
+
+    BatchOptions options;
+    Launcher launcher;
+    std::deque<BatchJob> pending;
+    std::vector<Running> running;
+    int total = 0;
+    bool cancelled = false;
+
+    Clock::time_point start;
+    Clock::time_point end;
+    int succeeded = 0;
+    int failed = 0;
+    int retried = 0;
+    double job_seconds = 0;
+    /// Wall time of every finished attempt, to relate to the CPU time.
+    double instance_seconds = 0;
+    double input_bytes = 0;
+    int cores = 1;
+    /// Measured cores used by one instance, 0 until a job finished.
+    double instance_cpu = 0;
+    double cpu_at_start = 0;
+
+    /// CPU time of the reaped children of vpe, in seconds. The time of vpe itself is left out, most of it goes to the
+    /// GUI rather than to the instances.
+    static double CpuSeconds()
+    {
+        rusage usage;
+        if (getrusage(RUSAGE_CHILDREN, &usage) != 0)
+            return 0;
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec
+               + usage.ru_stime.tv_usec * 1e-6;
+    }
+
+    static double Seconds(Clock::time_point a, Clock::time_point b)
+    {
+        return std::chrono::duration<double>(b - a).count();
+    }
+
+    void Log(const Running& r, const char* status)
+    {
+        if (options.log_dir.empty())
+            return;
+        mkdir(options.log_dir.c_str(), 0755);
+        std::string filename = options.log_dir + "/job" + std::to_string(r.job.index) + ".log";
+        FILE* file = fopen(filename.c_str(), r.job.attempt == 0 ? "w" : "a");
+        if (!file)
+        {
+            perror(filename.c_str());
+            return;
+        }
+        fprintf(file, "== %s, attempt %d: %s after %.1f s\n", r.job.input.c_str(), r.job.attempt + 1, status,
+                Seconds(r.start, Clock::now()));
+        std::string log = r.instance ? r.instance->GetLog() : "";
+        fwrite(log.data(), 1, log.size(), file);
+        fclose(file);
+    }
+
+    void Finish(Running& r, bool ok)
+    {
+        double seconds = Seconds(r.start, Clock::now());
+        instance_seconds += seconds;
+        if (ok)
+        {
+            succeeded++;
+            job_seconds += seconds;
+            struct stat st;
+            if (stat(r.job.input.c_str(), &st) == 0)
+                input_bytes += st.st_size;
+            Log(r, "ok");
+        }
+        else if (!cancelled && r.job.attempt < options.retries)
+        {
+            retried++;
+            Log(r, "failed, retrying");
+            BatchJob job = r.job;
+            job.attempt++;
+            pending.push_back(job);
+        }
+        else
+        {
+            failed++;
+            Log(r, cancelled ? "cancelled" : "failed");
+        }
+        printf("batch: job %d (%s) %s in %.1f s\n", r.job.index, r.job.input.c_str(), ok ? "done" : "failed", seconds);
+
+        // children are reaped by now, so their CPU time is accounted
+        if (instance_seconds > 0)
+            instance_cpu = (CpuSeconds() - cpu_at_start) / instance_seconds;
+    }
+
+public:
+
+    BatchScheduler(const BatchOptions& options, const Launcher& launcher) : options(options), launcher(launcher)
+    {
+        cores = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    ~BatchScheduler()
+    {
+        Cancel();
+    }
+
+    void Start(const std::vector<std::string>& inputs)
+    {
+        for (const auto& input : inputs)
+        {
+            BatchJob job;
+            job.index = total++;
+            job.input = input;
+            pending.push_back(job);
+        }
+        start = end = Clock::now();
+        cpu_at_start = CpuSeconds();
+    }
+
+    void Cancel()
+    {
+        cancelled = true;
+        for (auto& job : pending)
+            printf("batch: job %d (%s) cancelled\n", job.index, job.input.c_str());
+        failed += (int) pending.size();
+        pending.clear();
+        for (auto& r : running)
+            r.instance->Stop();
+    }
+
+    /// Number of instances the scheduler aims at.
+    int GetTargetInstances() const
+    {
+        // jobs that fail fast or wait on I/O measure close to no CPU, yet each instance has its processes and fifos
+        int target;
+        if (instance_cpu > 0)
+            target = std::min((int) (cores / instance_cpu + 0.5), cores);
+        else
+            target = (cores + 1) / 2;  // nothing measured yet
+        if (options.instances > 0)
+            target = std::min(target, options.instances);
+        return std::max(target, 1);
+    }
+
+    /// Reaps finished instances and launches pending jobs. Returns false once every job is done.
+    bool Update()
+    {
+        for (size_t i = 0; i < running.size();)
+        {
+            Running& r = running[i];
+            r.instance->Update();
+            if (r.instance->IsRunning())
+            {
+                i++;
+                continue;
+            }
+            Finish(r, !r.instance->HasFailed() && !cancelled);
+            running.erase(running.begin() + i);
+        }
+
+        while (!pending.empty() && (int) running.size() < GetTargetInstances())
+        {
+            Running r;
+            r.job = pending.front();
+            pending.pop_front();
+            r.start = Clock::now();
+            std::string error;
+            r.instance.reset(launcher(r.job, error));
+            if (!r.instance)
+            {
+                // the graph itself is broken, retrying will not help
+                fprintf(stderr, "batch: job %d (%s): %s\n", r.job.index, r.job.input.c_str(), error.c_str());
+                r.job.attempt = options.retries;
+                Finish(r, false);
+                continue;
+            }
+            running.push_back(std::move(r));
+        }
+
+        if (!IsDone())
+            end = Clock::now();
+        return !IsDone();
+    }
+
+    bool IsDone() const
+    {
+        return pending.empty() && running.empty();
+    }
+
+    int GetTotal() const { return total; }
+    int GetSucceeded() const { return succeeded; }
+    int GetFailed() const { return failed; }
+    int GetRunning() const { return (int) running.size(); }
+
+    /// Aggregate throughput, for the console and the GUI.
+    std::string GetReport() const
+    {
+        double wall = Seconds(start, end);
+        int finished = succeeded + failed;
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+                 "%d/%d jobs finished, %d ok, %d failed, %d retries\n"
+                 "%.1f s wall, %.3f jobs/s, %.1f MB/s of input, %.1f s per job\n"
+                 "%d instances on %d cores (%.2f cores per instance)\n",
+                 finished, total, succeeded, failed, retried,
+                 wall, wall > 0 ? succeeded / wall : 0., wall > 0 ? input_bytes / wall / 1e6 : 0.,
+                 succeeded ? job_seconds / succeeded : 0.,
+                 GetTargetInstances(), cores, instance_cpu);
+        return buffer;
+    }
+};
@@ -0,0 +1,141 @@
+// Measures the per-frame cost of the connections of an ImNodes canvas.
+//
+// usage: bench_canvas [connections frames]
+//
+// Graphs are rendered headless, once with their connections and once without, so that the difference is what the
+// connections cost in time and in vertices:
+//  - chain: a chain of nodes laid out on a grid, mostly out of view as in a large graph. Culled connections still have
+//    to find their slots every frame.
+//  - dense: a screenful of nodes with random connections crossing the view.
+//
+// The nodes are also rendered with content versions, for their recorded geometry to be replayed.
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <imgui.h>
+#include "ImNodes.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Node
+{
+    ImVec2 pos;
+    bool selected = false;
+    /// Nodes connected to the output slot.
+    std::vector<int> outputs;
+};
+
+static const char* InputSlot = "in";
+static const char* OutputSlot = "out";
+
+static void RenderFrame(ImNodes::CanvasState& canvas, std::vector<Node>& nodes, bool connections, bool versioned)
+{
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1280, 720);
+    io.DeltaTime = 1.f / 60;
+    io.MousePos = ImVec2(-FLT_MAX, -FLT_MAX);
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0, 0));
+    ImGui::SetNextWindowSize(io.DisplaySize);
+    ImGui::Begin("canvas", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize);
+    ImNodes::BeginCanvas(&canvas);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node& node = nodes[i];
+        if (versioned)
+            ImNodes::SetNextNodeVersion(1);
+        if (ImNodes::BeginNode(&node, &node.pos, &node.selected))
+        {
+            ImGui::Text("node %d", (int) i);
+            if (ImNodes::BeginInputSlot(InputSlot, 1))
+            {
+                ImGui::TextUnformatted(InputSlot);
+                ImNodes::EndSlot();
+            }
+            if (ImNodes::BeginOutputSlot(OutputSlot, 1))
+            {
+                ImGui::TextUnformatted(OutputSlot);
+                ImNodes::EndSlot();
+            }
+        }
+        for (int input : connections ? node.outputs : std::vector<int>())
+            ImNodes::Connection(&nodes[input], InputSlot, &node, OutputSlot);
+        ImNodes::EndNode();
+    }
+    ImNodes::EndCanvas();
+    ImGui::End();
+    ImGui::Render();
+}
+
+struct Measure
+{
+    double ms = 0.;
+    int vertices = 0;
+};
+
+/// Time and vertices per frame, after a few frames for the canvas to lay out and index the nodes.
+static Measure MeasureFrames(std::vector<Node>& nodes, bool connections, bool versioned, int nframes)
+{
+    ImNodes::CanvasState canvas;
+    for (int i = 0; i < 3; i++)
+        RenderFrame(canvas, nodes, connections, versioned);
+    Measure measure;
+    auto start = Clock::now();
+    for (int i = 0; i < nframes; i++)
+        RenderFrame(canvas, nodes, connections, versioned);
+    measure.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / nframes;
+    measure.vertices = ImGui::GetDrawData()->TotalVtxCount;
+    return measure;
+}
+
+static void Report(const char* name, std::vector<Node>& nodes, int nconnections, int nframes)
+{
+    Measure without = MeasureFrames(nodes, false, false, nframes);
+    Measure with = MeasureFrames(nodes, true, false, nframes);
+    Measure replayed = MeasureFrames(nodes, false, true, nframes);
+    printf("%s: %d nodes: %.3f ms/frame, %d vertices, %.3f ms/frame replayed\n", name, (int) nodes.size(), without.ms,
+           without.vertices, replayed.ms);
+    printf("%s: %d connections: %.3f ms/frame, %.3f us and %.1f vertices per connection\n", name, nconnections,
+           with.ms, (with.ms - without.ms) * 1000. / nconnections,
+           (double) (with.vertices - without.vertices) / nconnections);
+}
+
+int main(int argc, char** argv)
+{
+    int nconnections = argc > 1 ? atoi(argv[1]) : 10000;
+    int nframes = argc > 2 ? atoi(argv[2]) : 200;
+
+    ImGui::CreateContext();
+    unsigned char* pixels;
+    int width, height;
+    ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    std::vector<Node> chain(nconnections + 1);
+    for (size_t i = 0; i < chain.size(); i++)
+    {
+        chain[i].pos = ImVec2((i % 100) * 200.f, (i / 100) * 150.f);
+        if (i > 0)
+            chain[i - 1].outputs.push_back((int) i);
+    }
+    Report("chain", chain, nconnections, nframes);
+
+    // five random inputs per node, more vertices than 16-bit indices can address
+    std::vector<Node> dense(200);
+    std::mt19937 random(0);
+    int ndense = 0;
+    for (size_t i = 0; i < dense.size(); i++)
+    {
+        dense[i].pos = ImVec2((i % 20) * 64.f, (i / 20) * 70.f);
+        for (int k = 0; k < 5; k++, ndense++)
+            dense[random() % dense.size()].outputs.push_back((int) i);
+    }
+    Report("dense", dense, ndense, nframes);
+
+    ImGui::DestroyContext();
+    return 0;
+}
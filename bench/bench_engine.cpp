@@ -0,0 +1,135 @@
+// Microbenchmark of the in-process engine: task dispatch overhead, frame pool reuse and a chain of built-in nodes.
+//
+// usage: bench_engine [tasks frames]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "builtin.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Counts frames and signals the end of the stream.
+class CountingSink : public FrameSink
+{
+public:
+    std::mutex mutex;
+    std::condition_variable cv;
+    int frames = 0;
+    bool closed = false;
+
+    virtual void Push(Frame* frame) override
+    {
+        FramePool::Release(frame);
+        std::lock_guard<std::mutex> lock(mutex);
+        frames++;
+    }
+
+    virtual void Close() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        cv.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return closed; });
+    }
+};
+
+int main(int argc, char** argv)
+{
+    const int ntasks = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int nframes = argc > 2 ? atoi(argv[2]) : 200;
+    Engine& engine = GetEngine();
+    FramePool& pool = GetFramePool();
+    printf("%d workers\n", engine.GetSize());
+
+    // Dispatch: empty tasks through ParallelFor, from outside the engine.
+    {
+        std::atomic<int> sum{0};
+        auto start = Clock::now();
+        engine.ParallelFor(ntasks, [&](int) { sum.fetch_add(1, std::memory_order_relaxed); });
+        double seconds = Seconds(start);
+        printf("dispatch         %8.1f ns/task (%d tasks, %llu steals)\n", seconds * 1e9 / ntasks, sum.load(),
+               (unsigned long long) engine.GetStealCount());
+    }
+
+    // Dispatch: many small loops, as a built-in node does for each frame.
+    {
+        const int nloops = ntasks / 64;
+        auto start = Clock::now();
+        for (int i = 0; i < nloops; i++)
+            engine.ParallelFor(64, [](int) {});
+        double seconds = Seconds(start);
+        printf("parallel-for(64) %8.1f us/loop\n", seconds * 1e6 / nloops);
+    }
+
+    // Pool: acquire/release of full HD frames.
+    {
+        vpp::Format format;
+        format.w = 1920;
+        format.h = 1080;
+        format.d = 3;
+        uint64_t allocations = pool.GetAllocationCount();
+        auto start = Clock::now();
+        for (int i = 0; i < ntasks; i++)
+            FramePool::Release(pool.Acquire(format));
+        double seconds = Seconds(start);
+        printf("pool             %8.1f ns/frame (%llu allocations for %d frames)\n", seconds * 1e9 / ntasks,
+               (unsigned long long) (pool.GetAllocationCount() - allocations), ntasks);
+    }
+
+    // Chain of 10 in-process map nodes, fed from this thread.
+    {
+        vpp::Format format;
+        format.w = 640;
+        format.h = 480;
+        format.d = 3;
+
+        Expression expr;
+        expr.Compile("x*0.5+1");
+        std::vector<MapNode*> chain;
+        for (int i = 0; i < 10; i++)
+        {
+            chain.push_back(new MapNode(expr));
+            if (i > 0)
+                chain[i - 1]->AddOutput(chain[i]);
+        }
+        CountingSink sink;
+        chain.back()->AddOutput(&sink);
+        for (auto node : chain)
+            node->Launch();
+
+        FrameCredits credits(4);
+        std::atomic<bool> stop{false};
+        uint64_t allocations = pool.GetAllocationCount();
+        auto start = Clock::now();
+        for (int i = 0; i < nframes; i++)
+        {
+            credits.Acquire(stop);
+            Frame* frame = pool.Acquire(format);
+            frame->credits = &credits;
+            frame->sequence = i;
+            for (size_t k = 0; k < format.Count(); k++)
+                frame->data[k] = (float) k;
+            chain.front()->Push(frame);
+        }
+        chain.front()->Close();
+        sink.Wait();
+        double seconds = Seconds(start);
+        printf("10-node chain    %8.3f ms/frame (%d frames, %llu allocations)\n", seconds * 1e3 / nframes, sink.frames,
+               (unsigned long long) (pool.GetAllocationCount() - allocations));
+        for (auto node : chain)
+            delete node;
+    }
+    return 0;
+}
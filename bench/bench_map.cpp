@@ -0,0 +1,200 @@
+// Compares the in-process `builtin map` block with the external `vp map` command.
+//
+// usage: bench_map [width height depth frames [expression]]
+//
+// Both variants are fed through fifos by the same writer/reader threads, so the numbers include the fifo transport
+// the pipeline would actually use. The built-in node is also measured behind shared-memory rings, the way it runs
+// between two commands using vpe_shm.h. The external variant is skipped when `vp` is not in PATH.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.hpp"
+#include "shm.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double Seconds(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/// Pushes `nframes` copies of `frame` through `in` and drains `out`. `launch` starts the filter between them.
+static double RunThroughFifos(const std::string& in, const std::string& out, const vpp::Format& format,
+                              const std::vector<float>& frame, int nframes, const std::function<void()>& launch)
+{
+    std::atomic<bool> stop{false};
+    int received = 0;
+
+    auto start = Clock::now();
+    launch();
+    std::thread feeder([&] {
+        vpp::BlockSigpipe();
+        vpp::Writer writer;
+        if (!writer.Open(in, format, stop))
+            return;
+        for (int i = 0; i < nframes; i++)
+            if (!writer.WriteFrame(frame.data(), stop))
+                break;
+    });
+    std::thread drainer([&] {
+        vpp::Reader reader;
+        if (!reader.Open(out, stop))
+            return;
+        std::vector<float> buffer(reader.format.Count());
+        while (reader.ReadFrame(buffer.data(), stop))
+            received++;
+    });
+    feeder.join();
+    drainer.join();
+    double elapsed = Seconds(start);
+    if (received != nframes)
+        fprintf(stderr, "warning: received %d/%d frames\n", received, nframes);
+    return elapsed;
+}
+
+/// Same as RunThroughFifos(), with the client side of vpe_shm.h.
+static double RunThroughRings(const std::string& in, const std::string& out, const vpp::Format& format,
+                              const std::vector<float>& frame, int nframes, const std::function<void()>& launch)
+{
+    int received = 0;
+
+    auto start = Clock::now();
+    launch();
+    std::thread feeder([&] {
+        vpe_shm_ring* ring = vpe_shm_open(in.c_str());
+        for (int i = 0; ring && i < nframes; i++)
+        {
+            float* slot = vpe_shm_write_begin(ring, format.w, format.h, format.d, -1);
+            if (!slot)
+                break;
+            memcpy(slot, frame.data(), format.Bytes());
+            vpe_shm_write_end(ring);
+        }
+        vpe_shm_close(ring, 1);
+    });
+    std::thread drainer([&] {
+        vpe_shm_ring* ring = vpe_shm_open(out.c_str());
+        int w, h, d;
+        while (ring && vpe_shm_read_begin(ring, &w, &h, &d, -1))
+        {
+            received++;
+            vpe_shm_read_end(ring);
+        }
+        vpe_shm_close(ring, 0);
+    });
+    feeder.join();
+    drainer.join();
+    double elapsed = Seconds(start);
+    if (received != nframes)
+        fprintf(stderr, "warning: received %d/%d frames\n", received, nframes);
+    return elapsed;
+}
+
+static void Report(const char* name, double seconds, const vpp::Format& format, int nframes)
+{
+    double mpix = (double) format.w * format.h * nframes / seconds / 1e6;
+    printf("%-18s %8.3f ms/frame %10.1f Mpix/s\n", name, seconds * 1e3 / nframes, mpix);
+}
+
+int main(int argc, char** argv)
+{
+    vpp::Format format;
+    format.w = argc > 1 ? atoi(argv[1]) : 1920;
+    format.h = argc > 2 ? atoi(argv[2]) : 1080;
+    format.d = argc > 3 ? atoi(argv[3]) : 3;
+    int nframes = argc > 4 ? atoi(argv[4]) : 100;
+    std::string source = argc > 5 ? argv[5] : "(x/255)^2*255";
+
+    Expression expr;
+    if (!expr.Compile(source))
+    {
+        fprintf(stderr, "%s\n", expr.GetError().c_str());
+        return 1;
+    }
+
+    std::vector<float> frame(format.Count());
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(0, 255);
+    for (auto& v : frame)
+        v = dist(rng);
+
+    printf("%dx%dx%d, %d frames, \"%s\", %d threads\n", format.w, format.h, format.d, nframes, source.c_str(),
+           GetEngine().GetSize());
+
+    // Kernel only, no transport.
+    {
+        std::vector<float> out(frame.size());
+        auto start = Clock::now();
+        for (int i = 0; i < nframes; i++)
+            expr.Eval(frame.data(), out.data(), 0, frame.size(), format.w, format.h, format.d);
+        Report("kernel 1 thread", Seconds(start), format, nframes);
+    }
+
+    char dir[] = "/tmp/vpe-bench-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string in = std::string(dir) + "/in";
+    std::string out = std::string(dir) + "/out";
+    mkfifo(in.c_str(), 0600);
+    mkfifo(out.c_str(), 0600);
+
+    {
+        // same blocks as RunContext creates for a built-in node between two external commands
+        MapNode node(expr);
+        FifoSinkBlock output(out);
+        FifoSourceBlock input(in, &node);
+        node.AddOutput(&output);
+        double seconds = RunThroughFifos(in, out, format, frame, nframes, [&] {
+            node.Launch();
+            output.Launch();
+            input.Launch();
+        });
+        Report("builtin map", seconds, format, nframes);
+    }
+
+    {
+        ShmRing in_ring, out_ring;
+        MapNode node(expr);
+        ShmSinkBlock output(out_ring.GetSpec());
+        ShmSourceBlock input(in_ring.GetSpec(), &node);
+        node.AddOutput(&output);
+        double seconds = RunThroughRings(in_ring.GetSpec(), out_ring.GetSpec(), format, frame, nframes, [&] {
+            node.Launch();
+            output.Launch();
+            input.Launch();
+        });
+        Report("builtin map (shm)", seconds, format, nframes);
+    }
+
+    if (system("command -v vp >/dev/null 2>&1") == 0)
+    {
+        Process* process = nullptr;
+        double seconds = RunThroughFifos(in, out, format, frame, nframes, [&] {
+            process = new Process("vp map " + in + " " + out + " '" + source + "'");
+        });
+        process->get_exit_status();
+        delete process;
+        Report("vp map", seconds, format, nframes);
+    }
+    else
+    {
+        printf("vp not found in PATH, skipping external `vp map`\n");
+    }
+
+    unlink(in.c_str());
+    unlink(out.c_str());
+    rmdir(dir);
+    return 0;
+}
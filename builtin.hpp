@@ -0,0 +1,953 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "engine.hpp"
+#include "expr.hpp"
+#include "recording.hpp"
+#include "stats.hpp"
+#include "vpp.hpp"
+
+// Built-in nodes run inside vpe instead of as external processes. A node uses one when its command starts with
+// "builtin", e.g. `builtin map <1 >1 "(x/255)^2*255"`.
+//
+// Built-in nodes are tasks of the engine: a node is scheduled when a frame is pushed to it and processes its inbox in
+// order. Connections between two built-in nodes pass frames in memory. Connections to external commands go through a
+// fifo, with a bridge block reading or writing the vpp stream on its own thread (or through a shared-memory ring, see
+// shm.hpp).
+
+/// Splits a command line into arguments, honoring single and double quotes.
+inline std::vector<std::string> SplitCommand(const std::string& command)
+{
+    std::vector<std::string> args;
+    std::string current;
+    bool in_arg = false;
+    char quote = 0;
+    for (char ch : command)
+    {
+        if (quote)
+        {
+            if (ch == quote)
+                quote = 0;
+            else
+                current += ch;
+        }
+        else if (ch == '"' || ch == '\'')
+        {
+            quote = ch;
+            in_arg = true;
+        }
+        else if (ch == ' ' || ch == '\t')
+        {
+            if (in_arg)
+                args.push_back(current);
+            current.clear();
+            in_arg = false;
+        }
+        else
+        {
+            current += ch;
+            in_arg = true;
+        }
+    }
+    if (in_arg)
+        args.push_back(current);
+    return args;
+}
+
+inline bool IsBuiltinCommand(const std::string& command)
+{
+    return command.compare(0, 8, "builtin ") == 0;
+}
+
+/// Console output of a block, written from runtime threads and read by the GUI.
+class BlockLog
+{
+    mutable std::mutex mutex;
+    std::string text;
+
+public:
+
+    void Log(const char* fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[512];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(buffer, sizeof(buffer), fmt, args);
+        va_end(args);
+        std::lock_guard<std::mutex> lock(mutex);
+        text += buffer;
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        text.clear();
+    }
+
+    std::string Get() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return text;
+    }
+};
+
+/// Receives frames of a stream. Push() hands over one reference of the frame.
+class FrameSink
+{
+public:
+
+    virtual ~FrameSink()
+    {
+    }
+
+    virtual void Push(Frame* frame) = 0;
+    /// End of stream.
+    virtual void Close() = 0;
+};
+
+/// Block running on its own thread inside vpe. Used for the fifo bridges, which block on I/O.
+class ThreadBlock : public Block
+{
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+protected:
+    std::atomic<bool> stop{false};
+    BlockLog log;
+
+    /// Body of the block, called on the block thread. Should return soon after `stop` is set.
+    virtual void Run() = 0;
+
+public:
+
+    virtual ~ThreadBlock()
+    {
+        Join();
+    }
+
+    virtual void Launch() override
+    {
+        Join();
+        log.Clear();
+        stop = false;
+        running = true;
+        thread = std::thread([this] {
+            vpp::BlockSigpipe();
+            Run();
+            running = false;
+            WakeGui();
+        });
+    }
+
+    virtual void Stop() override
+    {
+        stop = true;
+    }
+
+    virtual bool IsRunning() override
+    {
+        return running;
+    }
+
+    virtual std::string GetOutput() const override
+    {
+        return log.Get();
+    }
+
+    void Join()
+    {
+        stop = true;
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+/// Reads a vpp stream from a fifo into pooled frames and pushes them to a built-in node.
+class FifoSourceBlock : public ThreadBlock
+{
+    std::string path;
+    FrameSink* sink;
+    /// Bounds the frames read ahead of the consumer.
+    FrameCredits credits{4};
+
+public:
+
+    FifoSourceBlock(const std::string& path, FrameSink* sink) : path(path), sink(sink) {}
+
+    virtual void Run() override
+    {
+        vpp::Reader reader;
+        if (reader.Open(path, stop))
+        {
+            uint64_t sequence = 0;
+            while (credits.Acquire(stop))
+            {
+                Frame* frame = GetFramePool().Acquire(reader.format);
+                if (!frame)
+                {
+                    log.Log("cannot allocate a %dx%dx%d frame\n", reader.format.w, reader.format.h, reader.format.d);
+                    credits.Return();
+                    break;
+                }
+                if (!reader.ReadFrame(frame->data, stop))
+                {
+                    FramePool::Release(frame);
+                    credits.Return();
+                    break;
+                }
+                frame->credits = &credits;
+                frame->sequence = sequence++;
+                sink->Push(frame);
+            }
+        }
+        else if (reader.GetFd() >= 0 && !stop)
+        {
+            log.Log("not a vpp stream or invalid frame size %dx%dx%d\n", reader.format.w, reader.format.h,
+                    reader.format.d);
+        }
+        sink->Close();
+    }
+};
+
+/// Block consuming on its own thread the frames pushed by a built-in node.
+class QueuedSinkBlock : public ThreadBlock, public FrameSink
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Frame*> queue;
+    size_t head = 0;
+    bool closed = false;
+
+protected:
+
+    /// Next frame to write, or nullptr at the end of the stream or when stopped.
+    Frame* Next()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (head == queue.size())
+        {
+            queue.clear();
+            head = 0;
+            if (closed || stop)
+                return nullptr;
+            cv.wait_for(lock, std::chrono::milliseconds(vpp::PollTimeoutMs));
+        }
+        return queue[head++];
+    }
+
+public:
+
+    QueuedSinkBlock()
+    {
+        queue.reserve(16);
+    }
+
+    virtual ~QueuedSinkBlock()
+    {
+        Join();
+        for (size_t i = head; i < queue.size(); i++)
+            FramePool::Release(queue[i]);
+    }
+
+    virtual void Launch() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = false;
+        }
+        ThreadBlock::Launch();
+    }
+
+    virtual void Push(Frame* frame) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(frame);
+        }
+        cv.notify_one();
+    }
+
+    virtual void Close() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        cv.notify_one();
+    }
+};
+
+/// Writes frames pushed by a built-in node to a fifo.
+class FifoSinkBlock : public QueuedSinkBlock
+{
+    std::string path;
+
+public:
+
+    explicit FifoSinkBlock(const std::string& path) : path(path) {}
+
+    virtual void Run() override
+    {
+        vpp::Writer writer;
+        bool ok = true;
+        // the header needs the frame size, so the fifo is opened with the first frame
+        while (Frame* frame = Next())
+        {
+            if (ok && writer.GetFd() < 0)
+                ok = writer.Open(path, frame->format, stop);
+            if (ok)
+                ok = writer.WriteFrame(frame->data, stop);
+            FramePool::Release(frame);
+        }
+        if (writer.GetFd() < 0 && !stop)
+        {
+            // empty stream: still let the reader see EOF
+            int fd = vpp::OpenFifo(path, true, stop);
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+};
+
+/// Tap on a connection: passes the frames on to `next` and hands one frame out of `every` to Sample() on its own thread.
+/// Frames arriving while the thread is busy are not sampled, so that the tap never holds the pipeline back. Sampled
+/// frames are shared, not copied.
+class SamplingTapBlock : public ThreadBlock, public FrameSink
+{
+    FrameSink* next;
+    std::mutex mutex;
+    std::condition_variable cv;
+    /// Frame waiting for the thread.
+    Frame* pending = nullptr;
+    bool closed = false;
+    uint64_t pushed = 0;
+
+    std::atomic<uint64_t> sampled{0};
+    std::atomic<uint64_t> dropped{0};
+
+protected:
+
+    /// Called on the block thread with a sampled frame, which must not be modified.
+    virtual void Sample(const Frame* frame) = 0;
+
+public:
+
+    /// Sample one frame out of `every`.
+    std::atomic<int> every;
+
+    SamplingTapBlock(FrameSink* next, int every) : next(next), every(every) {}
+
+    virtual ~SamplingTapBlock()
+    {
+        Join();
+        if (pending)
+            FramePool::Release(pending);
+    }
+
+    virtual void Launch() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = false;
+            pushed = 0;
+        }
+        ThreadBlock::Launch();
+    }
+
+    virtual void Push(Frame* frame) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pushed++ % std::max(every.load(), 1) == 0)
+            {
+                if (pending)
+                {
+                    dropped++;
+                }
+                else
+                {
+                    FramePool::Retain(frame);
+                    pending = frame;
+                    sampled++;
+                }
+            }
+        }
+        cv.notify_one();
+        next->Push(frame);
+    }
+
+    virtual void Close() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        cv.notify_one();
+        next->Close();
+    }
+
+    virtual void Run() override
+    {
+        for (;;)
+        {
+            Frame* frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!pending && !closed && !stop)
+                    cv.wait_for(lock, std::chrono::milliseconds(vpp::PollTimeoutMs));
+                if (!pending)
+                    return;
+                frame = pending;
+                pending = nullptr;
+            }
+            Sample(frame);
+            FramePool::Release(frame);
+            WakeGuiForMetrics();
+        }
+    }
+
+    uint64_t GetSampledCount() const { return sampled; }
+    uint64_t GetDroppedCount() const { return dropped; }
+};
+
+/// Computes the statistics of the sampled frames, see stats.hpp.
+class StatsTapBlock : public SamplingTapBlock
+{
+    mutable std::mutex stats_mutex;
+    FrameStats stats;
+    FrameStats scratch;
+    bool ready = false;
+
+public:
+
+    explicit StatsTapBlock(FrameSink* next) : SamplingTapBlock(next, 1) {}
+
+    virtual ~StatsTapBlock()
+    {
+        Join();
+    }
+
+    /// Statistics of the last sampled frame. Returns false before the first one.
+    bool GetStats(FrameStats& out) const
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        if (ready)
+            out = stats;
+        return ready;
+    }
+
+protected:
+
+    virtual void Sample(const Frame* frame) override
+    {
+        ComputeFrameStats(frame->data, frame->format.w, frame->format.h, frame->format.d, scratch);
+        scratch.sequence = frame->sequence;
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        std::swap(stats, scratch);
+        ready = true;
+    }
+};
+
+/// A built-in node, scheduled on the engine whenever frames are waiting in its inbox.
+class EngineNode : public Block, public FrameSink
+{
+    std::mutex mutex;
+    std::vector<Frame*> inbox;
+    size_t head = 0;
+    bool scheduled = false;
+    bool closed = false;
+    bool finished = false;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopped{false};
+    std::vector<FrameSink*> outputs;
+
+    static void RunTask(void* ctx, int)
+    {
+        ((EngineNode*) ctx)->Drain();
+    }
+
+    void Schedule()
+    {
+        // called with `mutex` held
+        if (scheduled)
+            return;
+        scheduled = true;
+        Task task;
+        task.fn = RunTask;
+        task.ctx = this;
+        GetEngine().Submit(task);
+    }
+
+    void Drain()
+    {
+        for (;;)
+        {
+            Frame* frame = nullptr;
+            bool last = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (head == inbox.size())
+                {
+                    inbox.clear();
+                    head = 0;
+                    scheduled = false;
+                    if (!closed || finished)
+                        return;
+                    finished = true;
+                    last = true;
+                }
+                else
+                {
+                    frame = inbox[head++];
+                }
+            }
+
+            if (last)
+            {
+                // end of stream reached; the node may be deleted as soon as it is not running anymore
+                Finish();
+                for (auto output : outputs)
+                    output->Close();
+                running = false;
+                WakeGui();
+                return;
+            }
+
+            if (stopped)
+            {
+                FramePool::Release(frame);
+            }
+            else
+            {
+                PROFILE_ZONE("EngineNode::Process");
+                Process(frame);
+            }
+        }
+    }
+
+protected:
+    BlockLog log;
+
+    /// Processes one frame. Takes over the reference of `frame`.
+    virtual void Process(Frame* frame) = 0;
+
+    /// Called after the last frame.
+    virtual void Finish() {}
+
+    /// Sends a frame to every output. Takes over the reference of `frame`.
+    void Emit(Frame* frame)
+    {
+        if (outputs.empty())
+        {
+            FramePool::Release(frame);
+            return;
+        }
+        for (size_t i = 1; i < outputs.size(); i++)
+            FramePool::Retain(frame);
+        for (auto output : outputs)
+            output->Push(frame);
+    }
+
+public:
+
+    EngineNode()
+    {
+        inbox.reserve(16);
+    }
+
+    virtual ~EngineNode()
+    {
+        for (size_t i = head; i < inbox.size(); i++)
+            FramePool::Release(inbox[i]);
+    }
+
+    void AddOutput(FrameSink* sink)
+    {
+        outputs.push_back(sink);
+    }
+
+    virtual void Launch() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        log.Clear();
+        closed = false;
+        finished = false;
+        stopped = false;
+        running = true;
+    }
+
+    virtual void Stop() override
+    {
+        stopped = true;
+        Close();
+    }
+
+    virtual bool IsRunning() override
+    {
+        return running;
+    }
+
+    virtual std::string GetOutput() const override
+    {
+        return log.Get();
+    }
+
+    virtual void Push(Frame* frame) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inbox.push_back(frame);
+        Schedule();
+    }
+
+    virtual void Close() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        if (running && !finished)
+            Schedule();
+    }
+};
+
+/// `builtin map <1 >1 <expression>`: evaluates a per-sample expression over each frame.
+class MapNode : public EngineNode
+{
+    Expression expr;
+    int nframes = 0;
+    double total_ms = 0;
+
+    /// Samples per engine task.
+    static const size_t ChunkSize = 64 * Expression::Block;
+
+public:
+
+    explicit MapNode(const Expression& expr) : expr(expr) {}
+
+    virtual void Launch() override
+    {
+        EngineNode::Launch();
+        nframes = 0;
+        total_ms = 0;
+    }
+
+    virtual void Process(Frame* in) override
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // frames are only modified in place when nobody else holds them
+        Frame* out = in;
+        if (in->refs > 1)
+        {
+            out = GetFramePool().Acquire(in->format);
+            if (!out)
+            {
+                log.Log("map: cannot allocate a %dx%dx%d frame\n", in->format.w, in->format.h, in->format.d);
+                FramePool::Release(in);
+                // drops the frames still queued and closes the outputs
+                Stop();
+                return;
+            }
+            out->sequence = in->sequence;
+        }
+
+        const vpp::Format format = in->format;
+        const size_t total = format.Count();
+        const int nchunks = (int) ((total + ChunkSize - 1) / ChunkSize);
+        GetEngine().ParallelFor(nchunks, [&](int chunk) {
+            size_t first = chunk * ChunkSize;
+            size_t count = total - first;
+            if (count > ChunkSize)
+                count = ChunkSize;
+            expr.Eval(in->data + first, out->data + first, first, count, format.w, format.h, format.d);
+        });
+        if (out != in)
+            FramePool::Release(in);
+
+        if (nframes++ == 0)
+            log.Log("map: %dx%dx%d frames on %d threads\n", format.w, format.h, format.d, GetEngine().GetSize());
+        total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        Emit(out);
+    }
+
+    virtual void Finish() override
+    {
+        if (nframes)
+            log.Log("map: %d frames, %.3f ms/frame\n", nframes, total_ms / nframes);
+    }
+};
+
+/// Records the frames going through an edge: pushed frames are forwarded to `next` and written to the file on the
+/// block thread.
+class EdgeRecorderBlock : public QueuedSinkBlock
+{
+    std::string path;
+    FrameSink* next;
+    /// Times of the queued frames, in order.
+    std::mutex times_mutex;
+    std::deque<int64_t> times;
+
+public:
+
+    EdgeRecorderBlock(const std::string& path, FrameSink* next) : path(path), next(next) {}
+
+    virtual ~EdgeRecorderBlock()
+    {
+        Join();
+    }
+
+    const std::string& GetPath() const
+    {
+        return path;
+    }
+
+    virtual void Push(Frame* frame) override
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        {
+            std::lock_guard<std::mutex> lock(times_mutex);
+            times.push_back(now);
+        }
+        FramePool::Retain(frame);
+        QueuedSinkBlock::Push(frame);
+        next->Push(frame);
+    }
+
+    virtual void Close() override
+    {
+        QueuedSinkBlock::Close();
+        next->Close();
+    }
+
+    virtual void Run() override
+    {
+        RecordingWriter writer;
+        bool opened = false;
+        bool ok = true;
+        while (Frame* frame = Next())
+        {
+            int64_t time_ns;
+            {
+                std::lock_guard<std::mutex> lock(times_mutex);
+                time_ns = times.front();
+                times.pop_front();
+            }
+            if (ok && !opened)
+            {
+                opened = ok = writer.Open(path, frame->format);
+                if (!ok)
+                    log.Log("cannot record %s: %s\n", path.c_str(), strerror(errno));
+            }
+            if (ok && frame->format != writer.GetFormat())
+            {
+                log.Log("%s: the frame size changed, recording stopped\n", path.c_str());
+                ok = false;
+            }
+            if (ok)
+                ok = writer.Write(frame->data, time_ns);
+            FramePool::Release(frame);
+        }
+        if (opened && writer.Finish())
+            log.Log("%zu frames recorded to %s\n", writer.GetCount(), path.c_str());
+    }
+};
+
+/// `builtin replay <file> >1 [--from N] [--to N] [--loop] [--realtime] [--speed X]`: plays the frames [from, to) of a
+/// recording (see recording.hpp), as fast as the graph takes them or with the timing they were recorded with.
+class ReplayNode : public EngineNode
+{
+    std::unique_ptr<RecordingFile> file;
+    size_t first;
+    size_t last;
+    bool loop;
+    bool realtime;
+    double speed;
+    std::thread thread;
+    std::atomic<bool> quit{false};
+    FrameCredits credits{4};
+
+    /// Waits until `deadline`. Returns false if stopped meanwhile.
+    bool WaitUntil(std::chrono::steady_clock::time_point deadline)
+    {
+        while (!quit)
+        {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero())
+                return true;
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                left, std::chrono::milliseconds(vpp::PollTimeoutMs)));
+        }
+        return false;
+    }
+
+    void Play()
+    {
+        const vpp::Format& format = file->GetFormat();
+        log.Log("replay: frames %zu to %zu of %zu, %dx%dx%d\n", first, last - 1, file->GetCount(), format.w, format.h,
+                format.d);
+        uint64_t sequence = 0;
+        bool playing = true;
+        do
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = first; i < last && playing; i++)
+            {
+                if (i + 1 < last)
+                    file->Prefetch(i + 1);
+                if (realtime)
+                {
+                    auto offset = std::chrono::nanoseconds((int64_t) ((file->GetTime(i) - file->GetTime(first)) / speed));
+                    playing = WaitUntil(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset));
+                }
+                if (!playing || !credits.Acquire(quit))
+                    break;
+                Frame* frame = GetFramePool().Acquire(format);
+                if (!frame)
+                {
+                    log.Log("replay: cannot allocate a %dx%dx%d frame\n", format.w, format.h, format.d);
+                    credits.Return();
+                    playing = false;
+                    break;
+                }
+                memcpy(frame->data, file->GetFrame(i), format.Bytes());
+                frame->credits = &credits;
+                frame->sequence = sequence++;
+                Push(frame);
+            }
+        } while (loop && playing && !quit);
+        Close();
+    }
+
+    void Join()
+    {
+        quit = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+public:
+
+    ReplayNode(RecordingFile* file, size_t first, size_t last, bool loop, bool realtime, double speed)
+        : file(file), first(first), last(last), loop(loop), realtime(realtime), speed(speed) {}
+
+    virtual ~ReplayNode()
+    {
+        Join();
+    }
+
+    virtual void Launch() override
+    {
+        Join();
+        EngineNode::Launch();
+        quit = false;
+        thread = std::thread([this] { Play(); });
+    }
+
+    virtual void Stop() override
+    {
+        quit = true;
+        EngineNode::Stop();
+    }
+
+    virtual void Process(Frame* frame) override
+    {
+        Emit(frame);
+    }
+};
+
+/// Creates the node for a `builtin ...` command. Slot arguments (`<1`, `>1`, ...) are skipped, they are connected by
+/// the caller. Returns nullptr and fills `error` for unknown or malformed commands.
+inline EngineNode* MakeBuiltinNode(const std::string& command, std::string& error)
+{
+    std::vector<std::string> args;
+    for (const auto& arg : SplitCommand(command))
+    {
+        bool is_slot = arg.size() == 2 && (arg[0] == '<' || arg[0] == '>') && arg[1] >= '1' && arg[1] <= '9';
+        if (!is_slot)
+            args.push_back(arg);
+    }
+    if (args.size() < 2)
+    {
+        error = "missing builtin name";
+        return nullptr;
+    }
+
+    if (args[1] == "map")
+    {
+        if (args.size() != 3)
+        {
+            error = "usage: builtin map <1 >1 <expression>";
+            return nullptr;
+        }
+        Expression expr;
+        if (!expr.Compile(args[2]))
+        {
+            error = expr.GetError();
+            return nullptr;
+        }
+        return new MapNode(expr);
+    }
+
+    if (args[1] == "replay")
+    {
+        const char* usage = "usage: builtin replay <file> >1 [--from N] [--to N] [--loop] [--realtime] [--speed X]";
+        if (args.size() < 3)
+        {
+            error = usage;
+            return nullptr;
+        }
+        long first = 0;
+        long last = -1;
+        bool loop = false;
+        bool realtime = false;
+        double speed = 1;
+        for (size_t i = 3; i < args.size(); i++)
+        {
+            bool has_value = i + 1 < args.size();
+            if (args[i] == "--from" && has_value)
+                first = atol(args[++i].c_str());
+            else if (args[i] == "--to" && has_value)
+                last = atol(args[++i].c_str());
+            else if (args[i] == "--speed" && has_value)
+                speed = atof(args[++i].c_str());
+            else if (args[i] == "--loop")
+                loop = true;
+            else if (args[i] == "--realtime")
+                realtime = true;
+            else
+            {
+                error = usage;
+                return nullptr;
+            }
+        }
+        std::unique_ptr<RecordingFile> file(new RecordingFile());
+        if (!file->Open(args[2], error))
+            return nullptr;
+        long count = (long) file->GetCount();
+        if (last < 0 || last > count)
+            last = count;
+        if (first < 0 || first >= last || speed <= 0)
+        {
+            error = "empty range or invalid speed, the recording has " + std::to_string(count) + " frames";
+            return nullptr;
+        }
+        return new ReplayNode(file.release(), first, last, loop, realtime, speed);
+    }
+
+    error = "unknown builtin '" + args[1] + "'";
+    return nullptr;
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.hpp"
+
+// Result cache: the output streams of nodes marked deterministic are kept on disk, keyed by a hash of the command, of
+// the keys of the upstream nodes and of the metadata of the input files. When every consumed output of a node is in
+// the cache, the node and whatever only feeds it are not launched; the cached streams are replayed instead.
+//
+// The cache lives in $VPE_CACHE (default "cache") and is capped to $VPE_CACHE_SIZE megabytes (default 4096), the least
+// recently used streams being evicted first.
+
+class ResultCache
+{
+    std::string dir;
+    uint64_t max_bytes;
+    int hits = 0;
+    int misses = 0;
+    uint64_t bytes_served = 0;
+    /// Total size of the streams as of the last scan, -1 before the first one. Kept up to date by Evict() and Clear(),
+    /// so that showing it does not scan the directory.
+    int64_t size = -1;
+
+public:
+
+    ResultCache()
+    {
+        const char* env = getenv("VPE_CACHE");
+        dir = env && *env ? env : "cache";
+        env = getenv("VPE_CACHE_SIZE");
+        max_bytes = (uint64_t) (env && *env ? atoll(env) : 4096) << 20;
+    }
+
+    /// 128-bit FNV-1a of `text`, in hexadecimal.
+    static std::string Hash(const std::string& text)
+    {
+        uint64_t a = 0xcbf29ce484222325ull;
+        uint64_t b = 0x84222325cbf29ce4ull;
+        for (unsigned char c : text)
+        {
+            a = (a ^ c) * 0x100000001b3ull;
+            b = (b ^ c) * 0x100000001b3ull;
+            b ^= b >> 29;
+        }
+        char hex[33];
+        snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long) a, (unsigned long long) b);
+        return hex;
+    }
+
+    /// Metadata of a file for cache keys, empty if it is not a regular file.
+    static std::string FileStamp(const std::string& path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            return std::string();
+        return path + ":" + std::to_string((long long) st.st_size) + ":" + std::to_string((long long) st.st_mtim.tv_sec)
+               + "." + std::to_string((long long) st.st_mtim.tv_nsec);
+    }
+
+    std::string GetPath(const std::string& key, int slot) const
+    {
+        return dir + "/" + key + "-" + std::to_string(slot) + ".vpp";
+    }
+
+    /// Whether the stream is cached; marks it as recently used.
+    bool Contains(const std::string& path)
+    {
+        if (access(path.c_str(), R_OK) != 0)
+            return false;
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        return true;
+    }
+
+    void CountLookup(bool hit)
+    {
+        (hit ? hits : misses)++;
+    }
+
+    void CountServed(uint64_t bytes)
+    {
+        bytes_served += bytes;
+    }
+
+    /// Temporary file a stream is recorded into, renamed by Commit().
+    std::string BeginRecord(const std::string& path)
+    {
+        mkdir(dir.c_str(), 0755);
+        return path + ".part";
+    }
+
+    void Commit(const std::string& part, const std::string& path)
+    {
+        if (rename(part.c_str(), path.c_str()) != 0)
+        {
+            perror(path.c_str());
+            unlink(part.c_str());
+            return;
+        }
+        Evict();
+    }
+
+    void Abort(const std::string& part)
+    {
+        unlink(part.c_str());
+    }
+
+    /// Removes the least recently used streams until the cache fits in its cap.
+    void Evict()
+    {
+        struct Entry
+        {
+            std::string path;
+            uint64_t size;
+            time_t used;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = ListEntries([&](const std::string& path, const struct stat& st) {
+            entries.push_back(Entry{path, (uint64_t) st.st_size, st.st_mtime});
+        });
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (const auto& e : entries)
+        {
+            if (total <= max_bytes)
+                break;
+            printf("cache: evict %s\n", e.path.c_str());
+            unlink(e.path.c_str());
+            total -= e.size;
+        }
+        size = (int64_t) total;
+    }
+
+    void Clear()
+    {
+        ListEntries([](const std::string& path, const struct stat&) { unlink(path.c_str()); });
+        size = 0;
+    }
+
+    /// Size of the cached streams, as of the last commit.
+    uint64_t GetSize()
+    {
+        if (size < 0)
+            size = (int64_t) ListEntries([](const std::string&, const struct stat&) {});
+        return (uint64_t) size;
+    }
+
+    uint64_t GetMaxSize() const { return max_bytes; }
+    int GetHits() const { return hits; }
+    int GetMisses() const { return misses; }
+    uint64_t GetBytesServed() const { return bytes_served; }
+
+private:
+
+    /// Calls `fn` for every cached stream, returns their total size.
+    template <typename F>
+    uint64_t ListEntries(F fn)
+    {
+        uint64_t total = 0;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+            return 0;
+        while (dirent* entry = readdir(d))
+        {
+            size_t len = strlen(entry->d_name);
+            if (len < 4 || strcmp(entry->d_name + len - 4, ".vpp"))
+                continue;
+            std::string path = dir + "/" + entry->d_name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+            total += st.st_size;
+            fn(path, st);
+        }
+        closedir(d);
+        return total;
+    }
+};
+
+/// Copies a vpp stream from a fifo to another fifo and/or a file. Without destination the stream is drained, so that
+/// the writer is not blocked by a consumer that was not launched.
+class StreamCopyBlock : public ThreadBlock
+{
+    std::string from;
+    std::string to;
+    std::string file;
+    std::atomic<bool> complete{false};
+
+public:
+
+    StreamCopyBlock(const std::string& from, const std::string& to, const std::string& file)
+        : from(from), to(to), file(file) {}
+
+    /// Whether the whole stream went to the file.
+    bool IsComplete() const
+    {
+        return complete;
+    }
+
+    virtual void Run() override
+    {
+        complete = false;
+        vpp::Reader reader;
+        if (!reader.Open(from, stop))
+            return;
+        vpp::Writer writer;
+        bool relay = !to.empty() && writer.Open(to, reader.format, stop);
+        FILE* out = nullptr;
+        if (!file.empty() && !(out = fopen(file.c_str(), "wb")))
+            log.Log("cannot record %s: %s\n", file.c_str(), strerror(errno));
+        bool recording = out != nullptr;
+        if (recording)
+        {
+            int dims[3] = {reader.format.w, reader.format.h, reader.format.d};
+            recording = fwrite("VPPF", 4, 1, out) == 1 && fwrite(dims, sizeof(dims), 1, out) == 1;
+        }
+
+        std::vector<float> data(reader.format.Count());
+        while (reader.ReadFrame(data.data(), stop))
+        {
+            if (relay && !writer.WriteFrame(data.data(), stop))
+                relay = false;
+            if (recording)
+                recording = fwrite("FRAM", 4, 1, out) == 1 && fwrite(data.data(), reader.format.Bytes(), 1, out) == 1;
+        }
+        if (out)
+            recording = fclose(out) == 0 && recording;
+        complete = recording && !stop;
+    }
+};
+
+/// Streams a cached file into a fifo.
+class CacheReplayBlock : public ThreadBlock
+{
+    std::string file;
+    std::string to;
+    std::atomic<uint64_t> served{0};
+
+public:
+
+    CacheReplayBlock(const std::string& file, const std::string& to) : file(file), to(to) {}
+
+    uint64_t GetBytesServed() const
+    {
+        return served;
+    }
+
+    virtual void Run() override
+    {
+        served = 0;
+        int in = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+        {
+            log.Log("cannot open %s: %s\n", file.c_str(), strerror(errno));
+            return;
+        }
+        int out = vpp::OpenFifo(to, true, stop);
+        std::unique_ptr<char[]> buffer(new char[1 << 20]);
+        ssize_t n;
+        while (out >= 0 && (n = read(in, buffer.get(), 1 << 20)) > 0)
+        {
+            if (!vpp::WriteFull(out, buffer.get(), n, stop))
+                break;
+            served += n;
+        }
+        if (out >= 0)
+            close(out);
+        close(in);
+        log.Log("%llu bytes from the cache\n", (unsigned long long) served);
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Memory limits of commands through cgroup v2. vpe needs a subtree delegated to it, given by $VPE_CGROUP, e.g.
+//
+//     systemd-run --user --scope -p Delegate=yes sh -c 'VPE_CGROUP=/sys/fs/cgroup$(cut -d: -f3 /proc/self/cgroup) vpe'
+//
+// vpe itself must not live in that cgroup once it has children with controllers (the "no internal processes" rule), so
+// it moves itself to a `vpe` leaf first.
+
+class CgroupTree
+{
+    std::string root;
+    bool available = false;
+    std::vector<std::string> created;
+
+    static bool WriteFile(const std::string& filename, const std::string& value)
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+            return false;
+        bool ok = fputs(value.c_str(), file) >= 0;
+        ok = fclose(file) == 0 && ok;
+        return ok;
+    }
+
+    /// Moves vpe to its leaf and enables the memory controller for the children of `root`. Done once per process,
+    /// every tree of the process shares the delegated cgroup.
+    static bool SetUp(const std::string& root)
+    {
+        std::string self = root + "/vpe";
+        mkdir(self.c_str(), 0755);
+        if (!WriteFile(self + "/cgroup.procs", std::to_string(getpid())))
+            perror((self + "/cgroup.procs").c_str());
+        if (!WriteFile(root + "/cgroup.subtree_control", "+memory"))
+        {
+            perror((root + "/cgroup.subtree_control").c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /// Numbers the cgroups of the process, trees of several runs create theirs side by side.
+    static std::atomic<int>& NextId()
+    {
+        static std::atomic<int> next{0};
+        return next;
+    }
+
+public:
+
+    CgroupTree()
+    {
+        const char* env = getenv("VPE_CGROUP");
+        if (!env || !*env)
+            return;
+        root = env;
+        static const bool set_up = SetUp(root);
+        available = set_up;
+    }
+
+    ~CgroupTree()
+    {
+        Clear();
+    }
+
+    CgroupTree(const CgroupTree&) = delete;
+    CgroupTree& operator=(const CgroupTree&) = delete;
+
+    bool IsAvailable() const
+    {
+        return available;
+    }
+
+    /// Creates a cgroup whose processes may use at most `memory_max` bytes of memory, swap included. Returns its path,
+    /// or an empty string when it cannot be created.
+    std::string Create(size_t memory_max)
+    {
+        if (!available)
+            return std::string();
+        std::string path = root + "/node" + std::to_string(getpid()) + "." + std::to_string(NextId()++);
+        if (mkdir(path.c_str(), 0755) != 0)
+        {
+            perror(path.c_str());
+            return std::string();
+        }
+        if (!WriteFile(path + "/memory.max", std::to_string(memory_max)))
+        {
+            perror(path.c_str());
+            rmdir(path.c_str());
+            return std::string();
+        }
+        WriteFile(path + "/memory.swap.max", "0");
+        created.push_back(path);
+        return path;
+    }
+
+    /// Removes the cgroups, whose processes must have exited.
+    void Clear()
+    {
+        for (const auto& path : created)
+            rmdir(path.c_str());
+        created.clear();
+    }
+
+    /// Whether the kernel killed a process of the cgroup for exceeding memory.max.
+    static bool WasOomKilled(const std::string& path)
+    {
+        FILE* file = fopen((path + "/memory.events").c_str(), "r");
+        if (!file)
+            return false;
+        char key[64];
+        unsigned long long value;
+        bool killed = false;
+        while (fscanf(file, "%63s %llu", key, &value) == 2)
+        {
+            if (!strcmp(key, "oom_kill") && value > 0)
+                killed = true;
+        }
+        fclose(file);
+        return killed;
+    }
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Pipeline daemon: `vpe --daemon` owns the execution of a graph, and GUIs attach to it over a Unix socket. The graph
+// keeps running when a GUI detaches or dies, and several GUIs may be attached at once.
+//
+// Messages are a 8-byte header {uint32 size, uint32 type} followed by `size` bytes, in host byte order since both ends
+// are on the same machine:
+//
+//     Graph      both ways   the graph file (see SaveGraph), sent to every attached GUI when it changes
+//     Run, Stop  to daemon   empty
+//     Subscribe  to daemon   uint32 mask of Status and Metrics streams
+//     Status     from daemon uint32 flags, uint32 count, then a NodeStatus per node, in graph order
+//     Metrics    from daemon uint32 count, then an EdgeMetrics per connection, in graph order
+//
+// Messages larger than Peer::MaxMessage close the connection. The daemon runs the commands of any graph pushed to it,
+// so its socket is only accessible to its user, and peers of another user are rejected.
+//
+// Status and metrics are sent at 10 Hz. A GUI that does not keep up misses updates rather than slowing the daemon: with
+// 4 bytes per node and 16 per connection, a graph of 1000 connections streams 160 KB/s.
+
+namespace daemon_protocol
+{
+
+enum MessageType : uint32_t
+{
+    Graph = 1,
+    Run = 2,
+    Stop = 3,
+    Subscribe = 4,
+    Status = 5,
+    Metrics = 6,
+};
+
+enum StreamMask : uint32_t
+{
+    StatusStream = 1,
+    MetricsStream = 2,
+};
+
+enum StatusFlags : uint32_t
+{
+    GraphRunning = 1,
+    GraphFailed = 2,
+};
+
+struct Header
+{
+    uint32_t size;
+    uint32_t type;
+};
+
+struct NodeStatus
+{
+    enum State : uint8_t
+    {
+        Idle,
+        Running,
+        FromCache,
+        LimitHit,
+    };
+
+    uint8_t state;
+    uint8_t reserved;
+    uint16_t crashes;
+};
+
+/// Latencies of the connection when the daemon measures them, zero otherwise.
+struct EdgeMetrics
+{
+    uint32_t frames;
+    float p50_ms;
+    float p99_ms;
+    float max_ms;
+};
+
+/// Path of the socket: $VPE_SOCKET, else $XDG_RUNTIME_DIR/vpe.sock, else /tmp/vpe-<uid>.sock.
+inline std::string GetSocketPath()
+{
+    const char* env = getenv("VPE_SOCKET");
+    if (env && *env)
+        return env;
+    env = getenv("XDG_RUNTIME_DIR");
+    if (env && *env)
+        return std::string(env) + "/vpe.sock";
+    return "/tmp/vpe-" + std::to_string(getuid()) + ".sock";
+}
+
+inline bool MakeAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/// Whether the other end of `fd` runs as the same user as this process.
+inline bool IsSameUser(int fd)
+{
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 && credentials.uid == geteuid();
+}
+
+/// One end of a connection: buffers what is sent and parses what is received, without ever blocking.
+class Peer
+{
+    int fd;
+    std::string input;
+    std::string output;
+
+public:
+
+    /// Updates dropped when this much output is pending, to let a slow peer catch up.
+    static const size_t DropThreshold = 1 << 20;
+    /// The peer is considered dead when this much output is pending.
+    static const size_t MaxPending = 64 << 20;
+    /// Largest message accepted, the peer is considered broken beyond.
+    static const size_t MaxMessage = 16 << 20;
+
+    explicit Peer(int fd) : fd(fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~Peer()
+    {
+        close(fd);
+    }
+
+    Peer(const Peer&) = delete;
+    Peer& operator=(const Peer&) = delete;
+
+    int GetFd() const { return fd; }
+    bool HasPendingOutput() const { return !output.empty(); }
+
+    /// Queues a message. Updates (`droppable`) are skipped while the peer is behind.
+    bool Send(uint32_t type, const void* data, size_t size, bool droppable = false)
+    {
+        if (droppable && output.size() > DropThreshold)
+            return true;
+        if (output.size() + size > MaxPending)
+            return false;
+        Header header = {(uint32_t) size, type};
+        output.append((const char*) &header, sizeof(header));
+        output.append((const char*) data, size);
+        return Flush();
+    }
+
+    bool Send(uint32_t type, const std::string& body, bool droppable = false)
+    {
+        return Send(type, body.data(), body.size(), droppable);
+    }
+
+    /// Writes what the socket accepts. Returns false when the connection is closed.
+    bool Flush()
+    {
+        while (!output.empty())
+        {
+            ssize_t n = send(fd, output.data(), output.size(), MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                output.erase(0, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        return true;
+    }
+
+    /// Reads what is available, up to a complete message of the largest size. Returns false when the connection is
+    /// closed or a message is too large.
+    bool Receive()
+    {
+        char buffer[1 << 16];
+        for (;;)
+        {
+            if (input.size() >= sizeof(Header))
+            {
+                Header header;
+                memcpy(&header, input.data(), sizeof(header));
+                if (header.size > MaxMessage)
+                    return false;
+            }
+            // the rest stays in the socket until Next() took the messages out
+            if (input.size() >= sizeof(Header) + MaxMessage)
+                return true;
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n > 0)
+            {
+                input.append(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    /// Takes the next complete message out of the received data.
+    bool Next(uint32_t& type, std::string& body)
+    {
+        Header header;
+        if (input.size() < sizeof(header))
+            return false;
+        memcpy(&header, input.data(), sizeof(header));
+        if (input.size() < sizeof(header) + header.size)
+            return false;
+        type = header.type;
+        body.assign(input, sizeof(header), header.size);
+        input.erase(0, sizeof(header) + header.size);
+        return true;
+    }
+};
+
+/// Listening socket of the daemon and its attached peers.
+class Server
+{
+    int fd = -1;
+    std::string path;
+
+public:
+
+    struct Client
+    {
+        std::unique_ptr<Peer> peer;
+        uint32_t streams = 0;
+    };
+    std::vector<Client> clients;
+
+    ~Server()
+    {
+        clients.clear();
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(path.c_str());
+        }
+    }
+
+    /// Listens on `path`. A stale socket left by a dead daemon is replaced, a live one is not.
+    bool Listen(const std::string& path, std::string& error)
+    {
+        sockaddr_un address;
+        if (!MakeAddress(path, address))
+        {
+            error = path + ": path too long";
+            return false;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && connect(probe, (sockaddr*) &address, sizeof(address)) == 0)
+        {
+            bool same_user = IsSameUser(probe);
+            close(probe);
+            error = path + (same_user ? ": a daemon is already running" : ": used by another user");
+            return false;
+        }
+        if (probe >= 0)
+            close(probe);
+        unlink(path.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd < 0)
+        {
+            error = path + ": " + strerror(errno);
+            return false;
+        }
+        // connecting needs write access to the socket file, only the user gets it from its creation on
+        mode_t mask = umask(077);
+        int bound = bind(fd, (sockaddr*) &address, sizeof(address));
+        umask(mask);
+        if (bound != 0 || listen(fd, 16) != 0)
+        {
+            error = path + ": " + strerror(errno);
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        this->path = path;
+        return true;
+    }
+
+    /// Waits up to `timeout_ms` for activity, accepts new clients and reads from the others. Returns the indices of
+    /// the clients that were accepted; clients whose connection closed are removed.
+    std::vector<size_t> Poll(int timeout_ms)
+    {
+        std::vector<pollfd> fds(1 + clients.size());
+        fds[0] = {fd, POLLIN, 0};
+        for (size_t i = 0; i < clients.size(); i++)
+            fds[i + 1] = {clients[i].peer->GetFd(), (short) (POLLIN | (clients[i].peer->HasPendingOutput() ? POLLOUT : 0)),
+                          0};
+        poll(fds.data(), fds.size(), timeout_ms);
+
+        std::vector<bool> alive(clients.size(), true);
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+                alive[i] = clients[i].peer->Receive();
+            if (alive[i] && (fds[i + 1].revents & POLLOUT))
+                alive[i] = clients[i].peer->Flush();
+        }
+        for (size_t i = clients.size(); i-- > 0;)
+        {
+            if (!alive[i])
+                clients.erase(clients.begin() + i);
+        }
+
+        std::vector<size_t> accepted;
+        if (fds[0].revents & POLLIN)
+        {
+            int client;
+            while ((client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0)
+            {
+                if (!IsSameUser(client))
+                {
+                    fprintf(stderr, "rejected a client of another user\n");
+                    close(client);
+                    continue;
+                }
+                accepted.push_back(clients.size());
+                clients.emplace_back();
+                clients.back().peer.reset(new Peer(client));
+            }
+        }
+        return accepted;
+    }
+
+    /// Sends a message to the clients subscribed to `stream` (0: every client), except `except`.
+    void Broadcast(uint32_t type, const std::string& body, uint32_t stream, const Peer* except = nullptr)
+    {
+        for (size_t i = clients.size(); i-- > 0;)
+        {
+            Client& c = clients[i];
+            if (c.peer.get() == except || (stream && !(c.streams & stream)))
+                continue;
+            if (!c.peer->Send(type, body, stream != 0))
+                clients.erase(clients.begin() + i);
+        }
+    }
+};
+
+/// Connects to the daemon listening on `path`. Returns nullptr on failure.
+inline Peer* Connect(const std::string& path, std::string& error)
+{
+    sockaddr_un address;
+    if (!MakeAddress(path, address))
+    {
+        error = path + ": path too long";
+        return nullptr;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        error = path + ": " + strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return nullptr;
+    }
+    // the graph would be run by someone else
+    if (!IsSameUser(fd))
+    {
+        error = path + ": the daemon runs as another user";
+        close(fd);
+        return nullptr;
+    }
+    return new Peer(fd);
+}
+
+}   // namespace daemon_protocol
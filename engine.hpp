@@ -0,0 +1,427 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+#include "vpp.hpp"
+
+// In-process execution engine for built-in nodes: a work-stealing thread pool plus a pool of recycled frame buffers.
+
+/// Frame buffers and per-worker queues are aligned on cache lines to avoid false sharing.
+static const size_t CacheLine = 64;
+
+struct Task
+{
+    void (*fn)(void* ctx, int index) = nullptr;
+    void* ctx = nullptr;
+    int index = 0;
+    /// Decremented once `fn` returned, if not null.
+    std::atomic<int>* pending = nullptr;
+};
+
+/// Bounded task queue. The owning worker pushes and pops at the back, thieves take the oldest task at the front.
+class TaskDeque
+{
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    size_t head = 0;
+    size_t size = 0;
+
+public:
+
+    explicit TaskDeque(size_t capacity = 4096) : tasks(capacity) {}
+
+    bool Push(const Task& task)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size == tasks.size())
+            return false;
+        tasks[(head + size) % tasks.size()] = task;
+        size++;
+        return true;
+    }
+
+    bool Pop(Task& task)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size == 0)
+            return false;
+        size--;
+        task = tasks[(head + size) % tasks.size()];
+        return true;
+    }
+
+    bool Steal(Task& task)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size == 0)
+            return false;
+        task = tasks[head];
+        head = (head + 1) % tasks.size();
+        size--;
+        return true;
+    }
+};
+
+class Engine
+{
+    struct Worker
+    {
+        TaskDeque deque;
+        char padding[CacheLine];
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    /// Tasks submitted from threads that are not workers of this engine.
+    TaskDeque inject;
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<int> queued{0};
+    std::atomic<int> sleepers{0};
+    bool quit = false;
+
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> steals{0};
+
+    struct ThreadState
+    {
+        Engine* engine = nullptr;
+        int index = -1;
+    };
+
+    static ThreadState& Current()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    int Self()
+    {
+        return Current().engine == this ? Current().index : -1;
+    }
+
+    void Execute(const Task& task)
+    {
+        PROFILE_ZONE("engine task");
+        task.fn(task.ctx, task.index);
+        executed.fetch_add(1, std::memory_order_relaxed);
+        if (task.pending)
+            task.pending->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    bool Take(int self, Task& task)
+    {
+        if (self >= 0 && workers[self]->deque.Pop(task))
+            return true;
+        if (inject.Steal(task))
+            return true;
+        int n = (int) workers.size();
+        for (int k = 1; k <= n; k++)
+        {
+            int victim = (self + k + n) % n;
+            if (victim != self && workers[victim]->deque.Steal(task))
+            {
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(int self)
+    {
+        Current().engine = this;
+        Current().index = self;
+        ProfileThreadName("engine");
+        for (;;)
+        {
+            if (RunOne())
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            // Announce sleeping before checking for work, Submit() checks in the opposite order.
+            sleepers++;
+            sleep_cv.wait(lock, [this] { return quit || queued > 0; });
+            sleepers--;
+            if (quit)
+                return;
+        }
+    }
+
+public:
+
+    explicit Engine(unsigned nthreads = std::thread::hardware_concurrency())
+    {
+        if (nthreads == 0)
+            nthreads = 1;
+        for (unsigned i = 0; i < nthreads; i++)
+            workers.emplace_back(new Worker());
+        for (unsigned i = 0; i < nthreads; i++)
+            threads.emplace_back([this, i] { WorkerLoop(i); });
+    }
+
+    ~Engine()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            quit = true;
+        }
+        sleep_cv.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    int GetSize() const
+    {
+        return (int) workers.size();
+    }
+
+    uint64_t GetExecutedCount() const { return executed; }
+    uint64_t GetStealCount() const { return steals; }
+
+    /// Queues a task. Tasks submitted by a worker go to its own deque, where idle workers can steal them.
+    void Submit(const Task& task)
+    {
+        int self = Self();
+        if (!(self >= 0 && workers[self]->deque.Push(task)) && !inject.Push(task))
+        {
+            // queues are full, run it right away rather than blocking
+            Execute(task);
+            return;
+        }
+        queued++;
+        if (sleepers > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            sleep_cv.notify_one();
+        }
+    }
+
+    /// Runs one queued task on the calling thread. Returns false when there was nothing to do.
+    bool RunOne()
+    {
+        Task task;
+        if (!Take(Self(), task))
+            return false;
+        queued--;
+        Execute(task);
+        return true;
+    }
+
+    /// Calls fn(ctx, 0) .. fn(ctx, n-1) and returns once they all finished. The calling thread works on the loop
+    /// (and on other queued tasks) while waiting, so it is safe to call from a task.
+    void ParallelFor(int n, void (*fn)(void* ctx, int index), void* ctx)
+    {
+        if (n <= 0)
+            return;
+        std::atomic<int> pending(n - 1);
+        for (int i = 1; i < n; i++)
+        {
+            Task task;
+            task.fn = fn;
+            task.ctx = ctx;
+            task.index = i;
+            task.pending = &pending;
+            Submit(task);
+        }
+        fn(ctx, 0);
+        while (pending.load(std::memory_order_acquire) > 0)
+        {
+            if (!RunOne())
+                std::this_thread::yield();
+        }
+    }
+
+    template <typename F>
+    void ParallelFor(int n, const F& fn)
+    {
+        ParallelFor(n, [](void* ctx, int index) { (*(const F*) ctx)(index); }, (void*) &fn);
+    }
+};
+
+inline Engine& GetEngine()
+{
+    static Engine engine;
+    return engine;
+}
+
+struct Frame;
+class FrameCredits;
+
+/// Whoever provides the memory of frames: frames go back to their owner when the last reference is released.
+class FrameOwner
+{
+public:
+
+    virtual ~FrameOwner()
+    {
+    }
+
+    virtual void Recycle(Frame* frame) = 0;
+};
+
+/// A vpp frame in memory. Frames are reference counted and go back to their owner when the last reference is released.
+struct Frame
+{
+    vpp::Format format;
+    float* data = nullptr;
+    /// Allocated size of `data`, in floats.
+    size_t capacity = 0;
+    /// Index of the frame in its stream.
+    uint64_t sequence = 0;
+    std::atomic<int> refs{0};
+    FrameOwner* owner = nullptr;
+    /// Credit returned when the frame is recycled, used by sources to bound the number of frames in flight.
+    FrameCredits* credits = nullptr;
+};
+
+/// Counting semaphore limiting the frames a source may have in flight.
+class FrameCredits
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    int available;
+
+public:
+
+    explicit FrameCredits(int count) : available(count) {}
+
+    /// Waits for a credit. Returns false if `stop` was set meanwhile.
+    bool Acquire(const std::atomic<bool>& stop)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (available == 0)
+        {
+            if (stop)
+                return false;
+            cv.wait_for(lock, std::chrono::milliseconds(vpp::PollTimeoutMs));
+        }
+        available--;
+        return true;
+    }
+
+    void Return()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            available++;
+        }
+        cv.notify_one();
+    }
+};
+
+/// Recycles cache-aligned frame buffers, so that steady-state processing does not allocate.
+class FramePool : public FrameOwner
+{
+    std::mutex mutex;
+    std::vector<Frame*> free_frames;
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> reuses{0};
+
+    virtual void Recycle(Frame* frame) override
+    {
+        frame->credits = nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        free_frames.push_back(frame);
+    }
+
+public:
+
+    FramePool()
+    {
+        free_frames.reserve(256);
+    }
+
+    ~FramePool()
+    {
+        for (Frame* frame : free_frames)
+        {
+            free(frame->data);
+            delete frame;
+        }
+    }
+
+    /// Returns a frame with one reference and room for `format`. Contents are undefined. Returns null when the memory
+    /// cannot be allocated.
+    Frame* Acquire(const vpp::Format& format)
+    {
+        const size_t count = format.Count();
+        Frame* frame = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // smallest buffer that fits, but do not waste more than half of it
+            size_t best = free_frames.size();
+            for (size_t i = 0; i < free_frames.size(); i++)
+            {
+                size_t capacity = free_frames[i]->capacity;
+                if (capacity >= count && capacity / 2 <= count
+                    && (best == free_frames.size() || capacity < free_frames[best]->capacity))
+                    best = i;
+            }
+            if (best != free_frames.size())
+            {
+                frame = free_frames[best];
+                free_frames[best] = free_frames.back();
+                free_frames.pop_back();
+            }
+        }
+
+        if (frame)
+        {
+            reuses++;
+        }
+        else
+        {
+            frame = new Frame();
+            size_t bytes = (count * sizeof(float) + CacheLine - 1) / CacheLine * CacheLine;
+            void* data = nullptr;
+            if (posix_memalign(&data, CacheLine, bytes ? bytes : CacheLine) != 0)
+            {
+                delete frame;
+                return nullptr;
+            }
+            frame->data = (float*) data;
+            frame->capacity = count;
+            frame->owner = this;
+            allocations++;
+        }
+
+        frame->format = format;
+        frame->sequence = 0;
+        frame->refs = 1;
+        return frame;
+    }
+
+    static void Retain(Frame* frame)
+    {
+        frame->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void Release(Frame* frame)
+    {
+        if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        FrameCredits* credits = frame->credits;
+        frame->owner->Recycle(frame);
+        if (credits)
+            credits->Return();
+    }
+
+    uint64_t GetAllocationCount() const { return allocations; }
+    uint64_t GetReuseCount() const { return reuses; }
+};
+
+inline FramePool& GetFramePool()
+{
+    static FramePool pool;
+    return pool;
+}
@@ -0,0 +1,484 @@
+#include "expr.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+struct Parser
+{
+    const char* s;
+    std::vector<Expression::Instr>& code;
+    std::string& error;
+    bool uses_coords = false;
+
+    Parser(const char* s, std::vector<Expression::Instr>& code, std::string& error)
+        : s(s), code(code), error(error) {}
+
+    void SkipSpaces()
+    {
+        while (*s == ' ' || *s == '\t' || *s == '\n')
+            s++;
+    }
+
+    bool Accept(const char* token)
+    {
+        SkipSpaces();
+        size_t n = strlen(token);
+        if (strncmp(s, token, n) != 0)
+            return false;
+        s += n;
+        return true;
+    }
+
+    bool Fail(const std::string& what)
+    {
+        if (error.empty())
+            error = what + " at '" + std::string(s) + "'";
+        return false;
+    }
+
+    void Emit(Expression::Op op, float value = 0)
+    {
+        code.push_back(Expression::Instr{op, value});
+    }
+
+    bool ParseComparison()
+    {
+        if (!ParseSum())
+            return false;
+        for (;;)
+        {
+            Expression::Op op;
+            if (Accept("<="))
+                op = Expression::OpLe;
+            else if (Accept(">="))
+                op = Expression::OpGe;
+            else if (Accept("=="))
+                op = Expression::OpEq;
+            else if (Accept("!="))
+                op = Expression::OpNe;
+            else if (Accept("<"))
+                op = Expression::OpLt;
+            else if (Accept(">"))
+                op = Expression::OpGt;
+            else
+                return true;
+            if (!ParseSum())
+                return false;
+            Emit(op);
+        }
+    }
+
+    bool ParseSum()
+    {
+        if (!ParseProduct())
+            return false;
+        for (;;)
+        {
+            Expression::Op op;
+            if (Accept("+"))
+                op = Expression::OpAdd;
+            else if (Accept("-"))
+                op = Expression::OpSub;
+            else
+                return true;
+            if (!ParseProduct())
+                return false;
+            Emit(op);
+        }
+    }
+
+    bool ParseProduct()
+    {
+        if (!ParseUnary())
+            return false;
+        for (;;)
+        {
+            Expression::Op op;
+            if (Accept("*"))
+                op = Expression::OpMul;
+            else if (Accept("/"))
+                op = Expression::OpDiv;
+            else if (Accept("%"))
+                op = Expression::OpMod;
+            else
+                return true;
+            if (!ParseUnary())
+                return false;
+            Emit(op);
+        }
+    }
+
+    bool ParseUnary()
+    {
+        if (Accept("-"))
+        {
+            if (!ParseUnary())
+                return false;
+            Emit(Expression::OpNeg);
+            return true;
+        }
+        if (Accept("+"))
+            return ParseUnary();
+        return ParsePower();
+    }
+
+    bool ParsePower()
+    {
+        if (!ParsePrimary())
+            return false;
+        if (Accept("^"))
+        {
+            // right associative, binds tighter than unary minus on its left: -x^2 == -(x^2)
+            if (!ParseUnary())
+                return false;
+            Emit(Expression::OpPow);
+        }
+        return true;
+    }
+
+    bool ParseArguments(int n)
+    {
+        if (!Accept("("))
+            return Fail("expected '('");
+        for (int i = 0; i < n; i++)
+        {
+            if (i && !Accept(","))
+                return Fail("expected ','");
+            if (!ParseComparison())
+                return false;
+        }
+        if (!Accept(")"))
+            return Fail("expected ')'");
+        return true;
+    }
+
+    bool ParsePrimary()
+    {
+        SkipSpaces();
+        if (Accept("("))
+        {
+            if (!ParseComparison())
+                return false;
+            if (!Accept(")"))
+                return Fail("expected ')'");
+            return true;
+        }
+
+        if ((*s >= '0' && *s <= '9') || *s == '.')
+        {
+            char* end;
+            float value = strtof(s, &end);
+            if (end == s)
+                return Fail("bad number");
+            s = end;
+            Emit(Expression::OpConst, value);
+            return true;
+        }
+
+        const char* start = s;
+        while ((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') || (*s >= '0' && *s <= '9') || *s == '_')
+            s++;
+        std::string name(start, s);
+        if (name.empty())
+            return Fail("unexpected character");
+
+        static const struct { const char* name; Expression::Op op; int nargs; } functions[] = {
+            {"abs", Expression::OpAbs, 1},
+            {"sqrt", Expression::OpSqrt, 1},
+            {"exp", Expression::OpExp, 1},
+            {"log", Expression::OpLog, 1},
+            {"sin", Expression::OpSin, 1},
+            {"cos", Expression::OpCos, 1},
+            {"tan", Expression::OpTan, 1},
+            {"floor", Expression::OpFloor, 1},
+            {"ceil", Expression::OpCeil, 1},
+            {"round", Expression::OpRound, 1},
+            {"min", Expression::OpMin, 2},
+            {"max", Expression::OpMax, 2},
+            {"pow", Expression::OpPow, 2},
+            {"atan2", Expression::OpAtan2, 2},
+            {"clamp", Expression::OpClamp, 3},
+        };
+        for (const auto& f : functions)
+        {
+            if (name != f.name)
+                continue;
+            if (!ParseArguments(f.nargs))
+                return false;
+            Emit(f.op);
+            return true;
+        }
+
+        if (name == "x")
+            Emit(Expression::OpX);
+        else if (name == "i")
+            Emit(Expression::OpI);
+        else if (name == "j")
+            Emit(Expression::OpJ);
+        else if (name == "c")
+            Emit(Expression::OpC);
+        else if (name == "pi")
+            Emit(Expression::OpConst, (float) M_PI);
+        else if (name == "e")
+            Emit(Expression::OpConst, (float) M_E);
+        else if (name == "w")
+            Emit(Expression::OpW);
+        else if (name == "h")
+            Emit(Expression::OpH);
+        else if (name == "d")
+            Emit(Expression::OpD);
+        else
+            return Fail("unknown identifier '" + name + "'");
+        if (name == "i" || name == "j" || name == "c")
+            uses_coords = true;
+        return true;
+    }
+};
+
+int Arity(Expression::Op op)
+{
+    switch (op)
+    {
+    case Expression::OpConst: case Expression::OpX: case Expression::OpI: case Expression::OpJ: case Expression::OpC:
+    case Expression::OpW: case Expression::OpH: case Expression::OpD:
+        return 0;
+    case Expression::OpNeg: case Expression::OpSqr: case Expression::OpAbs: case Expression::OpSqrt:
+    case Expression::OpExp: case Expression::OpLog: case Expression::OpSin: case Expression::OpCos: case Expression::OpTan:
+    case Expression::OpFloor: case Expression::OpCeil: case Expression::OpRound:
+        return 1;
+    case Expression::OpClamp:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+float Apply(Expression::Op op, const float* a)
+{
+    switch (op)
+    {
+    case Expression::OpAdd: return a[0] + a[1];
+    case Expression::OpSub: return a[0] - a[1];
+    case Expression::OpMul: return a[0] * a[1];
+    case Expression::OpDiv: return a[0] / a[1];
+    case Expression::OpMod: return fmodf(a[0], a[1]);
+    case Expression::OpPow: return powf(a[0], a[1]);
+    case Expression::OpLt: return a[0] < a[1];
+    case Expression::OpGt: return a[0] > a[1];
+    case Expression::OpLe: return a[0] <= a[1];
+    case Expression::OpGe: return a[0] >= a[1];
+    case Expression::OpEq: return a[0] == a[1];
+    case Expression::OpNe: return a[0] != a[1];
+    case Expression::OpMin: return fminf(a[0], a[1]);
+    case Expression::OpMax: return fmaxf(a[0], a[1]);
+    case Expression::OpAtan2: return atan2f(a[0], a[1]);
+    case Expression::OpClamp: return fminf(fmaxf(a[0], a[1]), a[2]);
+    case Expression::OpNeg: return -a[0];
+    case Expression::OpSqr: return a[0] * a[0];
+    case Expression::OpAbs: return fabsf(a[0]);
+    case Expression::OpSqrt: return sqrtf(a[0]);
+    case Expression::OpExp: return expf(a[0]);
+    case Expression::OpLog: return logf(a[0]);
+    case Expression::OpSin: return sinf(a[0]);
+    case Expression::OpCos: return cosf(a[0]);
+    case Expression::OpTan: return tanf(a[0]);
+    case Expression::OpFloor: return floorf(a[0]);
+    case Expression::OpCeil: return ceilf(a[0]);
+    case Expression::OpRound: return roundf(a[0]);
+    default: return 0;
+    }
+}
+
+/// Folds constant sub-expressions and strength-reduces small integer powers.
+std::vector<Expression::Instr> Optimize(const std::vector<Expression::Instr>& in)
+{
+    std::vector<Expression::Instr> out;
+    for (const auto& instr : in)
+    {
+        int n = Arity(instr.op);
+        bool constant = n > 0 && (int) out.size() >= n;
+        for (int k = 0; constant && k < n; k++)
+            constant = out[out.size() - n + k].op == Expression::OpConst;
+
+        if (constant)
+        {
+            float args[3];
+            for (int k = 0; k < n; k++)
+                args[k] = out[out.size() - n + k].value;
+            out.resize(out.size() - n);
+            out.push_back(Expression::Instr{Expression::OpConst, Apply(instr.op, args)});
+        }
+        else if (instr.op == Expression::OpPow && out.back().op == Expression::OpConst && out.back().value == 2)
+        {
+            out.back() = Expression::Instr{Expression::OpSqr, 0};
+        }
+        else if (instr.op == Expression::OpPow && out.back().op == Expression::OpConst && out.back().value == 1)
+        {
+            out.pop_back();
+        }
+        else if (instr.op == Expression::OpPow && out.back().op == Expression::OpConst && out.back().value == 0.5f)
+        {
+            out.back() = Expression::Instr{Expression::OpSqrt, 0};
+        }
+        else
+        {
+            out.push_back(instr);
+        }
+    }
+    return out;
+}
+
+struct Coordinates
+{
+    float i[Expression::Block];
+    float j[Expression::Block];
+    float c[Expression::Block];
+};
+
+VPE_SIMD_CLONES
+void RunBlock(const Expression::Instr* code, size_t ncode, const float* x, float* out, int n,
+              const Coordinates* coords, const float* dims)
+{
+    alignas(32) float stack[Expression::MaxStack][Expression::Block];
+    int sp = 0;
+
+    for (size_t pc = 0; pc < ncode; pc++)
+    {
+        const Expression::Instr& instr = code[pc];
+        float* r = stack[sp];
+        float* a = sp > 0 ? stack[sp - 1] : nullptr;
+        float* b = sp > 1 ? stack[sp - 2] : nullptr;
+        float* z = sp > 2 ? stack[sp - 3] : nullptr;
+        switch (instr.op)
+        {
+        case Expression::OpConst:
+            for (int k = 0; k < n; k++) r[k] = instr.value;
+            sp++;
+            break;
+        case Expression::OpX:
+            for (int k = 0; k < n; k++) r[k] = x[k];
+            sp++;
+            break;
+        case Expression::OpI: for (int k = 0; k < n; k++) r[k] = coords->i[k]; sp++; break;
+        case Expression::OpJ: for (int k = 0; k < n; k++) r[k] = coords->j[k]; sp++; break;
+        case Expression::OpC: for (int k = 0; k < n; k++) r[k] = coords->c[k]; sp++; break;
+        case Expression::OpW: for (int k = 0; k < n; k++) r[k] = dims[0]; sp++; break;
+        case Expression::OpH: for (int k = 0; k < n; k++) r[k] = dims[1]; sp++; break;
+        case Expression::OpD: for (int k = 0; k < n; k++) r[k] = dims[2]; sp++; break;
+        case Expression::OpAdd: for (int k = 0; k < n; k++) b[k] = b[k] + a[k]; sp--; break;
+        case Expression::OpSub: for (int k = 0; k < n; k++) b[k] = b[k] - a[k]; sp--; break;
+        case Expression::OpMul: for (int k = 0; k < n; k++) b[k] = b[k] * a[k]; sp--; break;
+        case Expression::OpDiv: for (int k = 0; k < n; k++) b[k] = b[k] / a[k]; sp--; break;
+        case Expression::OpMod: for (int k = 0; k < n; k++) b[k] = fmodf(b[k], a[k]); sp--; break;
+        case Expression::OpPow: for (int k = 0; k < n; k++) b[k] = powf(b[k], a[k]); sp--; break;
+        case Expression::OpLt: for (int k = 0; k < n; k++) b[k] = b[k] < a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpGt: for (int k = 0; k < n; k++) b[k] = b[k] > a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpLe: for (int k = 0; k < n; k++) b[k] = b[k] <= a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpGe: for (int k = 0; k < n; k++) b[k] = b[k] >= a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpEq: for (int k = 0; k < n; k++) b[k] = b[k] == a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpNe: for (int k = 0; k < n; k++) b[k] = b[k] != a[k] ? 1.f : 0.f; sp--; break;
+        case Expression::OpMin: for (int k = 0; k < n; k++) b[k] = b[k] < a[k] ? b[k] : a[k]; sp--; break;
+        case Expression::OpMax: for (int k = 0; k < n; k++) b[k] = b[k] > a[k] ? b[k] : a[k]; sp--; break;
+        case Expression::OpAtan2: for (int k = 0; k < n; k++) b[k] = atan2f(b[k], a[k]); sp--; break;
+        case Expression::OpClamp:
+            for (int k = 0; k < n; k++)
+            {
+                float v = z[k] < b[k] ? b[k] : z[k];
+                z[k] = v > a[k] ? a[k] : v;
+            }
+            sp -= 2;
+            break;
+        case Expression::OpNeg: for (int k = 0; k < n; k++) a[k] = -a[k]; break;
+        case Expression::OpSqr: for (int k = 0; k < n; k++) a[k] = a[k] * a[k]; break;
+        case Expression::OpAbs: for (int k = 0; k < n; k++) a[k] = fabsf(a[k]); break;
+        case Expression::OpSqrt: for (int k = 0; k < n; k++) a[k] = sqrtf(a[k]); break;
+        case Expression::OpExp: for (int k = 0; k < n; k++) a[k] = expf(a[k]); break;
+        case Expression::OpLog: for (int k = 0; k < n; k++) a[k] = logf(a[k]); break;
+        case Expression::OpSin: for (int k = 0; k < n; k++) a[k] = sinf(a[k]); break;
+        case Expression::OpCos: for (int k = 0; k < n; k++) a[k] = cosf(a[k]); break;
+        case Expression::OpTan: for (int k = 0; k < n; k++) a[k] = tanf(a[k]); break;
+        case Expression::OpFloor: for (int k = 0; k < n; k++) a[k] = floorf(a[k]); break;
+        case Expression::OpCeil: for (int k = 0; k < n; k++) a[k] = ceilf(a[k]); break;
+        case Expression::OpRound: for (int k = 0; k < n; k++) a[k] = roundf(a[k]); break;
+        }
+    }
+
+    for (int k = 0; k < n; k++)
+        out[k] = stack[0][k];
+}
+
+}   // namespace
+
+bool Expression::Compile(const std::string& source)
+{
+    code.clear();
+    error.clear();
+
+    std::vector<Instr> raw;
+    Parser parser(source.c_str(), raw, error);
+    if (!parser.ParseComparison())
+        return false;
+    parser.SkipSpaces();
+    if (*parser.s)
+    {
+        parser.Fail("trailing characters");
+        return false;
+    }
+    uses_coords = parser.uses_coords;
+
+    code = Optimize(raw);
+
+    int depth = 0;
+    for (const auto& instr : code)
+    {
+        int n = Arity(instr.op);
+        depth += 1 - n;
+        if (depth > MaxStack)
+        {
+            error = "expression too deep";
+            code.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void Expression::Eval(const float* in, float* out, size_t first, size_t count, int w, int h, int d) const
+{
+    Coordinates coords;
+    float dims[3] = {(float) w, (float) h, (float) d};
+
+    for (size_t offset = 0; offset < count; offset += Block)
+    {
+        int n = (int) (count - offset < (size_t) Block ? count - offset : Block);
+        if (uses_coords)
+        {
+            size_t index = first + offset;
+            size_t pixel = index / d;
+            int c = (int) (index % d);
+            int i = (int) (pixel % w);
+            int j = (int) (pixel / w);
+            for (int k = 0; k < n; k++)
+            {
+                coords.i[k] = i;
+                coords.j[k] = j;
+                coords.c[k] = c;
+                if (++c == d)
+                {
+                    c = 0;
+                    if (++i == w)
+                    {
+                        i = 0;
+                        j++;
+                    }
+                }
+            }
+        }
+        RunBlock(code.data(), code.size(), in + offset, out + offset, n, &coords, dims);
+    }
+}
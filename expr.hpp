@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Per-pixel expressions in the spirit of `vp map`, e.g. "(x/255)^2*255".
+//
+// Variables: x (sample value), i, j (column, row), c (channel), w, h, d (frame size), pi, e.
+// Operators: + - * / % ^, comparisons (yield 0 or 1), unary minus, parentheses.
+// Functions: abs sqrt exp log sin cos tan floor ceil round min max pow atan2 clamp.
+//
+// The expression is compiled to a small stack bytecode which is evaluated a block of samples at a time, so that every
+// instruction is a tight loop the compiler can vectorize (the kernel is built for AVX2 and a baseline target, and
+// dispatched at runtime).
+
+class Expression
+{
+public:
+    enum Op
+    {
+        OpConst,
+        OpX, OpI, OpJ, OpC, OpW, OpH, OpD,
+        OpAdd, OpSub, OpMul, OpDiv, OpMod, OpPow,
+        OpLt, OpGt, OpLe, OpGe, OpEq, OpNe,
+        OpNeg, OpSqr, OpAbs, OpSqrt, OpExp, OpLog, OpSin, OpCos, OpTan, OpFloor, OpCeil, OpRound,
+        OpMin, OpMax, OpAtan2, OpClamp,
+    };
+
+    struct Instr
+    {
+        Op op;
+        float value;
+    };
+
+    /// Number of samples evaluated per bytecode pass.
+    static const int Block = 256;
+    static const int MaxStack = 16;
+
+    /// Parses and compiles `source`. On failure, returns false and GetError() describes the problem.
+    bool Compile(const std::string& source);
+
+    /// Evaluates the expression over `count` interleaved samples starting at sample index `first` of a w*h*d frame.
+    /// `in` and `out` may alias.
+    void Eval(const float* in, float* out, size_t first, size_t count, int w, int h, int d) const;
+
+    const std::string& GetError() const { return error; }
+    const std::vector<Instr>& GetCode() const { return code; }
+
+private:
+    std::vector<Instr> code;
+    std::string error;
+    bool uses_coords = false;
+};
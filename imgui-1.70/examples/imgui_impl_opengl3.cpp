@@ -12,6 +12,7 @@
 
 // CHANGELOG
 // (minor and older changes stripped away, please see git history for details)
+//  vpe: OpenGL: Upload all command lists at once into orphaned buffers, reuse the VAO. Added ImGui_ImplOpenGL3_SetRestoreState() and ImGui_ImplOpenGL3_GetUploadBytes().
 //  2019-04-30: OpenGL: Added support for special ImDrawCallback_ResetRenderState callback to reset render state.
 //  2019-03-29: OpenGL: Not calling glBindBuffer more than necessary in the render loop.
 //  2019-03-15: OpenGL: Added a dummy GL call + comments in ImGui_ImplOpenGL3_Init() to detect uninitialized GL function loaders early.
@@ -64,6 +65,7 @@
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <string.h>     // memcpy
 #if defined(_MSC_VER) && _MSC_VER <= 1500 // MSVC 2008 or earlier
 #include <stddef.h>     // intptr_t
 #else
@@ -109,6 +111,12 @@ static GLuint       g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;                                // Uniforms location
 static int          g_AttribLocationVtxPos = 0, g_AttribLocationVtxUV = 0, g_AttribLocationVtxColor = 0; // Vertex attributes location
 static unsigned int g_VboHandle = 0, g_ElementsHandle = 0;
+static GLuint       g_VaoHandle = 0;                                                                     // Reused every frame, belongs to the context current at CreateDeviceObjects()
+static GLsizeiptr   g_VboSize = 0, g_ElementsSize = 0;                                                   // Capacity of the buffers, grown by powers of two
+static ImVector<char> g_VtxStaging, g_IdxStaging;                                                        // Vertices and indices of all command lists of a frame, uploaded at once
+static bool         g_RestoreState = true;
+static bool         g_ClipOriginLowerLeft = true;                                                        // Queried at CreateDeviceObjects() when the state is not backed up
+static size_t       g_UploadBytes = 0;
 
 // Functions
 bool    ImGui_ImplOpenGL3_Init(const char* glsl_version)
@@ -196,78 +204,175 @@ static void ImGui_ImplOpenGL3_SetupRenderState(ImDrawData* draw_data, int fb_wid
     glEnableVertexAttribArray(g_AttribLocationVtxPos);
     glEnableVertexAttribArray(g_AttribLocationVtxUV);
     glEnableVertexAttribArray(g_AttribLocationVtxColor);
-    glVertexAttribPointer(g_AttribLocationVtxPos,   2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, pos));
-    glVertexAttribPointer(g_AttribLocationVtxUV,    2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, uv));
-    glVertexAttribPointer(g_AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(ImDrawVert), (GLvoid*)IM_OFFSETOF(ImDrawVert, col));
+}
+
+// Points the attributes at the vertices of a command list, which start at byte 'vtx_offset' of the vertex buffer.
+// Indices of each command list start at 0, this does what glDrawElementsBaseVertex() would do on GL 3.2+ and ES 2.0 alike.
+static void ImGui_ImplOpenGL3_SetupVertexAttribs(size_t vtx_offset)
+{
+    glVertexAttribPointer(g_AttribLocationVtxPos,   2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtx_offset + IM_OFFSETOF(ImDrawVert, pos)));
+    glVertexAttribPointer(g_AttribLocationVtxUV,    2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(vtx_offset + IM_OFFSETOF(ImDrawVert, uv)));
+    glVertexAttribPointer(g_AttribLocationVtxColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(ImDrawVert), (GLvoid*)(vtx_offset + IM_OFFSETOF(ImDrawVert, col)));
+}
+
+// Uploads 'data' into the buffer bound to 'target'. The storage of the previous frame, which the GPU may still be reading, is orphaned
+// instead of waited for, and keeps the same size from frame to frame so that the driver can recycle it.
+static void ImGui_ImplOpenGL3_UploadBuffer(GLenum target, GLsizeiptr* capacity, const ImVector<char>& data)
+{
+    GLsizeiptr size = (GLsizeiptr)data.Size;
+    if (size > *capacity)
+    {
+        GLsizeiptr new_capacity = *capacity > 0 ? *capacity : 64 * 1024;
+        while (new_capacity < size)
+            new_capacity *= 2;
+        *capacity = new_capacity;
+    }
+    glBufferData(target, *capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, size, (const GLvoid*)data.Data);
+    g_UploadBytes += (size_t)size;
+}
+
+// GL state modified by the renderer. Every query is a round trip to the driver, which is slow on indirect and remote contexts.
+struct ImGui_ImplOpenGL3_SavedState
+{
+    GLenum active_texture;
+    GLint program, texture, array_buffer, vertex_array_object;
+    GLint sampler;
+    GLint polygon_mode[2], viewport[4], scissor_box[4];
+    GLenum blend_src_rgb, blend_dst_rgb, blend_src_alpha, blend_dst_alpha, blend_equation_rgb, blend_equation_alpha;
+    GLboolean enable_blend, enable_cull_face, enable_depth_test, enable_scissor_test;
+    bool clip_origin_lower_left;
+
+    void Backup()
+    {
+        glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&active_texture);
+        glActiveTexture(GL_TEXTURE0);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+#ifdef GL_SAMPLER_BINDING
+        glGetIntegerv(GL_SAMPLER_BINDING, &sampler);
+#endif
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &array_buffer);
+#ifndef IMGUI_IMPL_OPENGL_ES2
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertex_array_object);
+#endif
+#ifdef GL_POLYGON_MODE
+        glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+#endif
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_SCISSOR_BOX, scissor_box);
+        glGetIntegerv(GL_BLEND_SRC_RGB, (GLint*)&blend_src_rgb);
+        glGetIntegerv(GL_BLEND_DST_RGB, (GLint*)&blend_dst_rgb);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, (GLint*)&blend_src_alpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, (GLint*)&blend_dst_alpha);
+        glGetIntegerv(GL_BLEND_EQUATION_RGB, (GLint*)&blend_equation_rgb);
+        glGetIntegerv(GL_BLEND_EQUATION_ALPHA, (GLint*)&blend_equation_alpha);
+        enable_blend = glIsEnabled(GL_BLEND);
+        enable_cull_face = glIsEnabled(GL_CULL_FACE);
+        enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
+        enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+        clip_origin_lower_left = true;
+#if defined(GL_CLIP_ORIGIN) && !defined(__APPLE__)
+        GLenum last_clip_origin = 0; glGetIntegerv(GL_CLIP_ORIGIN, (GLint*)&last_clip_origin); // Support for GL 4.5's glClipControl(GL_UPPER_LEFT)
+        if (last_clip_origin == GL_UPPER_LEFT)
+            clip_origin_lower_left = false;
+#endif
+    }
+
+    void Restore()
+    {
+        glUseProgram(program);
+        glBindTexture(GL_TEXTURE_2D, texture);
+#ifdef GL_SAMPLER_BINDING
+        glBindSampler(0, sampler);
+#endif
+        glActiveTexture(active_texture);
+#ifndef IMGUI_IMPL_OPENGL_ES2
+        glBindVertexArray(vertex_array_object);
+#endif
+        glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+        glBlendEquationSeparate(blend_equation_rgb, blend_equation_alpha);
+        glBlendFuncSeparate(blend_src_rgb, blend_dst_rgb, blend_src_alpha, blend_dst_alpha);
+        if (enable_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
+        if (enable_cull_face) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
+        if (enable_depth_test) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
+        if (enable_scissor_test) glEnable(GL_SCISSOR_TEST); else glDisable(GL_SCISSOR_TEST);
+#ifdef GL_POLYGON_MODE
+        glPolygonMode(GL_FRONT_AND_BACK, (GLenum)polygon_mode[0]);
+#endif
+        glViewport(viewport[0], viewport[1], (GLsizei)viewport[2], (GLsizei)viewport[3]);
+        glScissor(scissor_box[0], scissor_box[1], (GLsizei)scissor_box[2], (GLsizei)scissor_box[3]);
+    }
+};
+
+void    ImGui_ImplOpenGL3_SetRestoreState(bool restore)
+{
+    g_RestoreState = restore;
+}
+
+size_t  ImGui_ImplOpenGL3_GetUploadBytes()
+{
+    return g_UploadBytes;
 }
 
 // OpenGL3 Render function.
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
 // Note that this implementation is little overcomplicated because we are saving/setting up/restoring every OpenGL state explicitly, in order to be able to run within any OpenGL engine that doesn't do so.
+// Hosts that set up their own state every frame can skip the save/restore with ImGui_ImplOpenGL3_SetRestoreState(false).
 void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
 {
     // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
     int fb_width = (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
     int fb_height = (int)(draw_data->DisplaySize.y * draw_data->FramebufferScale.y);
+    g_UploadBytes = 0;
     if (fb_width <= 0 || fb_height <= 0)
         return;
 
     // Backup GL state
-    GLenum last_active_texture; glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&last_active_texture);
-    glActiveTexture(GL_TEXTURE0);
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    GLint last_texture; glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-#ifdef GL_SAMPLER_BINDING
-    GLint last_sampler; glGetIntegerv(GL_SAMPLER_BINDING, &last_sampler);
-#endif
-    GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-#ifndef IMGUI_IMPL_OPENGL_ES2
-    GLint last_vertex_array_object; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array_object);
-#endif
-#ifdef GL_POLYGON_MODE
-    GLint last_polygon_mode[2]; glGetIntegerv(GL_POLYGON_MODE, last_polygon_mode);
-#endif
-    GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
-    GLint last_scissor_box[4]; glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box);
-    GLenum last_blend_src_rgb; glGetIntegerv(GL_BLEND_SRC_RGB, (GLint*)&last_blend_src_rgb);
-    GLenum last_blend_dst_rgb; glGetIntegerv(GL_BLEND_DST_RGB, (GLint*)&last_blend_dst_rgb);
-    GLenum last_blend_src_alpha; glGetIntegerv(GL_BLEND_SRC_ALPHA, (GLint*)&last_blend_src_alpha);
-    GLenum last_blend_dst_alpha; glGetIntegerv(GL_BLEND_DST_ALPHA, (GLint*)&last_blend_dst_alpha);
-    GLenum last_blend_equation_rgb; glGetIntegerv(GL_BLEND_EQUATION_RGB, (GLint*)&last_blend_equation_rgb);
-    GLenum last_blend_equation_alpha; glGetIntegerv(GL_BLEND_EQUATION_ALPHA, (GLint*)&last_blend_equation_alpha);
-    GLboolean last_enable_blend = glIsEnabled(GL_BLEND);
-    GLboolean last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
-    GLboolean last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
-    GLboolean last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
-    bool clip_origin_lower_left = true;
-#if defined(GL_CLIP_ORIGIN) && !defined(__APPLE__)
-    GLenum last_clip_origin = 0; glGetIntegerv(GL_CLIP_ORIGIN, (GLint*)&last_clip_origin); // Support for GL 4.5's glClipControl(GL_UPPER_LEFT)
-    if (last_clip_origin == GL_UPPER_LEFT)
-        clip_origin_lower_left = false;
-#endif
+    ImGui_ImplOpenGL3_SavedState last_state;
+    bool clip_origin_lower_left = g_ClipOriginLowerLeft;
+    if (g_RestoreState)
+    {
+        last_state.Backup();
+        clip_origin_lower_left = last_state.clip_origin_lower_left;
+    }
+    else
+    {
+        glActiveTexture(GL_TEXTURE0);
+    }
 
     // Setup desired GL state
-    // Recreate the VAO every time (this is to easily allow multiple GL contexts to be rendered to. VAO are not shared among GL contexts)
+    // The VAO is created once with the device objects: a host rendering to several GL contexts must create them in each context.
     // The renderer would actually work without any VAO bound, but then our VertexAttrib calls would overwrite the default one currently bound.
-    GLuint vertex_array_object = 0;
-#ifndef IMGUI_IMPL_OPENGL_ES2
-    glGenVertexArrays(1, &vertex_array_object);
-#endif
-    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object);
+    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, g_VaoHandle);
+
+    // Upload vertex/index buffers of all command lists at once
+    g_VtxStaging.resize(draw_data->TotalVtxCount * (int)sizeof(ImDrawVert));
+    g_IdxStaging.resize(draw_data->TotalIdxCount * (int)sizeof(ImDrawIdx));
+    char* vtx_dst = g_VtxStaging.Data;
+    char* idx_dst = g_IdxStaging.Data;
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+        memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        vtx_dst += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+        idx_dst += cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+    }
+    ImGui_ImplOpenGL3_UploadBuffer(GL_ARRAY_BUFFER, &g_VboSize, g_VtxStaging);
+    ImGui_ImplOpenGL3_UploadBuffer(GL_ELEMENT_ARRAY_BUFFER, &g_ElementsSize, g_IdxStaging);
 
     // Will project scissor/clipping rectangles into framebuffer space
     ImVec2 clip_off = draw_data->DisplayPos;         // (0,0) unless using multi-viewports
     ImVec2 clip_scale = draw_data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
 
     // Render command lists
+    size_t vtx_offset = 0;
+    size_t idx_buffer_offset = 0;
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        size_t idx_buffer_offset = 0;
-
-        // Upload vertex/index buffers
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        ImGui_ImplOpenGL3_SetupVertexAttribs(vtx_offset);
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -277,7 +382,10 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
                 // User callback, registered via ImDrawList::AddCallback()
                 // (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
                 if (pcmd->UserCallback == ImDrawCallback_ResetRenderState)
-                    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, vertex_array_object);
+                {
+                    ImGui_ImplOpenGL3_SetupRenderState(draw_data, fb_width, fb_height, g_VaoHandle);
+                    ImGui_ImplOpenGL3_SetupVertexAttribs(vtx_offset);
+                }
                 else
                     pcmd->UserCallback(cmd_list, pcmd);
             }
@@ -305,35 +413,12 @@ void    ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data)
             }
             idx_buffer_offset += pcmd->ElemCount * sizeof(ImDrawIdx);
         }
+        vtx_offset += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
     }
 
-    // Destroy the temporary VAO
-#ifndef IMGUI_IMPL_OPENGL_ES2
-    glDeleteVertexArrays(1, &vertex_array_object);
-#endif
-
     // Restore modified GL state
-    glUseProgram(last_program);
-    glBindTexture(GL_TEXTURE_2D, last_texture);
-#ifdef GL_SAMPLER_BINDING
-    glBindSampler(0, last_sampler);
-#endif
-    glActiveTexture(last_active_texture);
-#ifndef IMGUI_IMPL_OPENGL_ES2
-    glBindVertexArray(last_vertex_array_object);
-#endif
-    glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-    glBlendEquationSeparate(last_blend_equation_rgb, last_blend_equation_alpha);
-    glBlendFuncSeparate(last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha);
-    if (last_enable_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
-    if (last_enable_cull_face) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
-    if (last_enable_depth_test) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-    if (last_enable_scissor_test) glEnable(GL_SCISSOR_TEST); else glDisable(GL_SCISSOR_TEST);
-#ifdef GL_POLYGON_MODE
-    glPolygonMode(GL_FRONT_AND_BACK, (GLenum)last_polygon_mode[0]);
-#endif
-    glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
-    glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
+    if (g_RestoreState)
+        last_state.Restore();
 }
 
 bool ImGui_ImplOpenGL3_CreateFontsTexture()
@@ -579,6 +664,13 @@ bool    ImGui_ImplOpenGL3_CreateDeviceObjects()
     // Create buffers
     glGenBuffers(1, &g_VboHandle);
     glGenBuffers(1, &g_ElementsHandle);
+#ifndef IMGUI_IMPL_OPENGL_ES2
+    glGenVertexArrays(1, &g_VaoHandle);
+#endif
+#if defined(GL_CLIP_ORIGIN) && !defined(__APPLE__)
+    GLenum clip_origin = 0; glGetIntegerv(GL_CLIP_ORIGIN, (GLint*)&clip_origin);
+    g_ClipOriginLowerLeft = clip_origin != GL_UPPER_LEFT;
+#endif
 
     ImGui_ImplOpenGL3_CreateFontsTexture();
 
@@ -597,6 +689,13 @@ void    ImGui_ImplOpenGL3_DestroyDeviceObjects()
     if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
     if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
     g_VboHandle = g_ElementsHandle = 0;
+    g_VboSize = g_ElementsSize = 0;
+#ifndef IMGUI_IMPL_OPENGL_ES2
+    if (g_VaoHandle) glDeleteVertexArrays(1, &g_VaoHandle);
+#endif
+    g_VaoHandle = 0;
+    g_VtxStaging.clear();
+    g_IdxStaging.clear();
 
     if (g_ShaderHandle && g_VertHandle) glDetachShader(g_ShaderHandle, g_VertHandle);
     if (g_VertHandle) glDeleteShader(g_VertHandle);
@@ -39,6 +39,11 @@ IMGUI_IMPL_API void     ImGui_ImplOpenGL3_Shutdown();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_NewFrame();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_RenderDrawData(ImDrawData* draw_data);
 
+// Skip the backup and restore of the GL state around RenderDrawData(), for hosts that set up their own state every frame.
+IMGUI_IMPL_API void     ImGui_ImplOpenGL3_SetRestoreState(bool restore);
+// Bytes of vertices and indices uploaded by the last RenderDrawData().
+IMGUI_IMPL_API size_t   ImGui_ImplOpenGL3_GetUploadBytes();
+
 // Called by Init/NewFrame/Shutdown
 IMGUI_IMPL_API bool     ImGui_ImplOpenGL3_CreateFontsTexture();
 IMGUI_IMPL_API void     ImGui_ImplOpenGL3_DestroyFontsTexture();
@@ -62,7 +62,8 @@
 */
 
 //---- Use 32-bit vertex indices (default is 16-bit) to allow meshes with more than 64K vertices. Render function needs to support it.
-//#define ImDrawIdx unsigned int
+// vpe: the node canvas is a single window whose draw list exceeds 64K vertices on large graphs. imgui_impl_opengl3.cpp picks GL_UNSIGNED_INT from sizeof(ImDrawIdx).
+#define ImDrawIdx unsigned int
 
 //---- Tip: You can add extra functions within the ImGui:: namespace, here or in your own headers files.
 /*
@@ -969,15 +969,26 @@ void ImDrawList::PathArcTo(const ImVec2& centre, float radius, float a_min, floa
     }
 }
 
-static void PathBezierToCasteljau(ImVector<ImVec2>* path, float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, float tess_tol, int level)
+// Squared distance from (px,py) to the segment from (x1,y1) to (x4,y4)
+static inline float DistanceToSegmentSqr(float px, float py, float x1, float y1, float x4, float y4)
 {
     float dx = x4 - x1;
     float dy = y4 - y1;
-    float d2 = ((x2 - x4) * dy - (y2 - y4) * dx);
-    float d3 = ((x3 - x4) * dy - (y3 - y4) * dx);
-    d2 = (d2 >= 0) ? d2 : -d2;
-    d3 = (d3 >= 0) ? d3 : -d3;
-    if ((d2+d3) * (d2+d3) < tess_tol * (dx*dx + dy*dy))
+    float len_sqr = dx*dx + dy*dy;
+    float t = (len_sqr > 0.0f) ? ImClamp(((px - x1) * dx + (py - y1) * dy) / len_sqr, 0.0f, 1.0f) : 0.0f;
+    float ex = x1 + t * dx - px;
+    float ey = y1 + t * dy - py;
+    return ex*ex + ey*ey;
+}
+
+// Subdivides until the curve is within tess_tol pixels of its chord, so that the number of points follows the size of the curve on screen.
+// The curve lies in the convex hull of its control points, which is within tess_tol of the chord segment when both inner control points are.
+// Measuring the distance to the segment rather than to the line through it also catches curves that double back along their chord.
+static void PathBezierToCasteljau(ImVector<ImVec2>* path, float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, float tess_tol, int level)
+{
+    float d2 = DistanceToSegmentSqr(x2, y2, x1, y1, x4, y4);
+    float d3 = DistanceToSegmentSqr(x3, y3, x1, y1, x4, y4);
+    if (ImMax(d2, d3) <= tess_tol * tess_tol)
     {
         path->push_back(ImVec2(x4, y4));
     }
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "builtin.hpp"
+#include "wakeup.hpp"
+
+// End-to-end latency measurement. Frames are stamped when they leave a source node; the stamps are kept on the side,
+// keyed by the sequence number of the frame in its stream, so the vpp payload is untouched. Every edge observed by vpe
+// looks up the stamp of the frame with the same sequence number and records the elapsed time.
+//
+// This assumes that nodes produce one frame per input frame, which holds for the usual filters.
+
+/// Histogram with log-linear buckets in the spirit of HdrHistogram: 16 buckets per power of two, so percentiles are
+/// within ~6% of the recorded values whatever their magnitude. Values are in microseconds. Recording is lock-free.
+class LatencyHistogram
+{
+    static const int SubBits = 4;
+    static const int SubCount = 1 << SubBits;
+    static const int BucketCount = 64 * SubCount;
+
+    std::atomic<uint64_t> buckets[BucketCount];
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> max{0};
+
+    static int Index(uint64_t value)
+    {
+        if (value < 2 * SubCount)
+            return (int) value;
+        int shift = 63 - __builtin_clzll(value) - SubBits;
+        return (shift + 1) * SubCount + (int) ((value >> shift) - SubCount);
+    }
+
+    /// Highest value of the bucket `index`.
+    static uint64_t Value(int index)
+    {
+        if (index < 2 * SubCount)
+            return index;
+        int shift = index / SubCount - 1;
+        uint64_t sub = index % SubCount + SubCount;
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+
+    LatencyHistogram()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (auto& b : buckets)
+            b.store(0, std::memory_order_relaxed);
+        count = 0;
+        max = 0;
+    }
+
+    void Record(uint64_t us)
+    {
+        buckets[Index(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (us > current && !max.compare_exchange_weak(current, us, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64_t GetCount() const { return count; }
+    uint64_t GetMax() const { return max; }
+
+    /// Value below which `percent`% of the recorded values fall.
+    uint64_t GetPercentile(double percent) const
+    {
+        uint64_t total = count;
+        if (total == 0)
+            return 0;
+        uint64_t target = (uint64_t) (percent / 100 * total + 0.5);
+        if (target == 0)
+            target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BucketCount; i++)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target)
+                return std::min(Value(i), GetMax());
+        }
+        return GetMax();
+    }
+};
+
+/// Sideband table of the times at which the frames of a source were emitted, indexed by sequence number. Only the most
+/// recent frames are kept, which is enough as long as a frame does not spend more than `Capacity` frames in flight.
+class StampTable
+{
+    static const size_t Capacity = 1024;
+
+    struct Entry
+    {
+        std::atomic<uint64_t> sequence{UINT64_MAX};
+        std::atomic<uint64_t> time{0};
+    };
+    Entry entries[Capacity];
+
+public:
+
+    /// Records the time of frame `sequence`, unless it was already stamped by another edge of the source.
+    void Stamp(uint64_t sequence, uint64_t time)
+    {
+        Entry& e = entries[sequence % Capacity];
+        if (e.sequence.load(std::memory_order_acquire) == sequence)
+            return;
+        e.sequence.store(UINT64_MAX, std::memory_order_relaxed);
+        // a reader seeing the new time also sees the invalidation, see Find()
+        std::atomic_thread_fence(std::memory_order_release);
+        e.time.store(time, std::memory_order_relaxed);
+        e.sequence.store(sequence, std::memory_order_release);
+    }
+
+    bool Find(uint64_t sequence, uint64_t& time) const
+    {
+        const Entry& e = entries[sequence % Capacity];
+        if (e.sequence.load(std::memory_order_acquire) != sequence)
+            return false;
+        time = e.time.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+};
+
+/// Latency from a source to a sink node.
+struct LatencyPath
+{
+    std::string name;
+    LatencyHistogram histogram;
+};
+
+/// Observation point on one edge of the graph.
+class LatencyProbe
+{
+    struct Upstream
+    {
+        const StampTable* stamps;
+        /// Set when the edge goes into a sink node.
+        LatencyPath* path;
+    };
+
+    std::vector<Upstream> upstream;
+
+public:
+
+    std::string name;
+    /// Latency since the earliest upstream source emitted the frame.
+    LatencyHistogram histogram;
+    /// Set when the edge leaves a source node.
+    StampTable* stamps = nullptr;
+
+    static uint64_t Now()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    void AddUpstream(const StampTable* source, LatencyPath* path)
+    {
+        upstream.push_back(Upstream{source, path});
+    }
+
+    void Observe(uint64_t sequence)
+    {
+        const uint64_t now = Now();
+        if (stamps)
+            stamps->Stamp(sequence, now);
+        uint64_t worst = 0;
+        bool found = false;
+        for (const auto& u : upstream)
+        {
+            uint64_t time;
+            if (!u.stamps->Find(sequence, time) || time > now)
+                continue;
+            if (u.path)
+                u.path->histogram.Record(now - time);
+            worst = std::max(worst, now - time);
+            found = true;
+        }
+        if (found)
+        {
+            histogram.Record(worst);
+            // the latency window is live
+            WakeGuiForMetrics();
+        }
+    }
+};
+
+/// Observes the frames passed to a sink.
+class ProbedSink : public FrameSink
+{
+    FrameSink* sink;
+    LatencyProbe* probe;
+
+public:
+
+    ProbedSink(FrameSink* sink, LatencyProbe* probe) : sink(sink), probe(probe) {}
+
+    virtual void Push(Frame* frame) override
+    {
+        probe->Observe(frame->sequence);
+        sink->Push(frame);
+    }
+
+    virtual void Close() override
+    {
+        sink->Close();
+    }
+};
+
+/// Latency measurement of one run.
+class LatencyMonitor
+{
+    std::vector<std::unique_ptr<StampTable>> sources;
+    std::vector<std::unique_ptr<LatencyProbe>> probes;
+    std::vector<std::unique_ptr<LatencyPath>> paths;
+    std::vector<std::unique_ptr<FrameSink>> sinks;
+
+    static void WriteRow(FILE* file, const char* kind, const std::string& name, const LatencyHistogram& h)
+    {
+        fprintf(file, "%s,\"%s\",%llu,%llu,%llu,%llu\n", kind, name.c_str(), (unsigned long long) h.GetCount(),
+                (unsigned long long) h.GetPercentile(50), (unsigned long long) h.GetPercentile(99),
+                (unsigned long long) h.GetMax());
+    }
+
+public:
+
+    StampTable* AddSource()
+    {
+        sources.emplace_back(new StampTable());
+        return sources.back().get();
+    }
+
+    LatencyProbe* AddProbe(const std::string& name)
+    {
+        probes.emplace_back(new LatencyProbe());
+        probes.back()->name = name;
+        return probes.back().get();
+    }
+
+    LatencyPath* AddPath(const std::string& name)
+    {
+        paths.emplace_back(new LatencyPath());
+        paths.back()->name = name;
+        return paths.back().get();
+    }
+
+    /// Returns a sink observing the frames on their way to `sink`. The monitor keeps ownership.
+    FrameSink* Wrap(FrameSink* sink, LatencyProbe* probe)
+    {
+        sinks.emplace_back(new ProbedSink(sink, probe));
+        return sinks.back().get();
+    }
+
+    const std::vector<std::unique_ptr<LatencyProbe>>& GetProbes() const { return probes; }
+    const std::vector<std::unique_ptr<LatencyPath>>& GetPaths() const { return paths; }
+
+    /// Writes percentiles of every edge and path, in microseconds.
+    bool Export(const char* filename) const
+    {
+        FILE* file = fopen(filename, "w");
+        if (!file)
+        {
+            perror("fopen");
+            return false;
+        }
+        fprintf(file, "kind,name,frames,p50_us,p99_us,max_us\n");
+        for (const auto& p : probes)
+            WriteRow(file, "edge", p->name, p->histogram);
+        for (const auto& p : paths)
+            WriteRow(file, "path", p->name, p->histogram);
+        fclose(file);
+        return true;
+    }
+};
@@ -2,8 +2,13 @@
 #include "imgui_impl_sdl.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <SDL.h>
 
+#include "wakeup.hpp"
+#include "profiler.hpp"
+
 #if defined(IMGUI_IMPL_OPENGL_LOADER_GL3W)
 #include <GL/gl3w.h>    // Initialize with gl3wInit()
 #elif defined(IMGUI_IMPL_OPENGL_LOADER_GLEW)
@@ -14,8 +19,56 @@
 #include IMGUI_IMPL_OPENGL_LOADER_CUSTOM
 #endif
 
-int main(int, char**)
+/// Event posted by WakeGui() from the threads of the pipeline.
+static Uint32 wakeup_event = (Uint32) -1;
+
+int vpe_idle_timeout();
+
+/// Read and write syscalls of the process so far, from /proc/self/io. Returns false where it is not available.
+static bool ReadSyscalls(double& reads, double& writes)
 {
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/io", "r");
+    if (!file)
+        return false;
+    char line[128];
+    int found = 0;
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long value;
+        if (sscanf(line, "syscr: %llu", &value) == 1) {
+            reads = (double) value;
+            found++;
+        } else if (sscanf(line, "syscw: %llu", &value) == 1) {
+            writes = (double) value;
+            found++;
+        }
+    }
+    fclose(file);
+    return found == 2;
+#else
+    (void) reads;
+    (void) writes;
+    return false;
+#endif
+}
+
+/// Frames rendered after an event, for ImGui to settle: new windows and popups take a few frames to get their size.
+static const int SettleFrames = 3;
+
+/// Interval between frames while a text field is focused: ImGui shows its caret for 800 ms, then hides it for 400 ms.
+static const int CaretBlinkMs = 400;
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--batch")) {
+        int vpe_batch(int argc, char** argv);
+        return vpe_batch(argc - 2, argv + 2);
+    }
+    if (argc > 1 && !strcmp(argv[1], "--daemon")) {
+        int vpe_daemon(int argc, char** argv);
+        return vpe_daemon(argc - 2, argv + 2);
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0) {
         printf("Error: %s\n", SDL_GetError());
         return -1;
@@ -70,41 +123,120 @@ int main(int, char**)
 
     ImGui_ImplSDL2_InitForOpenGL(window, gl_context);
     ImGui_ImplOpenGL3_Init(glsl_version);
+    // the loop below sets the state it needs every frame, and previews restore their texture binding
+    ImGui_ImplOpenGL3_SetRestoreState(false);
 
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+    wakeup_event = SDL_RegisterEvents(1);
+    if (wakeup_event != (Uint32) -1) {
+        SetWakeupHandler([] {
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = wakeup_event;
+            SDL_PushEvent(&event);
+        });
+    }
+
+    // Frames are rendered when something changes: on input, on wakeups from the pipeline, while ImGui animates, at the
+    // polling interval of vpe_idle_timeout(), and at the caret blinks of a focused text field. Otherwise the loop sleeps
+    // in SDL_WaitEventTimeout.
+    int settle = SettleFrames;
     bool done = false;
+    double syscalls_read = -1, syscalls_written = -1;
+    ProfileThreadName("GUI");
     while (!done) {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
+        auto handle = [&](const SDL_Event& event) {
+            // new data from the pipeline is shown in one frame, input needs ImGui to settle
+            settle = std::max(settle, event.type == wakeup_event ? 1 : SettleFrames);
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT)
                 done = true;
             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE
                 && event.window.windowID == SDL_GetWindowID(window))
                 done = true;
+        };
+        SDL_Event event;
+        if (settle <= 0) {
+            int timeout = vpe_idle_timeout();
+            // a focused text field only needs frames to blink its caret
+            if (io.WantTextInput)
+                timeout = timeout < 0 ? CaretBlinkMs : std::min(timeout, CaretBlinkMs);
+            bool woken = timeout < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, timeout);
+            if (woken)
+                handle(event);
+            else
+                settle = 1;
         }
+        ProfileBeginFrame();
+        {
+            PROFILE_ZONE("events");
+            while (SDL_PollEvent(&event))
+                handle(event);
+        }
+        ClearWakeup();
 
         if (ImGui::IsKeyPressed(SDL_SCANCODE_A) && !ImGui::GetIO().WantTextInput) {
             break;
         }
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplSDL2_NewFrame(window);
-        ImGui::NewFrame();
-
-        ImGui::SetNextWindowPos(ImVec2(0,0));
-        ImGui::SetNextWindowSize(io.DisplaySize);
-        void vpe_show();
-        vpe_show();
-
-        ImGui::Render();
-        SDL_GL_MakeCurrent(window, gl_context);
-        glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-        glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
-        glClear(GL_COLOR_BUFFER_BIT);
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        SDL_GL_SwapWindow(window);
+        {
+            PROFILE_ZONE("ImGui::NewFrame");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplSDL2_NewFrame(window);
+            ImGui::NewFrame();
+        }
+
+        {
+            PROFILE_ZONE("vpe_show");
+            ImGui::SetNextWindowPos(ImVec2(0,0));
+            ImGui::SetNextWindowSize(io.DisplaySize);
+            void vpe_show();
+            vpe_show();
+        }
+
+        {
+            PROFILE_ZONE("ImGui::Render");
+            ImGui::Render();
+        }
+        {
+            PROFILE_ZONE("OpenGL");
+            SDL_GL_MakeCurrent(window, gl_context);
+            glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+            glDisable(GL_SCISSOR_TEST); // left enabled by the renderer
+            glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
+            glClear(GL_COLOR_BUFFER_BIT);
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        {
+            PROFILE_ZONE("SDL_GL_SwapWindow");
+            SDL_GL_SwapWindow(window);
+        }
+
+        ImDrawData* draw_data = ImGui::GetDrawData();
+        int draw_calls = 0;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+            draw_calls += draw_data->CmdLists[n]->CmdBuffer.Size;
+        ProfileCount("vertices", draw_data->TotalVtxCount);
+        ProfileCount("draw calls", draw_calls);
+        ProfileCount("uploaded KB", ImGui_ImplOpenGL3_GetUploadBytes() / 1024.);
+        // reading the syscall counters costs syscalls, skip it while nobody looks at them
+        double reads, writes;
+        if (IsProfilerShown() && ReadSyscalls(reads, writes)) {
+            if (syscalls_read >= 0) {
+                ProfileCount("read syscalls", reads - syscalls_read);
+                ProfileCount("write syscalls", writes - syscalls_written);
+            }
+            syscalls_read = reads;
+            syscalls_written = writes;
+        } else {
+            syscalls_read = syscalls_written = -1;
+        }
+        ProfileEndFrame();
+
+        // held buttons and drags keep animating; a focused text field stays active but only needs its caret blinks
+        bool animating = ImGui::IsAnyMouseDown() || (ImGui::IsAnyItemActive() && !io.WantTextInput);
+        settle = animating ? SettleFrames : settle - 1;
     }
 
     ImGui_ImplOpenGL3_Shutdown();
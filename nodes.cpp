@@ -1,9 +1,13 @@
 #ifndef IMGUI_DEFINE_MATH_OPERATORS
 #   define IMGUI_DEFINE_MATH_OPERATORS
 #endif
+#include <algorithm>
+#include <functional>
 #include <vector>
 #include <iostream>
 #include <map>
+#include <set>
+#include <memory>
 #include <string>
 #include <regex>
 #include <cstdio>
@@ -13,14 +17,43 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <signal.h>
+#include <unistd.h>
 
 #include <SDL.h>
 
 #include "pipeline.hpp"
+#include "builtin.hpp"
+#include "shm.hpp"
+#include "latency.hpp"
+#include "batch.hpp"
+#include "placement.hpp"
+#include "cgroup.hpp"
+#include "cache.hpp"
+#include "preview.hpp"
+#include "daemon.hpp"
+#include "profiler.hpp"
 
 ImNodes::CanvasState* gCanvas = nullptr;
 std::vector<struct BaseNode*> nodes;
 static class RunContext* context;
+/// Variables of the graph, `$NAME` in commands. Saved in the graph file as `$NAME=value` lines.
+static std::map<std::string, std::string> graph_variables;
+/// A connection: input node and slot, then output node and slot. Every map of connections is keyed this way.
+typedef std::tuple<const void*, const char*, const void*, const char*> EdgeKey;
+
+/// Connections recorded at each run (see recording.hpp). Saved in the graph file with a ` record` suffix on the
+/// connection line.
+static std::set<EdgeKey> recorded_edges;
+
+/// Set while attached to a daemon (see daemon.hpp), which runs the graph instead of `context`.
+static std::unique_ptr<daemon_protocol::Peer> daemon_peer;
+/// Last status of the nodes and metrics of the connections received from the daemon.
+static std::map<const void*, daemon_protocol::NodeStatus> remote_nodes;
+static std::map<EdgeKey, daemon_protocol::EdgeMetrics> remote_edges;
+
+/// Runs the graph, in the daemon when attached to one.
+static void RunGraph();
 
 static const char* PipeInputSlotNames[] = {
     "<1",
@@ -44,15 +77,122 @@ static const char* PipeOutputSlotNames[] = {
 
 class RunContext
 {
-    int nextfifo = 0;
-    std::map<std::tuple<const void*, const char*, const void*, const char*>, std::string> fifos;
+    std::map<EdgeKey, std::string> fifos;
+    /// Shared-memory rings of the current run, they are not reused between runs.
+    std::map<EdgeKey, std::unique_ptr<ShmRing>> rings;
     std::string dir = "tmp/";
     Pipeline pipeline;
+    bool running = false;
+    /// Variables of this run, they take precedence over the graph variables.
+    std::map<std::string, std::string> variables;
+    /// Blocks of the nodes in the current run.
+    std::map<const void*, Block*> node_blocks;
+    std::map<const void*, EngineNode*> engine_nodes;
+
+    bool measure_latency = false;
+    std::unique_ptr<LatencyMonitor> latency;
+    std::map<EdgeKey, LatencyProbe*> probes;
+
+    void StartLatencyMonitor();
+
+    /// Recorders of the `recorded_edges` in the current run, keyed like `probes`.
+    std::map<EdgeKey, EdgeRecorderBlock*> recorders;
+
+    std::string MakeRecordingPath(const void* node, const char* slot) const;
+
+    /// Connections shown in preview panels, keyed like `probes`, with their taps in the current run.
+    std::set<EdgeKey> previews;
+    std::map<EdgeKey, PreviewTapBlock*> preview_taps;
+    std::map<EdgeKey, std::unique_ptr<PreviewTexture>> preview_textures;
+    /// Connections whose frame statistics are shown in the tooltip of their curve, with their taps in the current run.
+    std::set<EdgeKey> stats_edges;
+    std::map<EdgeKey, StatsTapBlock*> stats_taps;
+
+    /// Spread the commands over the physical cores, for the nodes without a CPU set.
+    bool auto_place = false;
+    /// CPUs of the nodes in the current run, from the auto-placer.
+    std::map<const void*, std::vector<int>> placement;
+
+    void Place();
+
+    /// Restart crashed commands together with the nodes connected to them.
+    bool supervise = false;
+    /// Connected part of the graph of each node, the unit of restarts.
+    std::map<const void*, int> node_groups;
+    int current_group = 0;
+    /// Depth of each node from the sources, which orders graceful stops.
+    std::map<const void*, int> node_ranks;
+    int current_rank = 0;
+
+    void MakeGroups();
+    void ResetRings(int group);
+
+    /// cgroups of the commands with a memory limit.
+    CgroupTree cgroups;
+
+public:
+    /// How the stream of a connection goes when the result cache is involved.
+    enum class EdgeMode
+    {
+        Normal,
+        /// Relayed through vpe, which records it in the cache.
+        Record,
+        /// The consumer is not launched, vpe drains the stream.
+        Discard,
+        /// The producer is not launched, vpe replays the stream from the cache.
+        Replay,
+        /// Neither end is launched.
+        Skip,
+    };
+
+private:
+    ResultCache cache;
+    std::map<EdgeKey, EdgeMode> edge_modes;
+    std::map<EdgeKey, std::string> edge_files;
+    /// Nodes launched in the current run, the others are served from the cache or only feed such nodes.
+    std::set<const void*> launched;
+    std::set<const void*> served;
+
+    struct Recording
+    {
+        std::string part;
+        std::string path;
+        const void* node;
+        StreamCopyBlock* block;
+    };
+    std::vector<Recording> recordings;
+    std::vector<CacheReplayBlock*> replays;
+
+    void PlanCache();
+    /// Stores the complete recordings of the current run, `ended` tells whether the run ended by itself.
+    void FinishCache(bool ended);
+
+    /// Set by Run() while the previous run is stopping, Update() starts the run once it stopped.
+    bool run_pending = false;
+    /// Set when a run started by Update() could not be prepared.
+    bool start_failed = false;
+
+    /// Prepares and launches the graph, the previous run must have ended.
+    bool Start();
 
 public:
 
+    explicit RunContext(const std::string& dir = "tmp/") : dir(dir) {}
+
+    /// Blocks until the run stopped, see ShutdownPolicy. Contexts should be stopped first with Stop() and deleted once
+    /// IsStopped(), except at exit.
+    ~RunContext()
+    {
+        FinishCache(!pipeline.IsRunning());
+        pipeline.ShutdownAndDelete();
+        for (const auto& fifo : fifos)
+            RemoveFifo(fifo.second);
+    }
+
     std::string MakeFifo()
     {
+        // numbered for the process, contexts being stopped may still use their fifos in the same directory
+        static int nextfifo = 0;
         std::string filename = dir + "fifo" + std::to_string(nextfifo++);
         int ret = mkfifo(filename.c_str(), 0600);
         if (ret) {
@@ -74,17 +214,328 @@ public:
         return fifos[key];
     }
 
+    ShmRing* MakeOrGetRing(const void* node1, const char* slot1,
+                           const void* node2, const char* slot2)
+    {
+        auto& ring = rings[std::make_tuple(node1, slot1, node2, slot2)];
+        if (!ring)
+        {
+            ring.reset(new ShmRing());
+        }
+        return ring.get();
+    }
+
     void RemoveFifo(const std::string& filename)
     {
         printf("rm %s\n", filename.c_str());
+        unlink(filename.c_str());
+    }
+
+    void SetVariable(const std::string& name, const std::string& value)
+    {
+        variables[name] = value;
+    }
+
+    /// Replaces `$NAME` and `${NAME}` by the value of the variable. Unknown variables are left for the shell.
+    std::string Expand(const std::string& text, int depth = 0) const
+    {
+        std::string result;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            size_t start = i + 1;
+            bool braces = start < text.size() && text[start] == '{';
+            if (text[i] != '$' || depth > 4)
+            {
+                result += text[i];
+                continue;
+            }
+            if (braces)
+                start++;
+            size_t end = start;
+            while (end < text.size() && (isalnum((unsigned char) text[end]) || text[end] == '_'))
+                end++;
+            std::string name = text.substr(start, end - start);
+            if (braces && (end >= text.size() || text[end] != '}'))
+                name.clear();
+            const std::string* value = nullptr;
+            if (variables.count(name))
+                value = &variables.at(name);
+            else if (graph_variables.count(name))
+                value = &graph_variables.at(name);
+            if (name.empty() || !value)
+            {
+                result += text[i];
+                continue;
+            }
+            // values may refer to other variables, e.g. OUTPUT=out/$NAME.avi
+            result += Expand(*value, depth + 1);
+            i = braces ? end : end - 1;
+        }
+        return result;
+    }
+
+    void SetNodeBlock(const void* node, Block* block, EngineNode* engine_node = nullptr)
+    {
+        node_blocks[node] = block;
+        if (engine_node)
+            engine_nodes[node] = engine_node;
+    }
+
+    Block* GetNodeBlock(const void* node) const
+    {
+        auto it = node_blocks.find(node);
+        return it == node_blocks.end() ? nullptr : it->second;
+    }
+
+    /// Set when the node is a built-in node.
+    EngineNode* GetEngineNode(const void* node) const
+    {
+        auto it = engine_nodes.find(node);
+        return it == engine_nodes.end() ? nullptr : it->second;
+    }
+
+    /// Collects a block of the node or connection being prepared. `downstream` blocks read the output of the node,
+    /// e.g. stream duplication or relays, and end after it.
+    void CollectBlock(Block* b, bool downstream = false)
+    {
+        pipeline.Add(b, current_group, 2 * current_rank + downstream);
+    }
+
+    /// Stops the block of a node, the supervisor does not restart it.
+    void StopNode(const void* node)
+    {
+        if (Block* block = GetNodeBlock(node))
+            pipeline.Stop(block);
+    }
+
+    bool IsSupervising() const
+    {
+        return supervise;
+    }
+
+    void SetSupervise(bool s)
+    {
+        supervise = s;
+        pipeline.SetSupervised(s);
+    }
+
+    EdgeMode GetEdgeMode(const void* input_node, const char* input_slot, const void* output_node,
+                         const char* output_slot) const
+    {
+        auto it = edge_modes.find(EdgeKey(input_node, input_slot, output_node, output_slot));
+        return it == edge_modes.end() ? EdgeMode::Normal : it->second;
+    }
+
+    bool IsLaunched(const void* node) const
+    {
+        return launched.count(node) > 0;
+    }
+
+    bool IsServedFromCache(const void* node) const
+    {
+        return served.count(node) > 0;
+    }
+
+    ResultCache& GetCache()
+    {
+        return cache;
+    }
+
+    /// Collects the block copying a connection in Record or Discard mode.
+    void CollectCopy(const void* input_node, const char* input_slot, const void* output_node, const char* output_slot,
+                     const std::string& from, const std::string& to)
+    {
+        EdgeKey key(input_node, input_slot, output_node, output_slot);
+        std::string part;
+        if (edge_modes[key] == EdgeMode::Record)
+            part = cache.BeginRecord(edge_files[key]);
+        auto block = new StreamCopyBlock(from, to, part);
+        if (!part.empty())
+            recordings.push_back(Recording{part, edge_files[key], output_node, block});
+        CollectBlock(block, true);
+    }
+
+    /// Collects the block replaying a connection in Replay mode.
+    void CollectReplay(const void* input_node, const char* input_slot, const void* output_node, const char* output_slot,
+                       const std::string& to)
+    {
+        auto block = new CacheReplayBlock(edge_files[EdgeKey(input_node, input_slot, output_node, output_slot)], to);
+        replays.push_back(block);
+        CollectBlock(block, true);
+    }
+
+    /// cgroup of a command limited to `memory_mb` MB of memory, empty when cgroups are not available.
+    std::string MakeCgroup(int memory_mb)
+    {
+        std::string path = cgroups.Create((size_t) memory_mb << 20);
+        if (path.empty() && !cgroups.IsAvailable())
+            printf("memory limit not enforced: no cgroup delegated through $VPE_CGROUP\n");
+        else if (path.empty())
+            printf("memory limit not enforced: cannot create a cgroup\n");
+        return path;
+    }
+
+    std::vector<Crash> GetCrashes(const void* node) const
+    {
+        Block* block = GetNodeBlock(node);
+        return block ? pipeline.GetCrashes(block) : std::vector<Crash>();
+    }
+
+    size_t GetCrashCount(const void* node) const
+    {
+        Block* block = GetNodeBlock(node);
+        return block ? pipeline.GetCrashCount(block) : 0;
+    }
+
+    bool IsMeasuringLatency() const
+    {
+        return measure_latency;
+    }
+
+    /// Latency probe of the connection in the current run, nullptr when not measuring latency.
+    const LatencyProbe* GetProbe(const void* node1, const char* slot1, const void* node2, const char* slot2) const
+    {
+        auto it = probes.find(std::make_tuple(node1, slot1, node2, slot2));
+        return it == probes.end() ? nullptr : it->second;
+    }
+
+    /// Takes effect at the next run.
+    void SetMeasureLatency(bool measure)
+    {
+        measure_latency = measure;
+    }
+
+    /// Returns `sink`, or a sink observing the frames of the connection on their way to `sink` when measuring latency
+    /// or statistics, previewing or recording the connection.
+    FrameSink* Probe(const void* node1, const char* slot1, const void* node2, const char* slot2, FrameSink* sink);
+
+    bool IsPreviewed(const void* node1, const char* slot1, const void* node2, const char* slot2) const
+    {
+        return previews.count(std::make_tuple(node1, slot1, node2, slot2)) > 0;
+    }
+
+    /// Shows the connection in a preview panel from the next run on, or closes its panel.
+    void SetPreviewed(const void* node1, const char* slot1, const void* node2, const char* slot2, bool previewed)
+    {
+        auto key = std::make_tuple(node1, slot1, node2, slot2);
+        if (previewed)
+        {
+            previews.insert(key);
+        }
+        else
+        {
+            previews.erase(key);
+            preview_textures.erase(key);
+        }
+    }
+
+    bool IsMeasuringStats(const void* node1, const char* slot1, const void* node2, const char* slot2) const
+    {
+        return stats_edges.count(std::make_tuple(node1, slot1, node2, slot2)) > 0;
+    }
+
+    /// Takes effect at the next run.
+    void SetMeasuringStats(const void* node1, const char* slot1, const void* node2, const char* slot2, bool measure)
+    {
+        if (measure)
+            stats_edges.insert(std::make_tuple(node1, slot1, node2, slot2));
+        else
+            stats_edges.erase(std::make_tuple(node1, slot1, node2, slot2));
+    }
+
+    /// Shows the statistics of the connection in the current tooltip.
+    void RenderStats(const void* node1, const char* slot1, const void* node2, const char* slot2) const;
+
+    /// File the connection is recorded to in the current run, empty if it is not.
+    std::string GetRecordingPath(const void* node1, const char* slot1, const void* node2, const char* slot2) const
+    {
+        auto it = recorders.find(std::make_tuple(node1, slot1, node2, slot2));
+        return it == recorders.end() ? std::string() : it->second->GetPath();
+    }
+
+    bool IsAutoPlacing() const
+    {
+        return auto_place;
+    }
+
+    /// Takes effect at the next run.
+    void SetAutoPlace(bool place)
+    {
+        auto_place = place;
+    }
+
+    /// CPUs chosen by the auto-placer for the node, empty when it is not placed.
+    std::vector<int> GetPlacement(const void* node) const
+    {
+        auto it = placement.find(node);
+        return it == placement.end() ? std::vector<int>() : it->second;
+    }
+
+    /// Prepares and launches the graph. Returns false when it cannot be prepared. A previous run still going is
+    /// stopped gracefully first, without waiting: the graph is then launched by Update(), and HasFailed() tells
+    /// whether it could be prepared.
+    bool Run();
+
+    bool IsRunning()
+    {
+        return pipeline.IsRunning();
+    }
+
+    bool HasFailed()
+    {
+        return start_failed || pipeline.HasFailed();
+    }
+
+    /// Returns `true` from Run() until Update() saw the run end, which needs Update() calls in between.
+    bool IsActive() const
+    {
+        return running || run_pending;
+    }
+
+    /// Whether Update() must be called at a given time rather than on a wakeup of the blocks, see
+    /// Pipeline::HasDeadline(). A pending run waits for the graceful stop of the previous one.
+    bool HasDeadline() const
+    {
+        return run_pending || pipeline.HasDeadline();
+    }
+
+    /// Stops the sources and lets the frames drain through the graph, see ShutdownPolicy. Carried on by Update().
+    void Stop()
+    {
+        run_pending = false;
+        if (!pipeline.IsShuttingDown())
+            pipeline.Shutdown();
+    }
+
+    /// Stops the run of a context about to be deleted, see RetireContext(). The recordings of the run are dropped.
+    void Retire()
+    {
+        FinishCache(false);
+        Stop();
+    }
+
+    /// Whether nothing runs anymore, which needs Update() calls after Stop().
+    bool IsStopped()
+    {
+        return !pipeline.IsShuttingDown() && !pipeline.IsRunning();
+    }
+
+    const StopRecord* GetStopRecord(const void* node) const
+    {
+        Block* block = GetNodeBlock(node);
+        return block ? pipeline.GetStopRecord(block) : nullptr;
     }
 
-    void CollectBlock(Block* b)
+    std::string GetLog() const
     {
-        pipeline.Add(b);
+        return pipeline.GetLog();
     }
 
-    void Run();
+    /// Called every frame: exports the latency measurements when the pipeline stopped.
+    void Update();
+
+    void RenderLatency();
+    void RenderPreviews();
 };
 
 
@@ -112,15 +563,87 @@ struct Connection
         return !operator ==(other);
     }
 
+    /// Returns `true` when both ends run inside vpe and frames are passed in memory.
+    bool IsInProcess() const;
+
+    /// Returns `true` when frames go through a shared-memory ring (see vpe_shm.h) instead of a fifo.
+    bool UsesSharedMemory(const RunContext& ctx) const;
+
+    /// Returns `true` when vpe relays the frames between two external commands, to observe or record them.
+    bool IsRelayed(const RunContext& ctx) const;
+
+    RunContext::EdgeMode GetMode(const RunContext& ctx) const
+    {
+        return ctx.GetEdgeMode(input_node, input_slot, output_node, output_slot);
+    }
+
     bool Prepare(RunContext& ctx)
     {
-        return !GetFifoName(ctx).empty();
+        if (IsInProcess())
+            return true;
+        RunContext::EdgeMode mode = GetMode(ctx);
+        if (mode == RunContext::EdgeMode::Skip)
+            return true;
+        if (mode == RunContext::EdgeMode::Replay)
+        {
+            std::string to = GetChannelName(ctx);
+            if (to.empty())
+                return false;
+            ctx.CollectReplay(input_node, input_slot, output_node, output_slot, to);
+            return true;
+        }
+        if (mode != RunContext::EdgeMode::Normal)
+        {
+            std::string from = GetWriterChannelName(ctx);
+            std::string to = ctx.IsLaunched(input_node) ? GetChannelName(ctx) : std::string();
+            if (from.empty())
+                return false;
+            ctx.CollectCopy(input_node, input_slot, output_node, output_slot, from, to);
+            return true;
+        }
+        if (IsRelayed(ctx))
+        {
+            std::string from = GetWriterChannelName(ctx);
+            std::string to = GetChannelName(ctx);
+            if (from.empty() || to.empty())
+                return false;
+            auto sink = new FifoSinkBlock(to);
+            ctx.CollectBlock(sink, true);
+            ctx.CollectBlock(new FifoSourceBlock(from, Probe(ctx, sink)), true);
+            return true;
+        }
+        return !GetChannelName(ctx).empty();
     }
 
     std::string GetFifoName(RunContext& ctx)
     {
         return ctx.MakeOrGetFifo(input_node, input_slot, output_node, output_slot);
     }
+
+    ShmRing* GetRing(RunContext& ctx)
+    {
+        return ctx.MakeOrGetRing(input_node, input_slot, output_node, output_slot);
+    }
+
+    /// Slot name passed to the commands: a fifo path or a ring spec.
+    std::string GetChannelName(RunContext& ctx)
+    {
+        return UsesSharedMemory(ctx) ? GetRing(ctx)->GetSpec() : GetFifoName(ctx);
+    }
+
+    /// Slot name passed to the output node, which differs from GetChannelName() when the connection is relayed.
+    std::string GetWriterChannelName(RunContext& ctx)
+    {
+        if (!IsRelayed(ctx))
+            return GetChannelName(ctx);
+        // the relay reads this fifo, keyed by the reversed connection
+        return ctx.MakeOrGetFifo(output_node, output_slot, input_node, input_slot);
+    }
+
+    FrameSink* Probe(RunContext& ctx, FrameSink* sink) const
+    {
+        return ctx.Probe(input_node, input_slot, output_node, output_slot, sink);
+    }
 };
 
 enum NodeSlotTypes
@@ -154,65 +677,97 @@ struct BaseNode
 
     BaseNode(const BaseNode& other) = delete;
 
-    /// Renders a single node and it's connections.
+    /// Renders a single node and it's connections. The content of nodes out of view is skipped, and replaced by a
+    /// summary when the canvas is zoomed out. Content that did not change is replayed by ImNodes.
     void RenderNode()
     {
         // Start rendering node
-        if (ImNodes::BeginNode(this, &pos, &selected))
+        if (ImNodes::IsNodeVisible(this))
+            ImNodes::SetNextNodeVersion(GetContentVersion());
+        bool visible = ImNodes::BeginNode(this, &pos, &selected);
+        std::string label;
+        if (ImNodes::IsNodeSummarized())
+        {
+            label = GetLabel();
+            ImNodes::SetNodeSummary(label.c_str(), GetStatusColor());
+        }
+        if (visible)
         {
             // Render node title
             RenderTitle();
 
             // Render node-specific slots
             RenderNodeSlots();
+        }
 
-            // Store new connections when they are created
-            Connection new_connection;
-            if (ImNodes::GetNewConnection(&new_connection.input_node, &new_connection.input_slot,
-                &new_connection.output_node, &new_connection.output_slot))
+        // Store new connections when they are created
+        Connection new_connection;
+        if (ImNodes::GetNewConnection(&new_connection.input_node, &new_connection.input_slot,
+            &new_connection.output_node, &new_connection.output_slot))
+        {
+            // remove potential previous connection to the input slot
+            for (auto& c : ((BaseNode*) new_connection.input_node)->connections)
             {
-                // remove potential previous connection to the input slot
-                for (auto& c : ((BaseNode*) new_connection.input_node)->connections)
+                if (c.input_slot == new_connection.input_slot)
                 {
-                    if (c.input_slot == new_connection.input_slot)
-                    {
-                        ((BaseNode*) c.input_node)->DeleteConnection(c);
-                        ((BaseNode*) c.output_node)->DeleteConnection(c);
-                    }
+                    ((BaseNode*) c.input_node)->DeleteConnection(c);
+                    ((BaseNode*) c.output_node)->DeleteConnection(c);
                 }
-                ((BaseNode*) new_connection.input_node)->connections.push_back(new_connection);
-                ((BaseNode*) new_connection.output_node)->connections.push_back(new_connection);
             }
+            ((BaseNode*) new_connection.input_node)->connections.push_back(new_connection);
+            ((BaseNode*) new_connection.output_node)->connections.push_back(new_connection);
+        }
 
-            // Render output connections of this node
-            for (const Connection& connection : connections)
-            {
-                // Node contains all it's connections (both from output and to input slots). This means that multiple
-                // nodes will have same connection. We render only output connections and ensure that each connection
-                // will be rendered once.
-                if (connection.output_node != this)
-                    continue;
+        // Render output connections of this node, which may cross the view even when the node is out of it
+        for (const Connection& connection : connections)
+        {
+            // Node contains all it's connections (both from output and to input slots). This means that multiple
+            // nodes will have same connection. We render only output connections and ensure that each connection
+            // will be rendered once.
+            if (connection.output_node != this)
+                continue;
 
-                if (!ImNodes::Connection(connection.input_node, connection.input_slot, connection.output_node,
-                    connection.output_slot))
-                {
-                    // Remove deleted connections
-                    ((BaseNode*) connection.input_node)->DeleteConnection(connection);
-                    ((BaseNode*) connection.output_node)->DeleteConnection(connection);
-                }
+            if (!ImNodes::Connection(connection.input_node, connection.input_slot, connection.output_node,
+                connection.output_slot))
+            {
+                // Remove deleted connections
+                ((BaseNode*) connection.input_node)->DeleteConnection(connection);
+                ((BaseNode*) connection.output_node)->DeleteConnection(connection);
             }
+        }
 
-            // Node rendering is done. This call will render node background based on size of content inside node.
-            ImNodes::EndNode();
+        // Node rendering is done. This call will render node background based on size of content inside node.
+        ImNodes::EndNode();
 
-            // Store node width which is needed for centering title.
+        // Store node width which is needed for centering title.
+        if (visible)
             node_width = ImGui::GetItemRectSize().x;
-        }
     }
 
     /// Renders custom node content (slots, widgets)
     virtual void RenderNodeSlots() = 0;
 
+    /// Hash of everything the content of the node shows, see ImNodes::SetNextNodeVersion(). 0 lays the content out
+    /// at every frame.
+    virtual ImU32 GetContentVersion()
+    {
+        return 0;
+    }
+
+    /// Hash of the title and slot layout, and of the recorded input slots, which are drawn red.
+    ImU32 GetLayoutVersion() const
+    {
+        float widths[2] = {node_width, output_max_title_width};
+        ImU32 version = ImHashData(widths, sizeof(widths));
+        for (const Connection& c : connections)
+        {
+            if (c.input_node == this && recorded_edges.count(std::make_tuple((const void*) c.input_node, c.input_slot,
+                                                                            (const void*) c.output_node, c.output_slot)))
+                version = ImHashStr(c.input_slot, 0, version);
+        }
+        return version;
+    }
+
     virtual void RenderTitle()
     {
         if (node_width > 0)
@@ -247,6 +802,58 @@ struct BaseNode
 
             ImColor color = gCanvas->colors[is_active ? ImNodes::ColConnectionActive : ImNodes::ColConnection];
 
+            // ctrl+click on the curve of an input slot records the connection, shift+click previews it and alt+click
+            // measures its statistics
+            if (const Connection* c = ImNodes::IsInputSlotKind(kind) ? FindInputConnection(slot_title) : nullptr)
+            {
+                auto key = std::make_tuple((const void*) c->input_node, c->input_slot, (const void*) c->output_node,
+                                           c->output_slot);
+                bool tapped = recorded_edges.count(key) > 0;
+                if (ImNodes::IsSlotCurveHovered())
+                {
+                    const ImGuiIO& io = ImGui::GetIO();
+                    if (ImGui::IsMouseClicked(0) && io.KeyCtrl)
+                    {
+                        tapped = !tapped;
+                        if (tapped)
+                            recorded_edges.insert(key);
+                        else
+                            recorded_edges.erase(key);
+                    }
+                    if (ImGui::IsMouseClicked(0) && io.KeyShift)
+                        context->SetPreviewed(c->input_node, c->input_slot, c->output_node, c->output_slot,
+                                              !context->IsPreviewed(c->input_node, c->input_slot, c->output_node,
+                                                                    c->output_slot));
+                    bool stats = context->IsMeasuringStats(c->input_node, c->input_slot, c->output_node,
+                                                           c->output_slot);
+                    if (ImGui::IsMouseClicked(0) && io.KeyAlt)
+                    {
+                        stats = !stats;
+                        context->SetMeasuringStats(c->input_node, c->input_slot, c->output_node, c->output_slot,
+                                                   stats);
+                    }
+                    std::string path = context->GetRecordingPath(c->input_node, c->input_slot, c->output_node,
+                                                                 c->output_slot);
+                    ImGui::BeginTooltip();
+                    auto metrics = remote_edges.find(key);
+                    if (metrics != remote_edges.end() && metrics->second.frames)
+                        ImGui::Text("daemon: %u frames, p50 %.2f ms, p99 %.2f ms, max %.2f ms",
+                                    metrics->second.frames, metrics->second.p50_ms, metrics->second.p99_ms,
+                                    metrics->second.max_ms);
+                    if (stats)
+                        context->RenderStats(c->input_node, c->input_slot, c->output_node, c->output_slot);
+                    ImGui::TextUnformatted(!path.empty() ? ("recorded to " + path).c_str() :
+                                           tapped ? "recorded at the next run (ctrl+click: stop recording)" :
+                                           "ctrl+click: record at the next run");
+                    ImGui::TextUnformatted("shift+click: preview");
+                    ImGui::TextUnformatted(stats ? "alt+click: stop measuring statistics" :
+                                           "alt+click: measure statistics at the next run");
+                    ImGui::EndTooltip();
+                }
+                if (tapped && !is_active)
+                    color = ImColor(1.f, 0.35f, 0.3f);
+            }
+
             ImGui::PushStyleColor(ImGuiCol_Text, color.Value);
 
             if (ImNodes::IsOutputSlotKind(kind))
@@ -319,9 +926,29 @@ struct BaseNode
         return false;
     }
 
+    /// Finds the connection to input slot `slot_title`.
+    const Connection* FindInputConnection(const char* slot_title) const
+    {
+        for (const auto& c : connections)
+        {
+            if (c.input_node == this && c.input_slot == slot_title)
+                return &c;
+        }
+        return nullptr;
+    }
+
     /// Deletes connection from this node.
     void DeleteConnection(const Connection& connection)
     {
+        recorded_edges.erase(std::make_tuple((const void*) connection.input_node, connection.input_slot,
+                                             (const void*) connection.output_node, connection.output_slot));
+        if (context)
+        {
+            context->SetPreviewed(connection.input_node, connection.input_slot, connection.output_node,
+                                  connection.output_slot, false);
+            context->SetMeasuringStats(connection.input_node, connection.input_slot, connection.output_node,
+                                       connection.output_slot, false);
+        }
         for (auto it = connections.begin(); it != connections.end(); ++it)
         {
             if (connection == *it)
@@ -335,216 +962,2104 @@ struct BaseNode
     virtual bool Prepare(RunContext& ctx) {
         return true;
     }
+
+    /// Connects in-process connections, once every node was prepared.
+    virtual bool Link(RunContext& ctx) {
+        return true;
+    }
+
+    /// Returns `true` for nodes executed by the engine inside vpe.
+    virtual bool IsInProcess() const {
+        return false;
+    }
+
+    /// Returns `true` when the node can read and write shared-memory rings.
+    virtual bool AcceptsSharedMemory() const {
+        return false;
+    }
+
+    /// Short name of the node for reports.
+    virtual std::string GetLabel() const {
+        return title;
+    }
+
+    /// Color of the status shown on the node when the canvas is zoomed out, 0 when there is nothing to show.
+    virtual ImU32 GetStatusColor() {
+        return 0;
+    }
 };
 
-struct VPPOperator : BaseNode
+bool Connection::IsInProcess() const
 {
-    explicit VPPOperator() : BaseNode("vpp operator") { }
+    return ((BaseNode*) input_node)->IsInProcess() && ((BaseNode*) output_node)->IsInProcess();
+}
 
-    std::string command;
-    int ninputs = 0;
-    int noutputs = 0;
-    bool checked = false;
+bool Connection::IsRelayed(const RunContext& ctx) const
+{
+    RunContext::EdgeMode mode = GetMode(ctx);
+    if (mode == RunContext::EdgeMode::Record || mode == RunContext::EdgeMode::Discard)
+        return true;
+    bool observed = ctx.IsMeasuringLatency()
+                    || ctx.IsPreviewed(input_node, input_slot, output_node, output_slot)
+                    || ctx.IsMeasuringStats(input_node, input_slot, output_node, output_slot)
+                    || recorded_edges.count(std::make_tuple(input_node, input_slot, output_node, output_slot));
+    return mode == RunContext::EdgeMode::Normal && observed && !((BaseNode*) input_node)->IsInProcess()
+           && !((BaseNode*) output_node)->IsInProcess();
+}
 
-    CommandBlock* block = nullptr;
+bool Connection::UsesSharedMemory(const RunContext& ctx) const
+{
+    auto input = (BaseNode*) input_node;
+    auto output = (BaseNode*) output_node;
+    if (IsInProcess() || GetMode(ctx) != RunContext::EdgeMode::Normal || IsRelayed(ctx)
+        || !input->AcceptsSharedMemory() || !output->AcceptsSharedMemory())
+        return false;
+    if (output->IsInProcess())
+        return true;
+    // a ring has a single reader, a command output read by several nodes is duplicated over fifos
+    int readers = 0;
+    for (const auto& c : output->connections)
+    {
+        if (c.output_node == output && c.output_slot == output_slot)
+            readers++;
+    }
+    return readers == 1;
+}
 
-    void RenderNodeSlots() override
+/// Per-node settings, saved in the graph file as `id.key=value` lines.
+struct NodeSettings
+{
+    /// The command understands "shm:" slot names (see vpe_shm.h).
+    bool shm = false;
+    /// The output of the command only depends on its command line, its inputs and its input files, so it can be
+    /// cached (see cache.hpp).
+    bool deterministic = false;
+    /// CPU list such as "0-3,8" the command is pinned to, empty to let the auto-placer or the kernel decide.
+    std::string cpus;
+    int nice = 0;
+    Config::Scheduling scheduling = Config::Scheduling::inherit;
+    Config::IOClass io_class = Config::IOClass::inherit;
+    int io_priority = 4;
+    /// Resource limits, 0 for none. `memory` limits the resident memory and needs a cgroup (see cgroup.hpp).
+    int address_space_mb = 0;
+    int memory_mb = 0;
+    int cpu_seconds = 0;
+    int open_files = 0;
+
+    void Save(FILE* file, int id) const
     {
-        const auto& style = ImGui::GetStyle();
+        if (shm)
+            fprintf(file, "%d.shm=1\n", id);
+        if (deterministic)
+            fprintf(file, "%d.deterministic=1\n", id);
+        if (!cpus.empty())
+            fprintf(file, "%d.cpus=%s\n", id, cpus.c_str());
+        if (nice)
+            fprintf(file, "%d.nice=%d\n", id, nice);
+        if (scheduling != Config::Scheduling::inherit)
+            fprintf(file, "%d.sched=%s\n", id, SchedulingNames[(int) scheduling]);
+        if (io_class != Config::IOClass::inherit)
+            fprintf(file, "%d.io=%s/%d\n", id, IOClassNames[(int) io_class], io_priority);
+        if (address_space_mb)
+            fprintf(file, "%d.address_space=%d\n", id, address_space_mb);
+        if (memory_mb)
+            fprintf(file, "%d.memory=%d\n", id, memory_mb);
+        if (cpu_seconds)
+            fprintf(file, "%d.cpu_time=%d\n", id, cpu_seconds);
+        if (open_files)
+            fprintf(file, "%d.open_files=%d\n", id, open_files);
+    }
 
-        ImGui::BeginGroup();
+    /// Returns false for unknown keys and invalid values.
+    bool Load(const std::string& key, const std::string& value)
+    {
+        std::vector<int> list;
+        if (key == "shm")
+            shm = value == "1";
+        else if (key == "deterministic")
+            deterministic = value == "1";
+        else if (key == "cpus" && ParseCpuList(value, list))
+            cpus = value;
+        else if (key == "nice")
+            nice = atoi(value.c_str());
+        else if (key == "address_space")
+            address_space_mb = atoi(value.c_str());
+        else if (key == "memory")
+            memory_mb = atoi(value.c_str());
+        else if (key == "cpu_time")
+            cpu_seconds = atoi(value.c_str());
+        else if (key == "open_files")
+            open_files = atoi(value.c_str());
+        else if (key == "sched")
         {
-            for (int i = 0; i < ninputs; i++) {
-                RenderSlot(PipeInputSlotNames[i], ImNodes::InputSlotKind(NodeSlotPipe));
-            }
+            int index;
+            if (!FindName(SchedulingNames, value, index))
+                return false;
+            scheduling = static_cast<Config::Scheduling>(index);
         }
-        ImGui::EndGroup();
-
+        else if (key == "io")
+        {
+            size_t slash = value.find('/');
+            int index;
+            if (!FindName(IOClassNames, value.substr(0, slash), index))
+                return false;
+            io_class = static_cast<Config::IOClass>(index);
+            if (slash != std::string::npos)
+                io_priority = atoi(value.c_str() + slash + 1);
+        }
+        else
+            return false;
+        return true;
+    }
+
+    /// Returns false when the settings are invalid.
+    bool Apply(Config& config) const
+    {
+        if (!ParseCpuList(cpus, config.cpus))
+            return false;
+        config.nice = nice;
+        config.scheduling = scheduling;
+        config.io_class = io_class;
+        config.io_priority = io_priority;
+        config.max_address_space = (size_t) std::max(address_space_mb, 0) << 20;
+        config.max_cpu_seconds = std::max(cpu_seconds, 0);
+        config.max_open_files = std::max(open_files, 0);
+        return true;
+    }
+
+    void Render()
+    {
+        ImGui::Checkbox("shared memory slots (vpe_shm.h)", &shm);
+        ImGui::Checkbox("deterministic (cache the outputs)", &deterministic);
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputText("CPUs", &cpus);
+        std::vector<int> list;
+        if (!ParseCpuList(cpus, list))
+        {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.3, 0.3, 1), "invalid");
+        }
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderInt("nice", &nice, -20, 19);
+        ImGui::SetNextItemWidth(120);
+        int index = (int) scheduling;
+        if (ImGui::Combo("scheduling", &index, SchedulingNames, 4))
+            scheduling = static_cast<Config::Scheduling>(index);
+        ImGui::SetNextItemWidth(120);
+        index = (int) io_class;
+        if (ImGui::Combo("I/O class", &index, IOClassNames, 4))
+            io_class = static_cast<Config::IOClass>(index);
+        if (io_class == Config::IOClass::realtime || io_class == Config::IOClass::best_effort)
+        {
+            ImGui::SetNextItemWidth(120);
+            ImGui::SliderInt("I/O priority", &io_priority, 0, 7);
+        }
+        ImGui::Separator();
+        ImGui::TextUnformatted("limits (0: none)");
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputInt("address space (MB)", &address_space_mb, 256);
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputInt("memory (MB)", &memory_mb, 256);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("resident memory, enforced when a cgroup is delegated through $VPE_CGROUP");
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputInt("CPU time (s)", &cpu_seconds, 10);
+        ImGui::SetNextItemWidth(120);
+        ImGui::InputInt("open files", &open_files, 16);
+    }
+
+private:
+
+    static constexpr const char* SchedulingNames[4] = {"inherit", "other", "batch", "idle"};
+    static constexpr const char* IOClassNames[4] = {"inherit", "rt", "be", "idle"};
+
+    /// Sets `value` to the index of `name` in `names`, which is always a valid enumerator.
+    static bool FindName(const char* const (&names)[4], const std::string& name, int& value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (name == names[i])
+            {
+                value = i;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+constexpr const char* NodeSettings::SchedulingNames[4];
+constexpr const char* NodeSettings::IOClassNames[4];
+
+struct VPPOperator : BaseNode
+{
+    explicit VPPOperator() : BaseNode("vpp operator") { }
+
+    std::string command;
+    int ninputs = 0;
+    int noutputs = 0;
+    bool checked = false;
+    /// Last error reported while preparing the node.
+    std::string error;
+    NodeSettings settings;
+
+    void RenderNodeSlots() override
+    {
+        const auto& style = ImGui::GetStyle();
+        Block* block = context->GetNodeBlock(this);
+
+        ImGui::BeginGroup();
+        {
+            for (int i = 0; i < ninputs; i++) {
+                RenderSlot(PipeInputSlotNames[i], ImNodes::InputSlotKind(NodeSlotPipe));
+            }
+        }
+        ImGui::EndGroup();
+
+        ImGui::SetCursorScreenPos({ImGui::GetItemRectMax().x + style.ItemSpacing.x, ImGui::GetItemRectMin().y});
+        ImGui::BeginGroup();
+        auto remote = daemon_peer ? remote_nodes.find(this) : remote_nodes.end();
+        if (remote != remote_nodes.end())
+        {
+            using daemon_protocol::NodeStatus;
+            const NodeStatus& status = remote->second;
+            ImGui::TextUnformatted(status.state == NodeStatus::Running ? "running (daemon)" :
+                                   status.state == NodeStatus::FromCache ? "from cache (daemon)" :
+                                   status.state == NodeStatus::LimitHit ? "limit hit (daemon)" :
+                                   "not running (daemon)");
+            if (status.crashes)
+                ImGui::TextColored(ImVec4(1, 0.4, 0.2, 1), "%d crashes", (int) status.crashes);
+        }
+        else if (block && block->IsRunning())
+        {
+            ImGui::TextUnformatted("running");
+            if (ImGui::Button("stop")) {
+                context->StopNode(this);
+            }
+        }
+        else if (context->IsServedFromCache(this))
+        {
+            ImGui::TextUnformatted("from cache");
+        }
+        else if (block && !block->GetLimitBreach().empty())
+        {
+            ImGui::TextColored(ImVec4(1, 0.4, 0.2, 1), "limit hit: %s", block->GetLimitBreach().c_str());
+        }
+        else if (block && !block->GetLimitHint().empty())
+        {
+            ImGui::TextUnformatted(block->GetLimitHint().c_str());
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("the limit may be the cause, the kernel does not report these breaches");
+        }
+        else
+        {
+            ImGui::TextUnformatted("not running");
+        }
+        if (ImGui::Button("console")) {
+            ImGui::OpenPopup("Console");
+        }
+        if (!IsInProcess() && ImGui::Button("settings")) {
+            ImGui::OpenPopup("Settings");
+        }
+        if (noutputs == 0 && ImGui::Button("run")) {
+            RunGraph();
+        }
+        if (ImGui::BeginPopup("Console")) {
+            if (block)
+                ImGui::TextUnformatted(block->GetOutput().c_str());
+            if (!error.empty())
+                ImGui::TextUnformatted(error.c_str());
+            if (const StopRecord* stop = context->GetStopRecord(this))
+                ImGui::Text("stopped in %.2f s (%s)", stop->latency,
+                            stop->ending == StopRecord::Drained ? "drained" :
+                            stop->ending == StopRecord::Stopped ? "stopped" : "killed");
+            auto crashes = context->GetCrashes(this);
+            if (!crashes.empty())
+            {
+                ImGui::Separator();
+                ImGui::Text("%d crashes", (int) crashes.size());
+                for (const auto& c : crashes)
+                {
+                    char date[32];
+                    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&c.time));
+                    ImGui::Text("%s  status %d%s%s", date, c.status, c.limit.empty() ? "" : ", limit hit: ",
+                                c.limit.c_str());
+                }
+            }
+            if (ImGui::IsAnyMouseDown() && !ImGui::IsWindowHovered())
+                ImGui::CloseCurrentPopup();
+            ImGui::EndPopup();
+        }
+        if (ImGui::BeginPopup("Settings")) {
+            settings.Render();
+            if (ImGui::IsAnyMouseDown() && !ImGui::IsWindowHovered())
+                ImGui::CloseCurrentPopup();
+            ImGui::EndPopup();
+        }
+        ImGui::EndGroup();
+
         ImGui::SetCursorScreenPos({ImGui::GetItemRectMax().x + style.ItemSpacing.x, ImGui::GetItemRectMin().y});
         ImGui::BeginGroup();
+        {
+            for (int i = 0; i < noutputs; i++) {
+                RenderSlot(PipeOutputSlotNames[i], ImNodes::OutputSlotKind(NodeSlotPipe));
+            }
+        }
+        ImGui::EndGroup();
+    }
+
+    virtual void RenderTitle() override
+    {
+        ImGui::SetNextItemWidth(150);
+
+        float title_size = ImGui::CalcItemWidth();
+        ImGui::SetCursorPosX(ImGui::GetCursorPosX() + node_width / 2.f - title_size / 2.f);
+
+        if (ImGui::InputText("##command", &command, ImGuiInputTextFlags_EnterReturnsTrue)) {
+            SetCommand(command);
+        }
+    }
+
+    void SetCommand(const std::string& str)
+    {
+        command = str;
+        ninputs = 0;
+        while (command.find(PipeInputSlotNames[ninputs]) != std::string::npos) {
+            ninputs++;
+        }
+        noutputs = 0;
+        while (command.find(PipeOutputSlotNames[noutputs]) != std::string::npos) {
+            noutputs++;
+        }
+    }
+
+    virtual bool IsInProcess() const override
+    {
+        return IsBuiltinCommand(command);
+    }
+
+    virtual bool AcceptsSharedMemory() const override
+    {
+        return IsInProcess() || settings.shm;
+    }
+
+    virtual std::string GetLabel() const override
+    {
+        auto args = SplitCommand(command);
+        if (args.empty())
+            return title;
+        if (args.size() > 1 && IsInProcess())
+            return args[0] + " " + args[1];
+        return args[0];
+    }
+
+    /// Same states as RenderNodeSlots().
+    virtual ImU32 GetContentVersion() override
+    {
+        ImU32 version = ImHashStr(command.c_str(), command.size(), GetLayoutVersion());
+        auto remote = daemon_peer ? remote_nodes.find(this) : remote_nodes.end();
+        if (remote != remote_nodes.end())
+        {
+            int status[2] = {remote->second.state, remote->second.crashes};
+            version = ImHashData(status, sizeof(status), version);
+        }
+        Block* block = context->GetNodeBlock(this);
+        bool states[3] = {block && block->IsRunning(), context->IsServedFromCache(this), IsInProcess()};
+        version = ImHashData(states, sizeof(states), version);
+        int counts[3] = {ninputs, noutputs, (int) context->GetCrashCount(this)};
+        version = ImHashData(counts, sizeof(counts), version);
+        if (block)
+        {
+            std::string breach = block->GetLimitBreach() + block->GetLimitHint();
+            version = ImHashStr(breach.c_str(), breach.size(), version);
+        }
+        return version;
+    }
+
+    /// Same states as the status text of RenderNodeSlots().
+    virtual ImU32 GetStatusColor() override
+    {
+        const ImU32 running = IM_COL32(80, 200, 100, 255);
+        const ImU32 cached = IM_COL32(80, 140, 230, 255);
+        const ImU32 failed = IM_COL32(255, 102, 51, 255);
+        auto remote = daemon_peer ? remote_nodes.find(this) : remote_nodes.end();
+        if (remote != remote_nodes.end())
+        {
+            using daemon_protocol::NodeStatus;
+            const NodeStatus& status = remote->second;
+            if (status.crashes || status.state == NodeStatus::LimitHit)
+                return failed;
+            return status.state == NodeStatus::Running ? running :
+                   status.state == NodeStatus::FromCache ? cached : 0;
+        }
+        Block* block = context->GetNodeBlock(this);
         if (block && block->IsRunning())
+            return running;
+        if (context->IsServedFromCache(this))
+            return cached;
+        if (!error.empty() || (block && !block->GetLimitBreach().empty()) || context->GetCrashCount(this) > 0)
+            return failed;
+        return 0;
+    }
+
+    /// Finds the connection to input slot `i`.
+    Connection* GetInputConnection(int i)
+    {
+        for (auto& c : connections)
+        {
+            if (c.input_node == this && c.input_slot == PipeInputSlotNames[i])
+                return &c;
+        }
+        return nullptr;
+    }
+
+    bool PrepareBuiltin(RunContext& ctx)
+    {
+        error.clear();
+        EngineNode* engine_node = MakeBuiltinNode(ctx.Expand(command), error);
+        if (!engine_node)
+        {
+            printf("%s: %s\n", command.c_str(), error.c_str());
+            return false;
+        }
+        ctx.SetNodeBlock(this, engine_node, engine_node);
+        ctx.CollectBlock(engine_node);
+
+        // Only connections to external commands need a bridge, others are linked in Link().
+        for (int i = 0; i < ninputs; i++) {
+            Connection* con = GetInputConnection(i);
+            if (!con) {
+                printf("input slot %d not connected?\n", i);
+                return false;
+            }
+            if (con->IsInProcess())
+                continue;
+            const std::string& name = con->GetChannelName(ctx);
+            if (name.empty()) {
+                printf("slot %d not prepared\n", i);
+                return false;
+            }
+            FrameSink* sink = con->Probe(ctx, engine_node);
+            if (con->UsesSharedMemory(ctx))
+                ctx.CollectBlock(new ShmSourceBlock(name, sink));
+            else
+                ctx.CollectBlock(new FifoSourceBlock(name, sink));
+        }
+        for (int i = 0; i < noutputs; i++) {
+            bool connected = false;
+            for (auto& c : connections)
+            {
+                if (c.output_node != this || c.output_slot != PipeOutputSlotNames[i])
+                    continue;
+                connected = true;
+                if (c.IsInProcess())
+                    continue;
+                const std::string& name = c.GetWriterChannelName(ctx);
+                if (name.empty()) {
+                    printf("slot %d not prepared\n", i);
+                    return false;
+                }
+                QueuedSinkBlock* sink;
+                if (c.UsesSharedMemory(ctx))
+                    sink = new ShmSinkBlock(name);
+                else
+                    sink = new FifoSinkBlock(name);
+                engine_node->AddOutput(c.Probe(ctx, sink));
+                ctx.CollectBlock(sink, true);
+            }
+            if (!connected) {
+                printf("output slot %d not connected?\n", i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual bool Link(RunContext& ctx) override
+    {
+        EngineNode* engine_node = ctx.GetEngineNode(this);
+        if (!engine_node)
+            return true;
+        for (auto& c : connections)
+        {
+            if (c.output_node == this && c.IsInProcess())
+            {
+                if (EngineNode* input = ctx.GetEngineNode(c.input_node))
+                    engine_node->AddOutput(c.Probe(ctx, input));
+            }
+        }
+        return true;
+    }
+
+    virtual bool Prepare(RunContext& ctx) override
+    {
+        if (IsBuiltinCommand(this->command))
+            return PrepareBuiltin(ctx);
+
+        std::string command = ctx.Expand(this->command);
+        Config config;
+        if (!settings.Apply(config)) {
+            error = "invalid CPU list '" + settings.cpus + "'";
+            printf("%s: %s\n", this->command.c_str(), error.c_str());
+            return false;
+        }
+        if (config.cpus.empty())
+            config.cpus = ctx.GetPlacement(this);
+        if (settings.memory_mb > 0)
+            config.cgroup = ctx.MakeCgroup(settings.memory_mb);
+        for (int i = 0; i < ninputs; i++) {
+            Connection* con = GetInputConnection(i);
+            if (!con) {
+                printf("input slot %d not connected?\n", i);
+                return false;
+            }
+            if (con->UsesSharedMemory(ctx))
+                AddDescriptors(config, con->GetRing(ctx));
+            const std::string& name = con->GetChannelName(ctx);
+            if (name.empty()) {
+                printf("slot %d not prepared\n", i);
+                return false;
+            }
+            command = std::regex_replace(command, std::regex(PipeInputSlotNames[i]), name);
+        }
+        // TODO: duplicate output if multiple inputs use it
+        for (int i = 0; i < noutputs; i++) {
+            std::vector<Connection*> outputs;
+            for (auto& c : connections)
+            {
+                if (c.output_node != this || c.output_slot != PipeOutputSlotNames[i])
+                    continue;
+                outputs.push_back(&c);
+            }
+            if (outputs.empty()) {
+                printf("output slot %d not connected?\n", i);
+                return false;
+            }
+            std::string fifoname;
+            if (outputs.size() == 1)
+            {
+                if (outputs[0]->UsesSharedMemory(ctx))
+                    AddDescriptors(config, outputs[0]->GetRing(ctx));
+                fifoname = outputs[0]->GetWriterChannelName(ctx);
+            }
+            else
+            {
+                // multiple outputs, so we need to duplicate the stream
+                // XXX: this is vpp specific
+                auto fifo = ctx.MakeFifo();
+                fifoname = fifo;
+                for (unsigned i = 0; i < outputs.size() - 1; i++)
+                {
+                    std::string from = fifo;
+                    std::string to;
+                    if (i == outputs.size() - 2)
+                    {
+                        to = outputs[i+1]->GetWriterChannelName(ctx);
+                    }
+                    else
+                    {
+                        fifo = ctx.MakeFifo();
+                        to = fifo;
+                    }
+                    std::string to2 = outputs[i]->GetWriterChannelName(ctx);
+                    ctx.CollectBlock(new CommandBlock("vp dup " + from + " " + to + " " + to2), true);
+                }
+            }
+            if (fifoname.empty()) {
+                printf("slot %d not prepared\n", i);
+                return false;
+            }
+            command = std::regex_replace(command, std::regex(PipeOutputSlotNames[i]), fifoname);
+        }
+
+        Block* block = new CommandBlock(command, config);
+        ctx.SetNodeBlock(this, block);
+        ctx.CollectBlock(block);
+        return true;
+    }
+
+    static void AddDescriptors(Config& config, const ShmRing* ring)
+    {
+        for (int fd : ring->GetDescriptors())
+            config.keep_file_descriptors.push_back(fd);
+    }
+};
+
+void RunContext::Place()
+{
+    // pipeline order: depth first from the sources, so that the stages of a chain are consecutive
+    std::map<const BaseNode*, int> indegree;
+    for (auto node : nodes)
+    {
+        for (const auto& c : node->connections)
+        {
+            if (c.input_node == node)
+                indegree[node]++;
+        }
+    }
+    std::vector<BaseNode*> stack;
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+    {
+        if (!indegree[*it])
+            stack.push_back(*it);
+    }
+    std::vector<BaseNode*> order;
+    while (!stack.empty())
+    {
+        BaseNode* node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+        for (auto it = node->connections.rbegin(); it != node->connections.rend(); ++it)
+        {
+            if (it->output_node == node && --indegree[(BaseNode*) it->input_node] == 0)
+                stack.push_back((BaseNode*) it->input_node);
+        }
+    }
+
+    // built-in nodes run on the engine threads, and explicit CPU sets are kept
+    std::vector<BaseNode*> stages;
+    for (auto node : order)
+    {
+        if (!node->IsInProcess() && ((VPPOperator*) node)->settings.cpus.empty())
+            stages.push_back(node);
+    }
+    auto cores = CpuTopology::Read().Place((int) stages.size());
+    for (size_t i = 0; i < stages.size(); i++)
+    {
+        placement[stages[i]] = cores[i];
+        printf("place '%s' on CPUs %s\n", stages[i]->GetLabel().c_str(), FormatCpuList(cores[i]).c_str());
+    }
+}
+
+void RunContext::PlanCache()
+{
+    edge_modes.clear();
+    edge_files.clear();
+    launched.clear();
+    served.clear();
+    recordings.clear();
+    replays.clear();
+
+    // keys of the deterministic commands whose inputs all come from deterministic commands
+    std::map<const void*, std::string> keys;
+    std::set<const void*> visiting;
+    std::function<std::string(VPPOperator*)> key = [&](VPPOperator* node) -> std::string {
+        auto it = keys.find(node);
+        if (it != keys.end())
+            return it->second;
+        if (!node->settings.deterministic || node->IsInProcess() || visiting.count(node))
+            return std::string();
+        visiting.insert(node);
+        std::string command = Expand(node->command);
+        std::string text = "command " + command + "\n";
+        bool ok = true;
+        for (int i = 0; i < node->ninputs && ok; i++)
+        {
+            Connection* c = node->GetInputConnection(i);
+            std::string upstream = c ? key((VPPOperator*) c->output_node) : std::string();
+            ok = !upstream.empty();
+            text += "input " + std::to_string(i) + " " + upstream + " " + (c ? c->output_slot : "") + "\n";
+        }
+        for (const auto& arg : SplitCommand(command))
+        {
+            std::string stamp = ResultCache::FileStamp(arg);
+            if (!stamp.empty())
+                text += "file " + stamp + "\n";
+        }
+        visiting.erase(node);
+        return keys[node] = ok ? ResultCache::Hash(text) : std::string();
+    };
+
+    auto slot_index = [](const char* slot) {
+        for (int i = 0; i < (int) (sizeof(PipeOutputSlotNames) / sizeof(PipeOutputSlotNames[0])); i++)
+        {
+            if (slot == PipeOutputSlotNames[i])
+                return i;
+        }
+        return -1;
+    };
+
+    for (auto n : nodes)
+    {
+        auto node = (VPPOperator*) n;
+        std::string k = key(node);
+        if (k.empty())
+            continue;
+        bool consumed = false;
+        bool hit = true;
+        for (const auto& c : node->connections)
+        {
+            if (c.output_node != node)
+                continue;
+            consumed = true;
+            hit = cache.Contains(cache.GetPath(k, slot_index(c.output_slot))) && hit;
+        }
+        if (!consumed)
+            continue;
+        cache.CountLookup(hit);
+        printf("cache: %s for '%s'\n", hit ? "hit" : "miss", node->command.c_str());
+        if (hit)
+            served.insert(node);
+    }
+
+    // a node is launched when it is a sink or feeds a launched node, unless it is served from the cache
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto node : nodes)
+        {
+            if (launched.count(node) || served.count(node))
+                continue;
+            bool sink = true;
+            bool feeds = false;
+            for (const auto& c : node->connections)
+            {
+                if (c.output_node != node)
+                    continue;
+                sink = false;
+                feeds = feeds || launched.count(c.input_node);
+            }
+            if (sink || feeds)
+            {
+                launched.insert(node);
+                changed = true;
+            }
+        }
+    }
+
+    for (auto n : nodes)
+    {
+        auto node = (VPPOperator*) n;
+        std::string k = keys[node];
+        std::set<const char*> recorded;
+        for (const auto& c : node->connections)
+        {
+            if (c.output_node != node || c.IsInProcess())
+                continue;
+            EdgeKey edge(c.input_node, c.input_slot, c.output_node, c.output_slot);
+            EdgeMode& mode = edge_modes[edge];
+            bool consumer = launched.count(c.input_node) > 0;
+            if (served.count(node))
+                mode = consumer ? EdgeMode::Replay : EdgeMode::Skip;
+            else if (!launched.count(node))
+                mode = EdgeMode::Skip;
+            else if (!k.empty() && recorded.insert(c.output_slot).second)
+                mode = EdgeMode::Record;
+            else
+                mode = consumer ? EdgeMode::Normal : EdgeMode::Discard;
+            if (mode == EdgeMode::Replay || mode == EdgeMode::Record)
+                edge_files[edge] = cache.GetPath(k, slot_index(c.output_slot));
+        }
+    }
+}
+
+void RunContext::FinishCache(bool ended)
+{
+    for (const auto& r : recordings)
+    {
+        Block* producer = GetNodeBlock(r.node);
+        if (ended && r.block->IsComplete() && producer && !producer->HasFailed())
+        {
+            printf("cache: stored %s\n", r.path.c_str());
+            cache.Commit(r.part, r.path);
+        }
+        else
+        {
+            cache.Abort(r.part);
+        }
+    }
+    recordings.clear();
+    for (auto replay : replays)
+        cache.CountServed(replay->GetBytesServed());
+    replays.clear();
+}
+
+void RunContext::MakeGroups()
+{
+    // streams between the nodes of a connected part break together, so they restart together
+    std::map<const void*, const void*> parent;
+    std::function<const void*(const void*)> find = [&](const void* node) {
+        auto it = parent.find(node);
+        if (it == parent.end() || it->second == node)
+            return node;
+        return it->second = find(it->second);
+    };
+    for (auto node : nodes)
+    {
+        for (const auto& c : node->connections)
+            parent[find(c.input_node)] = find(c.output_node);
+    }
+    // longest path from the sources; cycles are cut after as many steps as there are nodes
+    node_ranks.clear();
+    for (size_t step = 0; step < nodes.size(); step++)
+    {
+        for (auto node : nodes)
+        {
+            for (const auto& c : node->connections)
+            {
+                if (c.output_node == node)
+                    node_ranks[c.input_node] = std::max(node_ranks[c.input_node], node_ranks[node] + 1);
+            }
+        }
+    }
+
+    node_groups.clear();
+    std::map<const void*, int> roots;
+    for (auto node : nodes)
+    {
+        auto root = roots.emplace(find(node), (int) roots.size()).first;
+        node_groups[node] = root->second;
+    }
+}
+
+void RunContext::ResetRings(int group)
+{
+    for (auto& r : rings)
+    {
+        if (node_groups[std::get<0>(r.first)] == group)
+            r.second->Reset();
+    }
+}
+
+FrameSink* RunContext::Probe(const void* node1, const char* slot1, const void* node2, const char* slot2,
+                             FrameSink* sink)
+{
+    auto key = std::make_tuple(node1, slot1, node2, slot2);
+    if (latency)
+    {
+        auto it = probes.find(key);
+        if (it != probes.end())
+            sink = latency->Wrap(sink, it->second);
+    }
+    if (stats_edges.count(key))
+    {
+        auto tap = new StatsTapBlock(sink);
+        stats_taps[key] = tap;
+        CollectBlock(tap, true);
+        sink = tap;
+    }
+    if (previews.count(key))
+    {
+        auto tap = new PreviewTapBlock(sink);
+        preview_taps[key] = tap;
+        CollectBlock(tap, true);
+        sink = tap;
+    }
+    if (recorded_edges.count(key))
+    {
+        auto recorder = new EdgeRecorderBlock(MakeRecordingPath(node2, slot2), sink);
+        recorders[key] = recorder;
+        CollectBlock(recorder, true);
+        sink = recorder;
+    }
+    return sink;
+}
+
+/// $VPE_RECORDINGS/[<job name>.]<label>.<slot>-<date>.vpp, $VPE_RECORDINGS being "recordings" by default.
+std::string RunContext::MakeRecordingPath(const void* node, const char* slot) const
+{
+    const char* env = getenv("VPE_RECORDINGS");
+    std::string dir = env && *env ? env : "recordings";
+    mkdir(dir.c_str(), 0755);
+    std::string label = ((const BaseNode*) node)->GetLabel();
+    for (char& c : label)
+    {
+        if (!isalnum((unsigned char) c) && c != '-' && c != '_')
+            c = '_';
+    }
+    auto name = variables.find("NAME");
+    if (name != variables.end())
+        label = name->second + "." + label;
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y%m%d-%H%M%S", localtime(&now));
+    std::string base = dir + "/" + label + "." + (slot + 1) + "-" + date;
+    std::string path = base + ".vpp";
+    // an output read by several recorded connections
+    auto taken = [this](const std::string& path) {
+        for (const auto& r : recorders)
+            if (r.second->GetPath() == path)
+                return true;
+        return false;
+    };
+    for (int n = 2; taken(path); n++)
+        path = base + "-" + std::to_string(n) + ".vpp";
+    return path;
+}
+
+void RunContext::StartLatencyMonitor()
+{
+    latency.reset(new LatencyMonitor());
+    probes.clear();
+
+    auto is_source = [](const BaseNode* node) {
+        for (const auto& c : node->connections)
+            if (c.input_node == node)
+                return false;
+        return true;
+    };
+    auto is_sink = [](const BaseNode* node) {
+        for (const auto& c : node->connections)
+            if (c.output_node == node)
+                return false;
+        return true;
+    };
+    auto label = [](const BaseNode* node) {
+        int id = (int) (std::find(nodes.begin(), nodes.end(), node) - nodes.begin());
+        return "#" + std::to_string(id) + " " + node->GetLabel();
+    };
+
+    std::map<const BaseNode*, StampTable*> stamps;
+    for (auto node : nodes)
+    {
+        if (is_source(node))
+            stamps[node] = latency->AddSource();
+    }
+
+    // sources upstream of each node
+    std::map<const BaseNode*, std::vector<const BaseNode*>> upstream;
+    std::function<const std::vector<const BaseNode*>&(const BaseNode*)> sources_of;
+    sources_of = [&](const BaseNode* node) -> const std::vector<const BaseNode*>& {
+        auto it = upstream.find(node);
+        if (it != upstream.end())
+            return it->second;
+        auto& result = upstream[node];  // also breaks cycles
+        if (stamps.count(node))
+            result.push_back(node);
+        for (const auto& c : node->connections)
+        {
+            if (c.input_node != node)
+                continue;
+            for (auto s : sources_of((const BaseNode*) c.output_node))
+                if (std::find(result.begin(), result.end(), s) == result.end())
+                    result.push_back(s);
+        }
+        return result;
+    };
+
+    std::map<std::pair<const BaseNode*, const BaseNode*>, LatencyPath*> paths;
+    for (auto node : nodes)
+    {
+        for (const auto& c : node->connections)
+        {
+            if (c.output_node != node)
+                continue;
+            auto input = (const BaseNode*) c.input_node;
+            auto probe = latency->AddProbe(label(node) + " " + c.output_slot + " -> " + label(input) + " "
+                                           + c.input_slot);
+            if (stamps.count(node))
+                probe->stamps = stamps[node];
+            for (auto source : sources_of(node))
+            {
+                LatencyPath* path = nullptr;
+                if (is_sink(input))
+                {
+                    auto& p = paths[std::make_pair(source, input)];
+                    if (!p)
+                        p = latency->AddPath(label(source) + " -> " + label(input));
+                    path = p;
+                }
+                probe->AddUpstream(stamps[source], path);
+            }
+            probes[std::make_tuple(c.input_node, c.input_slot, c.output_node, c.output_slot)] = probe;
+        }
+    }
+}
+
+void RunContext::Update()
+{
+    pipeline.Update();
+    if (run_pending)
+    {
+        if (pipeline.IsShuttingDown())
+            return;
+        run_pending = false;
+        start_failed = !Start();
+        if (start_failed)
+            running = false;
+        return;
+    }
+    if (running && !pipeline.IsRunning())
+    {
+        running = false;
+        FinishCache(true);
+        if (latency && latency->Export("latency.csv"))
+            printf("latency written to latency.csv\n");
+    }
+}
+
+void RunContext::RenderLatency()
+{
+    if (!latency)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(560, 220), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Latency"))
+    {
+        auto row = [](const std::string& name, const LatencyHistogram& h) {
+            ImGui::TextUnformatted(name.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long) h.GetCount());
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", h.GetPercentile(50) / 1000.);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", h.GetPercentile(99) / 1000.);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", h.GetMax() / 1000.);
+            ImGui::NextColumn();
+        };
+
+        ImGui::Columns(5);
+        ImGui::SetColumnWidth(0, 300);
+        for (const char* header : {"edge / path", "frames", "p50 ms", "p99 ms", "max ms"})
+        {
+            ImGui::TextUnformatted(header);
+            ImGui::NextColumn();
+        }
+        ImGui::Separator();
+        for (const auto& p : latency->GetProbes())
+            row(p->name, p->histogram);
+        ImGui::Separator();
+        for (const auto& p : latency->GetPaths())
+            row(p->name, p->histogram);
+        ImGui::Columns(1);
+
+        if (ImGui::Button("export csv"))
+            latency->Export("latency.csv");
+    }
+    ImGui::End();
+}
+
+void RunContext::RenderStats(const void* node1, const char* slot1, const void* node2, const char* slot2) const
+{
+    auto tap = stats_taps.find(std::make_tuple(node1, slot1, node2, slot2));
+    FrameStats stats;
+    if (tap == stats_taps.end() || !tap->second->GetStats(stats))
+    {
+        ImGui::TextUnformatted(tap == stats_taps.end() ? "statistics from the next run" : "waiting for frames");
+        ImGui::Separator();
+        return;
+    }
+    ImGui::Text("%dx%dx%d, frame %llu, %llu frames sampled, %llu skipped while busy", stats.w, stats.h, stats.d,
+                (unsigned long long) stats.sequence, (unsigned long long) tap->second->GetSampledCount(),
+                (unsigned long long) tap->second->GetDroppedCount());
+    // frames with many channels only show the first ones
+    for (int c = 0; c < (int) stats.channels.size() && c < 4; c++)
+    {
+        const ChannelStats& s = stats.channels[c];
+        if (s.finite)
+            ImGui::Text("channel %d: min %g, max %g, mean %g", c, s.min, s.max, s.mean);
+        else
+            ImGui::Text("channel %d: no finite sample", c);
+        if (s.nan || s.inf)
+        {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1, 0.4, 0.2, 1), "%llu NaN, %llu Inf", (unsigned long long) s.nan,
+                               (unsigned long long) s.inf);
+        }
+        float histogram[ChannelStats::Bins];
+        for (int i = 0; i < ChannelStats::Bins; i++)
+            histogram[i] = s.histogram[i];
+        ImGui::PushID(c);
+        ImGui::PlotHistogram("", histogram, ChannelStats::Bins, 0, nullptr, 0.f, FLT_MAX, ImVec2(256, 48));
+        ImGui::PopID();
+    }
+    ImGui::Separator();
+}
+
+void RunContext::RenderPreviews()
+{
+    auto label = [](const void* node) {
+        int id = (int) (std::find(nodes.begin(), nodes.end(), node) - nodes.begin());
+        return "#" + std::to_string(id) + " " + ((const BaseNode*) node)->GetLabel();
+    };
+
+    size_t budget = PreviewTexture::UploadBudget;
+    for (auto it = previews.begin(); it != previews.end();)
+    {
+        auto key = *it;
+        std::string title = label(std::get<2>(key)) + " " + std::get<3>(key) + " -> " + label(std::get<0>(key)) + " "
+                            + std::get<1>(key) + "##preview" + std::to_string((uintptr_t) std::get<0>(key))
+                            + std::get<1>(key);
+        bool open = true;
+        ImGui::SetNextWindowSize(ImVec2(300, 280), ImGuiCond_FirstUseEver);
+        if (ImGui::Begin(title.c_str(), &open))
+        {
+            auto tap = preview_taps.find(key);
+            if (tap == preview_taps.end())
+            {
+                ImGui::TextUnformatted("shown from the next run");
+            }
+            else
+            {
+                auto& texture = preview_textures[key];
+                if (!texture)
+                    texture.reset(new PreviewTexture());
+                texture->Update(*tap->second, budget);
+
+                vpp::Format format;
+                uint64_t sequence;
+                float low, high;
+                tap->second->GetInfo(format, sequence, low, high);
+                if (texture->IsReady())
+                {
+                    float width = ImGui::GetContentRegionAvail().x;
+                    ImGui::Image(texture->GetId(), ImVec2(width, width * texture->GetHeight() / texture->GetWidth()));
+                    ImGui::Text("%dx%dx%d, frame %llu, range [%g, %g]", format.w, format.h, format.d,
+                                (unsigned long long) sequence, low, high);
+                }
+                else
+                {
+                    ImGui::TextUnformatted("waiting for frames");
+                }
+                ImGui::Text("%llu frames sampled, %llu dropped while busy",
+                            (unsigned long long) tap->second->GetSampledCount(),
+                            (unsigned long long) tap->second->GetDroppedCount());
+                int every = tap->second->every;
+                ImGui::SetNextItemWidth(120);
+                if (ImGui::SliderInt("sample every", &every, 1, 60))
+                    tap->second->every = every;
+                bool stretch = tap->second->stretch;
+                if (ImGui::Checkbox("stretch range", &stretch))
+                    tap->second->stretch = stretch;
+            }
+        }
+        ImGui::End();
+        ++it;
+        if (!open)
+            SetPreviewed(std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key), false);
+    }
+}
+
+bool RunContext::Run()
+{
+    start_failed = false;
+    if (pipeline.IsRunning() || pipeline.IsShuttingDown())
+    {
+        // the previous run drains while the GUI goes on, Update() starts this one
+        if (!pipeline.IsShuttingDown())
+        {
+            FinishCache(false);
+            pipeline.Shutdown();
+        }
+        run_pending = true;
+        running = true;
+        return true;
+    }
+    return Start();
+}
+
+bool RunContext::Start()
+{
+    // the previous run ended, its processes are reaped
+    FinishCache(!pipeline.IsRunning());
+    pipeline.DeleteBlocks();
+    cgroups.Clear();
+    rings.clear();
+    node_blocks.clear();
+    engine_nodes.clear();
+    probes.clear();
+    recorders.clear();
+    preview_taps.clear();
+    stats_taps.clear();
+    latency.reset();
+    if (measure_latency)
+        StartLatencyMonitor();
+    placement.clear();
+    if (auto_place)
+        Place();
+    MakeGroups();
+    pipeline.SetSupervised(supervise);
+    pipeline.SetRestartHook([this](int group) { ResetRings(group); });
+    PlanCache();
+
+    for (auto node : nodes)
+    {
+        current_group = node_groups[node];
+        current_rank = node_ranks[node];
+        for (auto& c : node->connections)
+        {
+            if (c.output_node != node)
+                continue;
+            if (!c.Prepare(*this))
+            {
+                return false;
+            }
+        }
+    }
+
+    for (auto node : nodes)
+    {
+        if (!IsLaunched(node))
+            continue;
+        current_group = node_groups[node];
+        current_rank = node_ranks[node];
+        if (!node->Prepare(*this))
+        {
+            return false;
+        }
+    }
+
+    for (auto node : nodes)
+    {
+        if (IsLaunched(node) && !node->Link(*this))
+        {
+            return false;
+        }
+    }
+
+    pipeline.Launch();
+    running = true;
+    return true;
+}
+
+std::map<std::string, BaseNode*(*)()> available_nodes{
+    {"vpp operator", []() -> BaseNode* {
+                                           auto x = new VPPOperator();
+                                           x->SetCommand("ls <1 >1 >2");
+                                           return x;
+                                       }},
+    {"Video Input", []() -> BaseNode* {
+                                           auto x = new VPPOperator();
+                                           x->SetCommand("vid2vpp file.avi >1");
+                                           return x;
+                                      }},
+    {"Map (builtin)", []() -> BaseNode* {
+                                           auto x = new VPPOperator();
+                                           x->SetCommand("builtin map <1 >1 \"x\"");
+                                           return x;
+                                      }},
+    {"Replay (builtin)", []() -> BaseNode* {
+                                           auto x = new VPPOperator();
+                                           x->SetCommand("builtin replay recording.vpp >1 --loop");
+                                           return x;
+                                      }},
+    {"Video Output", []() -> BaseNode* {
+                                           auto x = new VPPOperator();
+                                           x->SetCommand("vpp2vid <1 file.avi");
+                                           return x;
+                                      }},
+
+};
+
+static void WriteGraph(FILE* file)
+{
+    auto getnodid = [&](void* nod){
+        int i = 0;
+        for (auto n : nodes)
+        {
+            if (nod == n)
+                return i;
+            i++;
+        }
+        return -1;
+    };
+    for (const auto& v : graph_variables)
+        fprintf(file, "$%s=%s\n", v.first.c_str(), v.second.c_str());
+    for (int pass = 0; pass < 4; pass++)
+    for (auto n : nodes)
+    {
+        int id = getnodid(n);
+        if (pass == 0)
+            fprintf(file, "%d %s\n", id, ((VPPOperator*) n)->command.c_str());
+        if (pass == 2)
+            fprintf(file, "%d/%d,%d\n", id, (int) n->pos.x, (int) n->pos.y);
+        if (pass == 3)
+            ((VPPOperator*) n)->settings.Save(file, id);
+        for (auto& c : n->connections)
+        {
+            if (c.output_node != n)
+                continue;
+            bool recorded = recorded_edges.count(std::make_tuple((const void*) c.input_node, c.input_slot,
+                                                                 (const void*) c.output_node, c.output_slot));
+            if (pass == 1)
+                fprintf(file, "%d:%s %d:%s%s\n", id, c.output_slot, getnodid(c.input_node), c.input_slot,
+                        recorded ? " record" : "");
+        }
+    }
+}
+
+static void ReadGraph(FILE* file)
+{
+    for (auto n : nodes)
+        delete n;
+    nodes.clear();
+    graph_variables.clear();
+    recorded_edges.clear();
+
+    // TODO: fix buffers and array (node id) overflows
+    std::map<int, BaseNode*> id2node;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+
+        line[sizeof(line)-1] = 0;
+        line[strlen(line)-1] = 0;
+
+        if (line[0] == '$')
+        {
+            const char* eq = strchr(line, '=');
+            if (eq)
+                graph_variables[std::string((const char*) line + 1, eq)] = eq + 1;
+            continue;
+        }
+
+        int id;
+        char op;
+        if (sscanf(line, "%d%c", &id, &op) != 2)
+            continue;
+        // what follows the node id and the operator
+        const char* rest = line + strspn(line, "0123456789") + 1;
+
+        if (op == ' ')
+        {
+            auto node = new VPPOperator();
+            node->SetCommand(rest);
+            nodes.push_back(node);
+            id2node[id] = node;
+        }
+        else if (op == ':')
+        {
+            char inputslot[64];
+            char outputslot[64];
+            int toid;
+            if (sscanf(rest, "%63s %d:%63s", outputslot, &toid, inputslot) == 3)
+            {
+                Connection c;
+                c.output_node = id2node[id];
+                for (unsigned i = 0; i < sizeof(PipeOutputSlotNames)/sizeof(PipeOutputSlotNames[0]); i++)
+                    if (!strcmp(outputslot, PipeOutputSlotNames[i]))
+                        c.output_slot = PipeOutputSlotNames[i];
+                c.input_node = id2node[toid];
+                for (unsigned i = 0; i < sizeof(PipeInputSlotNames)/sizeof(PipeInputSlotNames[0]); i++)
+                    if (!strcmp(inputslot, PipeInputSlotNames[i]))
+                        c.input_slot = PipeInputSlotNames[i];
+                ((BaseNode*) c.output_node)->connections.push_back(c);
+                ((BaseNode*) c.input_node)->connections.push_back(c);
+                if (strstr(rest, " record"))
+                    recorded_edges.insert(std::make_tuple((const void*) c.input_node, c.input_slot,
+                                                          (const void*) c.output_node, c.output_slot));
+            }
+        }
+        else if (op == '/')
+        {
+            auto node = id2node[id];
+            int x, y;
+            if (sscanf(rest, "%d,%d", &x, &y) == 2)
+                node->pos = ImVec2(x, y);
+        }
+        else if (op == '.')
+        {
+            auto node = (VPPOperator*) id2node[id];
+            const char* eq = strchr(rest, '=');
+            if (node && eq)
+            {
+                std::string key(rest, eq);
+                if (!node->settings.Load(key, eq + 1))
+                    printf("unknown setting '%s'\n", key.c_str());
+            }
+        }
+        printf("%s\n", line);
+    }
+}
+
+static bool SaveGraph(const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        perror("fopen");
+        return false;
+    }
+    WriteGraph(file);
+    fclose(file);
+    return true;
+}
+
+static bool LoadGraph(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        perror("fopen");
+        return false;
+    }
+    ReadGraph(file);
+    fclose(file);
+    return true;
+}
+
+/// The graph file as text, as sent to and from the daemon.
+static std::string GraphToText()
+{
+    char* data = nullptr;
+    size_t size = 0;
+    FILE* file = open_memstream(&data, &size);
+    if (!file)
+        return std::string();
+    WriteGraph(file);
+    fclose(file);
+    std::string text(data, size);
+    free(data);
+    return text;
+}
+
+static void GraphFromText(const std::string& text)
+{
+    // fmemopen() does not accept empty buffers
+    std::string buffer = text.empty() ? "\n" : text;
+    FILE* file = fmemopen(&buffer[0], buffer.size(), "r");
+    if (!file)
+        return;
+    ReadGraph(file);
+    fclose(file);
+}
+
+/// A run of the graph for one batch job, in its own fifo directory.
+class GraphInstance : public BatchInstance
+{
+    std::string dir;
+    std::unique_ptr<RunContext> ctx;
+
+public:
+
+    explicit GraphInstance(const std::string& dir) : dir(dir), ctx(new RunContext(dir + "/")) {}
+
+    ~GraphInstance()
+    {
+        ctx.reset();
+        rmdir(dir.c_str());
+    }
+
+    RunContext& GetContext()
+    {
+        return *ctx;
+    }
+
+    virtual void Update() override { ctx->Update(); }
+    virtual bool IsRunning() override { return ctx->IsRunning(); }
+    virtual bool HasFailed() override { return ctx->HasFailed(); }
+    virtual void Stop() override { ctx->Stop(); }
+    virtual std::string GetLog() override { return ctx->GetLog(); }
+};
+
+/// Launches the graph for a batch job. Commands see the job as $INPUT, $NAME (file name without extension), $DIR and
+/// $JOB, on top of the graph variables.
+static BatchInstance* LaunchJob(const BatchJob& job, std::string& error)
+{
+    mkdir("tmp", 0755);
+    std::string dir = "tmp/job" + std::to_string(job.index) + "." + std::to_string(job.attempt);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        error = dir + ": " + strerror(errno);
+        return nullptr;
+    }
+
+    size_t slash = job.input.find_last_of('/');
+    std::string base = slash == std::string::npos ? job.input : job.input.substr(slash + 1);
+    std::string name = base.substr(0, base.find_last_of('.'));
+
+    std::unique_ptr<GraphInstance> instance(new GraphInstance(dir));
+    RunContext& ctx = instance->GetContext();
+    ctx.SetVariable("INPUT", job.input);
+    ctx.SetVariable("NAME", name.empty() ? base : name);
+    ctx.SetVariable("DIR", slash == std::string::npos ? "." : job.input.substr(0, slash));
+    ctx.SetVariable("JOB", std::to_string(job.index));
+    if (!ctx.Run())
+    {
+        error = "cannot prepare the graph";
+        return nullptr;
+    }
+    return instance.release();
+}
+
+/// Batch started from the GUI.
+static BatchScheduler* batch = nullptr;
+static bool batch_reported = true;
+static bool show_batch = false;
+static bool show_variables = false;
+static bool show_minimap = true;
+static bool show_profiler = false;
+
+static void RenderVariables()
+{
+    if (!show_variables)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(420, 200), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Variables", &show_variables))
+    {
+        ImGui::TextWrapped("Used as $NAME in commands. Batch jobs also set INPUT, NAME, DIR and JOB.");
+        for (auto it = graph_variables.begin(); it != graph_variables.end();)
+        {
+            ImGui::PushID(it->first.c_str());
+            ImGui::SetNextItemWidth(250);
+            ImGui::InputText(it->first.c_str(), &it->second);
+            ImGui::SameLine();
+            bool remove = ImGui::SmallButton("x");
+            ImGui::PopID();
+            if (remove)
+                it = graph_variables.erase(it);
+            else
+                ++it;
+        }
+        static std::string name;
+        ImGui::SetNextItemWidth(150);
+        ImGui::InputText("##name", &name);
+        ImGui::SameLine();
+        if (ImGui::Button("add") && !name.empty())
+        {
+            graph_variables[name];
+            name.clear();
+        }
+    }
+    ImGui::End();
+}
+
+/// Frame times and counters of the GUI, and a flame chart of the zones of every thread during a frame (see
+/// profiler.hpp).
+static void RenderProfiler()
+{
+    SetProfilerShown(show_profiler);
+    int nframes = GetProfileFrameCount();
+    if (!show_profiler || nframes == 0)
+        return;
+
+    PROFILE_ZONE("RenderProfiler");
+    ImGui::SetNextWindowSize(ImVec2(640, 420), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Profiler", &show_profiler))
+    {
+        // frame times, oldest first
+        static std::vector<float> times;
+        static std::vector<float> sorted;
+        times.resize(nframes);
+        for (int i = 0; i < nframes; i++)
+        {
+            const ProfileFrame& frame = GetProfileFrame(nframes - 1 - i);
+            times[i] = (frame.end - frame.begin) / 1e6f;
+        }
+        sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        float p50 = sorted[(nframes - 1) / 2];
+        float p99 = sorted[(nframes - 1) * 99 / 100];
+        ImGui::Text("frame %.2f ms, p50 %.2f ms, p99 %.2f ms over %d frames", times.back(), p50, p99, nframes);
+        ImGui::PlotLines("##times", times.data(), nframes, 0, nullptr, 0.f, std::max(p99 * 1.5f, 1.f), ImVec2(-1, 50));
+
+        static int age = 0;
+        age = std::min(age, nframes - 1);
+        ImGui::SetNextItemWidth(200);
+        ImGui::SliderInt("frames ago", &age, 0, nframes - 1);
+        const ProfileFrame& frame = GetProfileFrame(age);
+        for (size_t i = 0; i < frame.counters.size(); i++)
+        {
+            if (i > 0)
+                ImGui::SameLine(0, 20);
+            ImGui::Text("%s: %.6g", frame.counters[i].first, frame.counters[i].second);
+        }
+
+        static std::vector<ProfileThreadZones> threads;
+        CollectProfileZones(frame.begin, frame.end, threads);
+
+        ImDrawList* draw_list = ImGui::GetWindowDrawList();
+        const float label_width = 70;
+        const float row_height = ImGui::GetTextLineHeight() + 2;
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x - label_width, 50.f);
+        double scale = width / (double) std::max<int64_t>(frame.end - frame.begin, 1);
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        float y = origin.y;
+        for (size_t t = 0; t < threads.size(); t++)
+        {
+            const ProfileThreadZones& thread = threads[t];
+            if (thread.zones.empty())
+                continue;
+            int depth = 0;
+            for (const auto& zone : thread.zones)
+                depth = std::max(depth, zone.depth + 1);
+            char label[32];
+            snprintf(label, sizeof(label), "thread %d", (int) t);
+            const char* name = thread.name ? thread.name : label;
+            draw_list->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text), name);
+
+            for (const auto& zone : thread.zones)
+            {
+                // zones of other threads may start before or end after the frame
+                int64_t begin = std::max(zone.begin, frame.begin);
+                int64_t end = std::min(zone.end, frame.end);
+                float x0 = origin.x + label_width + (float) ((begin - frame.begin) * scale);
+                float x1 = origin.x + label_width + (float) ((end - frame.begin) * scale);
+                x1 = std::max(x1, x0 + 1);
+                ImVec2 a(x0, y + zone.depth * row_height);
+                ImVec2 b(x1, a.y + row_height - 1);
+                // the names are literals, their addresses tell zones apart
+                float hue = ((uintptr_t) zone.name * 2654435761u % 360) / 360.f;
+                ImColor color = ImColor::HSV(hue, 0.5f, 0.7f);
+                draw_list->AddRectFilled(a, b, color);
+                if (b.x - a.x > 20)
+                {
+                    draw_list->PushClipRect(a, b, true);
+                    draw_list->AddText(ImVec2(a.x + 2, a.y + 1), IM_COL32_BLACK, zone.name);
+                    draw_list->PopClipRect();
+                }
+                if (ImGui::IsWindowHovered() && ImRect(a, b).Contains(mouse))
+                    ImGui::SetTooltip("%s: %.3f ms", zone.name, (zone.end - zone.begin) / 1e6);
+            }
+            y += depth * row_height + 4;
+        }
+        ImGui::Dummy(ImVec2(label_width + width, y - origin.y));
+    }
+    ImGui::End();
+}
+
+static void RenderBatch()
+{
+    static std::string inputs = "*.avi";
+    static BatchOptions options;
+
+    if (batch && !batch->Update() && !batch_reported)
+    {
+        printf("%s", batch->GetReport().c_str());
+        batch_reported = true;
+    }
+    if (!show_batch)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(460, 280), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Batch", &show_batch))
+    {
+        ImGui::InputText("inputs", &inputs);
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("glob patterns or @list files, separated by spaces");
+        ImGui::InputInt("instances (0: auto)", &options.instances);
+        ImGui::InputInt("retries", &options.retries);
+        ImGui::InputText("log directory", &options.log_dir);
+
+        if (!batch || batch->IsDone())
         {
-            ImGui::TextUnformatted("running");
-            if (ImGui::Button("stop")) {
-                block->Stop();
+            if (ImGui::Button("start"))
+            {
+                delete batch;
+                batch = new BatchScheduler(options, LaunchJob);
+                batch->Start(ExpandJobList(SplitCommand(inputs)));
+                batch_reported = false;
             }
         }
-        else
+        else if (ImGui::Button("cancel"))
         {
-            ImGui::TextUnformatted("not running");
+            batch->Cancel();
         }
-        if (ImGui::Button("console")) {
-            ImGui::OpenPopup("Console");
+
+        if (batch)
+        {
+            int finished = batch->GetSucceeded() + batch->GetFailed();
+            ImGui::ProgressBar(batch->GetTotal() ? (float) finished / batch->GetTotal() : 1.f);
+            ImGui::Text("%d running", batch->GetRunning());
+            ImGui::TextUnformatted(batch->GetReport().c_str());
         }
-        if (noutputs == 0 && ImGui::Button("run")) {
-            context->Run();
+    }
+    ImGui::End();
+}
+
+static volatile sig_atomic_t batch_interrupted = 0;
+
+/// Headless batch mode: `vpe --batch graph.vpe [-j instances] [-r retries] [-l logdir] [-D NAME=value]... inputs...`
+int vpe_batch(int argc, char** argv)
+{
+    BatchOptions options;
+    std::vector<std::string> specs;
+    std::map<std::string, std::string> defines;
+    const char* graph = nullptr;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool option = arg.size() >= 2 && arg[0] == '-' && strchr("jrlD", arg[1]);
+        if (option && (arg.size() > 2 || i + 1 < argc))
+        {
+            // both "-j 4" and "-j4"
+            std::string value = arg.size() > 2 ? arg.substr(2) : argv[++i];
+            if (arg[1] == 'j')
+                options.instances = atoi(value.c_str());
+            else if (arg[1] == 'r')
+                options.retries = atoi(value.c_str());
+            else if (arg[1] == 'l')
+                options.log_dir = value;
+            else if (value.find('=') != std::string::npos)
+                defines[value.substr(0, value.find('='))] = value.substr(value.find('=') + 1);
         }
-        if (ImGui::BeginPopup("Console")) {
-            if (block)
-                ImGui::TextUnformatted(block->GetOutput().c_str());
-            if (ImGui::IsAnyMouseDown() && !ImGui::IsWindowHovered())
-                ImGui::CloseCurrentPopup();
-            ImGui::EndPopup();
+        else if (!graph)
+        {
+            graph = argv[i];
         }
-        ImGui::EndGroup();
-
-        ImGui::SetCursorScreenPos({ImGui::GetItemRectMax().x + style.ItemSpacing.x, ImGui::GetItemRectMin().y});
-        ImGui::BeginGroup();
+        else
         {
-            for (int i = 0; i < noutputs; i++) {
-                RenderSlot(PipeOutputSlotNames[i], ImNodes::OutputSlotKind(NodeSlotPipe));
-            }
+            specs.push_back(arg);
         }
-        ImGui::EndGroup();
+    }
+    if (!graph || specs.empty())
+    {
+        fprintf(stderr, "usage: vpe --batch graph.vpe [-j instances] [-r retries] [-l logdir] [-D NAME=value]... "
+                        "inputs|@list...\n");
+        return 2;
     }
 
-    virtual void RenderTitle() override
+    if (!LoadGraph(graph))
+        return 1;
+    for (const auto& d : defines)
+        graph_variables[d.first] = d.second;
+    std::vector<std::string> inputs = ExpandJobList(specs);
+    if (inputs.empty())
     {
-        ImGui::SetNextItemWidth(150);
+        fprintf(stderr, "no inputs\n");
+        return 1;
+    }
 
-        float title_size = ImGui::CalcItemWidth();
-        ImGui::SetCursorPosX(ImGui::GetCursorPosX() + node_width / 2.f - title_size / 2.f);
+    signal(SIGINT, [](int) { batch_interrupted = 1; });
+    BatchScheduler scheduler(options, LaunchJob);
+    scheduler.Start(inputs);
+    bool cancelled = false;
+    while (scheduler.Update())
+    {
+        if (batch_interrupted && !cancelled)
+        {
+            cancelled = true;
+            scheduler.Cancel();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    printf("%s", scheduler.GetReport().c_str());
+    return scheduler.GetFailed() ? 1 : 0;
+}
 
-        if (ImGui::InputText("##command", &command, ImGuiInputTextFlags_EnterReturnsTrue)) {
-            SetCommand(command);
+/// Connections of the graph in the order of the graph file, which indexes the metrics of the daemon.
+static std::vector<const Connection*> ListConnections()
+{
+    std::vector<const Connection*> list;
+    for (auto n : nodes)
+    {
+        for (const auto& c : n->connections)
+        {
+            if (c.output_node == n)
+                list.push_back(&c);
         }
     }
+    return list;
+}
 
-    void SetCommand(const std::string& str)
+/// The graph file without the positions of the nodes, which do not change what runs.
+static std::string StripPositions(const std::string& graph)
+{
+    std::string result;
+    size_t start = 0;
+    while (start < graph.size())
     {
-        command = str;
-        ninputs = 0;
-        while (command.find(PipeInputSlotNames[ninputs]) != std::string::npos) {
-            ninputs++;
+        size_t end = graph.find('\n', start);
+        end = end == std::string::npos ? graph.size() : end + 1;
+        size_t digits = graph.find_first_not_of("0123456789", start);
+        if (digits == start || digits >= end || graph[digits] != '/')
+            result.append(graph, start, end - start);
+        start = end;
+    }
+    return result;
+}
+
+/// Contexts whose run is stopping, deleted once it stopped so that neither the GUI nor the daemon wait for it.
+static std::vector<std::unique_ptr<RunContext>> retired_contexts;
+
+/// Stops the run of `ctx` and deletes it later, from ReapContexts().
+static void RetireContext(RunContext* ctx)
+{
+    ctx->Retire();
+    retired_contexts.emplace_back(ctx);
+}
+
+/// Called every frame and at every poll of the daemon.
+static void ReapContexts()
+{
+    for (size_t i = retired_contexts.size(); i-- > 0;)
+    {
+        retired_contexts[i]->Update();
+        if (retired_contexts[i]->IsStopped())
+            retired_contexts.erase(retired_contexts.begin() + i);
+    }
+}
+
+/// Body of a Status message for the run of `ctx`.
+static std::string MakeStatus(RunContext& ctx, bool failed)
+{
+    using daemon_protocol::NodeStatus;
+    uint32_t header[2] = {0, (uint32_t) nodes.size()};
+    if (ctx.IsRunning())
+        header[0] |= daemon_protocol::GraphRunning;
+    if (failed || ctx.HasFailed())
+        header[0] |= daemon_protocol::GraphFailed;
+    std::string body((const char*) header, sizeof(header));
+    for (auto node : nodes)
+    {
+        Block* block = ctx.GetNodeBlock(node);
+        NodeStatus status = {NodeStatus::Idle, 0, 0};
+        if (block && block->IsRunning())
+            status.state = NodeStatus::Running;
+        else if (ctx.IsServedFromCache(node))
+            status.state = NodeStatus::FromCache;
+        else if (block && !block->GetLimitBreach().empty())
+            status.state = NodeStatus::LimitHit;
+        status.crashes = (uint16_t) std::min<size_t>(ctx.GetCrashCount(node), 0xffff);
+        body.append((const char*) &status, sizeof(status));
+    }
+    return body;
+}
+
+/// Body of a Metrics message for the run of `ctx`.
+static std::string MakeMetrics(const RunContext& ctx)
+{
+    auto connections = ListConnections();
+    uint32_t count = connections.size();
+    std::string body((const char*) &count, sizeof(count));
+    for (auto c : connections)
+    {
+        daemon_protocol::EdgeMetrics metrics = {0, 0, 0, 0};
+        if (const LatencyProbe* probe = ctx.GetProbe(c->input_node, c->input_slot, c->output_node, c->output_slot))
+        {
+            metrics.frames = (uint32_t) probe->histogram.GetCount();
+            metrics.p50_ms = probe->histogram.GetPercentile(50) / 1000.f;
+            metrics.p99_ms = probe->histogram.GetPercentile(99) / 1000.f;
+            metrics.max_ms = probe->histogram.GetMax() / 1000.f;
         }
-        noutputs = 0;
-        while (command.find(PipeOutputSlotNames[noutputs]) != std::string::npos) {
-            noutputs++;
+        body.append((const char*) &metrics, sizeof(metrics));
+    }
+    return body;
+}
+
+static volatile sig_atomic_t daemon_interrupted = 0;
+
+/// Daemon mode: `vpe --daemon [--latency] [-s socket] [graph.vpe]`, runs the graph given on the command line or pushed
+/// by the attached GUIs until interrupted. `--latency` measures the latency of the connections, sent as their metrics.
+int vpe_daemon(int argc, char** argv)
+{
+    using namespace daemon_protocol;
+    bool measure_latency = false;
+    std::string path = GetSocketPath();
+    const char* graph_file = nullptr;
+    for (int i = 0; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--latency"))
+            measure_latency = true;
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            path = argv[++i];
+        else if (!graph_file)
+            graph_file = argv[i];
+        else
+        {
+            fprintf(stderr, "usage: vpe --daemon [--latency] [-s socket] [graph.vpe]\n");
+            return 2;
         }
     }
 
-    virtual bool Prepare(RunContext& ctx) override
+    Server server;
+    std::string error;
+    if (!server.Listen(path, error))
     {
-        std::string command = this->command;
-        for (int i = 0; i < ninputs; i++) {
-            Connection* con = nullptr;
-            for (auto& c : connections)
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    printf("listening on %s\n", path.c_str());
+    mkdir("tmp", 0755);
+
+    context = new RunContext();
+    context->SetMeasureLatency(measure_latency);
+    std::string graph;
+    bool failed = false;
+    if (graph_file)
+    {
+        if (!LoadGraph(graph_file))
+            return 1;
+        graph = GraphToText();
+        failed = !context->Run();
+    }
+
+    signal(SIGINT, [](int) { daemon_interrupted = 1; });
+    signal(SIGTERM, [](int) { daemon_interrupted = 1; });
+    auto last_update = std::chrono::steady_clock::now();
+    while (!daemon_interrupted)
+    {
+        for (size_t i : server.Poll(20))
+        {
+            Peer& peer = *server.clients[i].peer;
+            peer.Send(Graph, graph);
+            peer.Send(Status, MakeStatus(*context, failed));
+        }
+
+        // messages are handled once read from every client, as handling them may drop clients
+        std::vector<std::tuple<const Peer*, uint32_t, std::string>> messages;
+        for (auto& client : server.clients)
+        {
+            uint32_t type;
+            std::string body;
+            while (client.peer->Next(type, body))
             {
-                if (c.input_node != this || c.input_slot != PipeInputSlotNames[i])
-                    continue;
-                con = &c;
-            }
-            if (!con) {
-                printf("input slot %d not connected?\n", i);
-                return false;
-            }
-            const std::string& name = con->GetFifoName(ctx);
-            if (name.empty()) {
-                printf("slot %d not prepared\n", i);
-                return false;
+                if (type == Subscribe && body.size() >= sizeof(uint32_t))
+                    memcpy(&client.streams, body.data(), sizeof(uint32_t));
+                else
+                    messages.emplace_back(client.peer.get(), type, std::move(body));
             }
-            command = std::regex_replace(command, std::regex(PipeInputSlotNames[i]), name);
         }
-        // TODO: duplicate output if multiple inputs use it
-        for (int i = 0; i < noutputs; i++) {
-            std::vector<Connection*> outputs;
-            for (auto& c : connections)
+        for (const auto& m : messages)
+        {
+            uint32_t type = std::get<1>(m);
+            const std::string& body = std::get<2>(m);
+            if (type == Graph)
             {
-                if (c.output_node != this || c.output_slot != PipeOutputSlotNames[i])
-                    continue;
-                outputs.push_back(&c);
-            }
-            if (outputs.empty()) {
-                printf("output slot %d not connected?\n", i);
-                return false;
+                // moving nodes around does not restart the graph
+                if (StripPositions(body) != StripPositions(graph))
+                {
+                    printf("graph updated\n");
+                    RetireContext(context);
+                    context = new RunContext();
+                    context->SetMeasureLatency(measure_latency);
+                    GraphFromText(body);
+                    failed = false;
+                }
+                graph = body;
+                server.Broadcast(Graph, graph, 0, std::get<0>(m));
             }
-            std::string fifoname;
-            if (outputs.size() == 1)
+            else if (type == Run)
             {
-                fifoname = outputs[0]->GetFifoName(ctx);
+                failed = !context->Run();
             }
-            else
+            else if (type == Stop)
             {
-                // multiple outputs, so we need to duplicate the stream
-                // XXX: this is vpp specific
-                auto fifo = ctx.MakeFifo();
-                fifoname = fifo;
-                for (unsigned i = 0; i < outputs.size() - 1; i++)
-                {
-                    std::string from = fifo;
-                    std::string to;
-                    if (i == outputs.size() - 2)
-                    {
-                        to = outputs[i+1]->GetFifoName(ctx);
-                    }
-                    else
-                    {
-                        fifo = ctx.MakeFifo();
-                        to = fifo;
-                    }
-                    std::string to2 = outputs[i]->GetFifoName(ctx);
-                    ctx.CollectBlock(new CommandBlock("vp dup " + from + " " + to + " " + to2));
-                }
-            }
-            if (fifoname.empty()) {
-                printf("slot %d not prepared\n", i);
-                return false;
+                context->Stop();
             }
-            command = std::regex_replace(command, std::regex(PipeOutputSlotNames[i]), fifoname);
         }
 
-        block = new CommandBlock(command);
-        ctx.CollectBlock(block);
-        return true;
+        context->Update();
+        ReapContexts();
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_update >= std::chrono::milliseconds(100))
+        {
+            last_update = now;
+            server.Broadcast(Status, MakeStatus(*context, failed), StatusStream);
+            server.Broadcast(Metrics, MakeMetrics(*context), MetricsStream);
+        }
     }
-};
 
-void RunContext::Run()
+    delete context;
+    context = nullptr;
+    retired_contexts.clear();
+    return 0;
+}
+
+static void DetachDaemon()
 {
-    pipeline.Clear();
+    daemon_peer.reset();
+    remote_nodes.clear();
+    remote_edges.clear();
+}
 
-    for (auto node : nodes)
+static void PushGraph()
+{
+    if (daemon_peer && !daemon_peer->Send(daemon_protocol::Graph, GraphToText()))
+        DetachDaemon();
+}
+
+/// Attaches to the daemon, whose graph replaces the current one, or which receives the current one if it has none.
+static void AttachDaemon()
+{
+    std::string error;
+    daemon_peer.reset(daemon_protocol::Connect(daemon_protocol::GetSocketPath(), error));
+    if (!daemon_peer)
     {
-        for (auto& c : node->connections)
-        {
-            if (c.output_node != node)
-                continue;
-            if (!c.Prepare(*this))
-            {
-                return;
-            }
-        }
+        printf("cannot attach: %s\n", error.c_str());
+        return;
     }
+    // the graph runs in the daemon now
+    RetireContext(context);
+    context = new RunContext();
+    uint32_t streams = daemon_protocol::StatusStream | daemon_protocol::MetricsStream;
+    daemon_peer->Send(daemon_protocol::Subscribe, &streams, sizeof(streams));
+}
 
-    for (auto node : nodes)
+static void RunGraph()
+{
+    if (!daemon_peer)
     {
-        if (!node->Prepare(*this))
+        context->Run();
+        return;
+    }
+    PushGraph();
+    if (daemon_peer && !daemon_peer->Send(daemon_protocol::Run, nullptr, 0))
+        DetachDaemon();
+}
+
+/// Called every frame: handles the messages of the daemon.
+static void UpdateDaemon()
+{
+    using namespace daemon_protocol;
+    if (!daemon_peer)
+        return;
+    if (!daemon_peer->Receive() || !daemon_peer->Flush())
+    {
+        printf("daemon connection lost\n");
+        DetachDaemon();
+        return;
+    }
+    uint32_t type;
+    std::string body;
+    while (daemon_peer && daemon_peer->Next(type, body))
+    {
+        if (type == Graph)
         {
-            return;
+            remote_nodes.clear();
+            remote_edges.clear();
+            if (body.empty())
+                PushGraph();
+            else
+                GraphFromText(body);
+        }
+        else if (type == Status && body.size() >= 2 * sizeof(uint32_t))
+        {
+            uint32_t count;
+            memcpy(&count, body.data() + sizeof(uint32_t), sizeof(count));
+            // a status of another version of the graph is ignored until the graph arrives
+            if (count != nodes.size() || body.size() < 2 * sizeof(uint32_t) + count * sizeof(NodeStatus))
+                continue;
+            for (uint32_t i = 0; i < count; i++)
+                memcpy(&remote_nodes[nodes[i]], body.data() + 2 * sizeof(uint32_t) + i * sizeof(NodeStatus),
+                       sizeof(NodeStatus));
+        }
+        else if (type == Metrics && body.size() >= sizeof(uint32_t))
+        {
+            uint32_t count;
+            memcpy(&count, body.data(), sizeof(count));
+            auto connections = ListConnections();
+            if (count != connections.size() || body.size() < sizeof(uint32_t) + count * sizeof(EdgeMetrics))
+                continue;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const Connection* c = connections[i];
+                auto key = std::make_tuple((const void*) c->input_node, c->input_slot, (const void*) c->output_node,
+                                           c->output_slot);
+                memcpy(&remote_edges[key], body.data() + sizeof(uint32_t) + i * sizeof(EdgeMetrics),
+                       sizeof(EdgeMetrics));
+            }
         }
     }
-
-    pipeline.Launch();
 }
 
-std::map<std::string, BaseNode*(*)()> available_nodes{
-    {"vpp operator", []() -> BaseNode* {
-                                           auto x = new VPPOperator();
-                                           x->SetCommand("ls <1 >1 >2");
-                                           return x;
-                                       }},
-    {"Video Input", []() -> BaseNode* {
-                                           auto x = new VPPOperator();
-                                           x->SetCommand("vid2vpp file.avi >1");
-                                           return x;
-                                      }},
-    {"Video Output", []() -> BaseNode* {
-                                           auto x = new VPPOperator();
-                                           x->SetCommand("vpp2vid <1 file.avi");
-                                           return x;
-                                      }},
-
-};
+/// Milliseconds the GUI may sleep waiting for an event or a wakeup (see wakeup.hpp), -1 for no limit. A run is left to
+/// the wakeups of its blocks, except while it has a deadline; the batch, the daemon connection and the retired runs
+/// are polled a few times per second while there is one. Metrics whose wakeup was throttled are shown when the
+/// throttle ends.
+int vpe_idle_timeout()
+{
+    int timeout = GetMetricsWakeupDelay();
+    if (daemon_peer || (batch && (!batch->IsDone() || !batch_reported)) || (context && context->HasDeadline())
+        || !retired_contexts.empty())
+        timeout = timeout < 0 ? 100 : std::min(timeout, 100);
+    return timeout;
+}
 
 void vpe_show()
 {
@@ -565,6 +3080,7 @@ void vpe_show()
     if (ImGui::Begin("ImNodes", nullptr, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse
                      | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize))
     {
+        PROFILE_ZONE("canvas");
         // We probably need to keep some state, like positions of nodes/slots for rendering connections.
         ImNodes::BeginCanvas(gCanvas);
         for (auto it = nodes.begin(); it != nodes.end();)
@@ -600,7 +3116,7 @@ void vpe_show()
             read->pos = ImVec2(50, 320);
             nodes.push_back(read);
             auto skip = new VPPOperator();
-            skip->SetCommand("vp map <1 >1 \"(x/255)^2*255\"");
+            skip->SetCommand("builtin map <1 >1 \"(x/255)^2*255\"");
             skip->pos = ImVec2(250, 320);
             nodes.push_back(skip);
             auto write = new VPPOperator();
@@ -640,6 +3156,38 @@ void vpe_show()
             ImGui::Separator();
             if (ImGui::MenuItem("Reset Zoom"))
                 gCanvas->zoom = 1;
+            bool measure = context->IsMeasuringLatency();
+            if (ImGui::MenuItem("Measure latency", nullptr, &measure))
+                context->SetMeasureLatency(measure);
+            bool place = context->IsAutoPlacing();
+            if (ImGui::MenuItem("Place on cores", nullptr, &place))
+                context->SetAutoPlace(place);
+            bool supervise = context->IsSupervising();
+            if (ImGui::MenuItem("Restart crashed nodes", nullptr, &supervise))
+                context->SetSupervise(supervise);
+            if (ImGui::BeginMenu("Cache"))
+            {
+                ResultCache& cache = context->GetCache();
+                ImGui::Text("%d hits, %d misses", cache.GetHits(), cache.GetMisses());
+                ImGui::Text("%.1f MB served", cache.GetBytesServed() / 1e6);
+                ImGui::Text("%.1f / %.1f MB on disk", cache.GetSize() / 1e6, cache.GetMaxSize() / 1e6);
+                if (ImGui::MenuItem("Clear"))
+                    cache.Clear();
+                ImGui::EndMenu();
+            }
+            ImGui::MenuItem("Variables", nullptr, &show_variables);
+            ImGui::MenuItem("Batch", nullptr, &show_batch);
+            ImGui::MenuItem("Minimap", nullptr, &show_minimap);
+            ImGui::MenuItem("Profiler", nullptr, &show_profiler);
+            ImGui::Separator();
+            if (!daemon_peer && ImGui::MenuItem("Attach to daemon"))
+                AttachDaemon();
+            if (daemon_peer && ImGui::MenuItem("Push graph"))
+                PushGraph();
+            if (daemon_peer && ImGui::MenuItem("Stop graph"))
+                daemon_peer->Send(daemon_protocol::Stop, nullptr, 0);
+            if (daemon_peer && ImGui::MenuItem("Detach"))
+                DetachDaemon();
 
             if (ImGui::IsAnyMouseDown() && !ImGui::IsWindowHovered())
                 ImGui::CloseCurrentPopup();
@@ -647,109 +3195,34 @@ void vpe_show()
         }
 
         if (!io.WantCaptureKeyboard && ImGui::IsKeyPressed(SDL_SCANCODE_P)) {
-            context->Run();
+            RunGraph();
         }
         if (!io.WantCaptureKeyboard && ImGui::IsKeyPressed(SDL_SCANCODE_S)) {
-            FILE* file = fopen("graph.vpe", "w");
-            if (!file)
-            {
-                perror("fopen");
-            }
-            auto getnodid = [&](void* nod){
-                int i = 0;
-                for (auto n : nodes)
-                {
-                    if (nod == n)
-                        return i;
-                    i++;
-                }
-                return -1;
-            };
-            for (int pass = 0; pass < 3; pass++)
-            for (auto n : nodes)
-            {
-                int id = getnodid(n);
-                if (pass == 0)
-                    fprintf(file, "%d %s\n", id, ((VPPOperator*) n)->command.c_str());
-                if (pass == 2)
-                    fprintf(file, "%d/%d,%d\n", id, (int) n->pos.x, (int) n->pos.y);
-                for (auto& c : n->connections)
-                {
-                    if (c.output_node != n)
-                        continue;
-                    if (pass == 1)
-                        fprintf(file, "%d:%s %d:%s\n", id, c.output_slot, getnodid(c.input_node), c.input_slot);
-                }
-            }
-            fclose(file);
+            SaveGraph("graph.vpe");
         }
         if (!io.WantCaptureKeyboard && ImGui::IsKeyPressed(SDL_SCANCODE_L)) {
-            for (auto n : nodes)
-                delete n;
-            nodes.clear();
-            FILE* file = fopen("graph.vpe", "r");
-            if (!file)
-            {
-                perror("fopen");
-            }
-
-            // TODO: fix buffers and array (node id) overflows
-            std::map<int, BaseNode*> id2node;
-            char line[1024];
-            while (fgets(line, sizeof(line), file))
-            {
-                if (line[0] == '#')
-                    continue;
-
-                line[sizeof(line)-1] = 0;
-                line[strlen(line)-1] = 0;
-
-                int id;
-                char op;
-                if (sscanf(line, "%d%c", &id, &op) != 2)
-                    continue;
-
-                if (op == ' ')
-                {
-                    auto node = new VPPOperator();
-                    node->SetCommand(line + 2);
-                    nodes.push_back(node);
-                    id2node[id] = node;
-                }
-                else if (op == ':')
-                {
-                    char inputslot[64];
-                    char outputslot[64];
-                    int toid;
-                    if (sscanf(line + 2, "%s %d:%s", outputslot, &toid, inputslot) == 3)
-                    {
-                        Connection c;
-                        c.output_node = id2node[id];
-                        for (unsigned i = 0; i < sizeof(PipeOutputSlotNames)/sizeof(PipeOutputSlotNames[0]); i++)
-                            if (!strcmp(outputslot, PipeOutputSlotNames[i]))
-                                c.output_slot = PipeOutputSlotNames[i];
-                        c.input_node = id2node[toid];
-                        for (unsigned i = 0; i < sizeof(PipeInputSlotNames)/sizeof(PipeInputSlotNames[0]); i++)
-                            if (!strcmp(inputslot, PipeInputSlotNames[i]))
-                                c.input_slot = PipeInputSlotNames[i];
-                        ((BaseNode*) c.output_node)->connections.push_back(c);
-                        ((BaseNode*) c.input_node)->connections.push_back(c);
-                    }
-                }
-                else if (op == '/')
-                {
-                    auto node = id2node[id];
-                    int x, y;
-                    if (sscanf(line+2, "%d,%d", &x, &y) == 2)
-                        node->pos = ImVec2(x, y);
-                }
-                printf("%s\n", line);
-            }
-            fclose(file);
+            LoadGraph("graph.vpe");
         }
 
+        if (show_minimap)
+            ImNodes::Minimap();
         ImNodes::EndCanvas();
     }
     ImGui::End();
+
+    UpdateDaemon();
+    {
+        PROFILE_ZONE("RunContext::Update");
+        context->Update();
+        ReapContexts();
+    }
+    context->RenderLatency();
+    {
+        PROFILE_ZONE("RenderPreviews");
+        context->RenderPreviews();
+    }
+    RenderVariables();
+    RenderBatch();
+    RenderProfiler();
 }
 
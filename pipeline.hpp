@@ -1,8 +1,28 @@
 #pragma once
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <process.hpp>
+#include "cgroup.hpp"
+#include "wakeup.hpp"
 using namespace TinyProcessLib;
 
 class Block
@@ -15,19 +35,116 @@ public:
     }
 
     virtual void Launch() = 0;
+    /// Asks the block to end: sources stop producing, the other blocks end without finishing their input.
     virtual void Stop() = 0;
+
+    /// Ends a block that did not react to Stop().
+    virtual void Kill()
+    {
+        Stop();
+    }
+
     virtual bool IsRunning() = 0;
+    virtual std::string GetOutput() const = 0;
+
+    /// Whether the block ended with an error, once it is not running anymore.
+    virtual bool HasFailed()
+    {
+        return false;
+    }
+
+    /// Exit status of a failed block, for the crash history.
+    virtual int GetExitStatus()
+    {
+        return HasFailed() ? 1 : 0;
+    }
+
+    /// The resource limit the block ran into, e.g. "CPU time (10 s)", empty if none. Only breaches confirmed by the
+    /// kernel are reported.
+    virtual std::string GetLimitBreach()
+    {
+        return std::string();
+    }
+
+    /// For a block that failed without a confirmed breach, its exit next to the limits it ran with, as a possible
+    /// cause, e.g. "exited 1, limit: address space 512 MB". Empty otherwise.
+    virtual std::string GetLimitHint()
+    {
+        return std::string();
+    }
+
+    /// Name of the block in logs.
+    virtual std::string GetName() const
+    {
+        return std::string();
+    }
+
+    /// Process started by the last Launch(), 0 for blocks running in vpe. Read right after Launch(), before the
+    /// process can be reaped.
+    virtual int GetProcessId() const
+    {
+        return 0;
+    }
 };
 
 class CommandBlock : public Block
 {
     std::string command;
+    Config config;
     TinyProcessLib::Process* process = nullptr;
     std::string consoleOutput;
+    /// Set once the process was seen to exit, with its status and the limit it ran into, which are then computed once
+    /// rather than at every query of the GUI.
+    bool exited = false;
+    int exitStatus = 0;
+    std::string limitBreach;
+    std::string limitHint;
+
+    /// Whether the process exited, reaping it the first time.
+    bool PollExit()
+    {
+        if (exited)
+            return true;
+        int status;
+        if (!process || !process->try_get_exit_status(status))
+            return false;
+        exited = true;
+        exitStatus = status;
+        limitBreach = FindLimitBreach(status);
+        if (status && limitBreach.empty())
+            limitHint = FindLimitHint(status);
+        return true;
+    }
+
+    /// Limits whose breach the kernel reports: SIGXCPU for the CPU time, the OOM kills of the cgroup for the memory.
+    std::string FindLimitBreach(int status) const
+    {
+        if (!status)
+            return std::string();
+        // killed by a signal, its number is in the low bits
+        if (config.max_cpu_seconds && (status & 0x7f) == SIGXCPU)
+            return "CPU time (" + std::to_string(config.max_cpu_seconds) + " s)";
+        if (!config.cgroup.empty() && CgroupTree::WasOomKilled(config.cgroup))
+            return "memory";
+        return std::string();
+    }
+
+    /// The other limits only make system calls fail, which commands report in their own way, if at all.
+    std::string FindLimitHint(int status) const
+    {
+        std::string limits;
+        if (config.max_address_space)
+            limits += "address space " + std::to_string(config.max_address_space >> 20) + " MB";
+        if (config.max_open_files)
+            limits += (limits.empty() ? "" : ", ") + std::string("open files ") + std::to_string(config.max_open_files);
+        if (limits.empty())
+            return std::string();
+        return "exited " + std::to_string(status) + ", limit: " + limits;
+    }
 
 public:
 
-    CommandBlock(const std::string command) : command(command) {}
+    CommandBlock(const std::string command, const Config& config = {}) : command(command), config(config) {}
 
     virtual ~CommandBlock()
     {
@@ -41,10 +158,16 @@ public:
             Stop();
         }
         consoleOutput.clear();
+        exited = false;
+        exitStatus = 0;
+        limitBreach.clear();
+        limitHint.clear();
         auto clb = [this](const char *bytes, size_t n) {
             consoleOutput += std::string(bytes, n);
+            WakeGui();
         };
-        process = new Process(command, "", clb);
+        delete process;
+        process = new Process(command, "", clb, nullptr, false, config);
         printf("%s\n", command.c_str());
     }
 
@@ -56,36 +179,496 @@ public:
         }
     }
 
+    virtual void Kill() override
+    {
+        if (process)
+        {
+            process->signal(SIGKILL);
+        }
+    }
+
     virtual bool IsRunning() override
     {
-        int status;
-        return process && !process->try_get_exit_status(status);
+        return process && !PollExit();
     }
 
-    const std::string& GetOutput() const
+    virtual std::string GetOutput() const override
     {
         return consoleOutput;
     }
+
+    virtual bool HasFailed() override
+    {
+        return GetExitStatus() != 0;
+    }
+
+    virtual int GetExitStatus() override
+    {
+        return PollExit() ? exitStatus : 0;
+    }
+
+    virtual std::string GetLimitBreach() override
+    {
+        return PollExit() ? limitBreach : std::string();
+    }
+
+    virtual std::string GetLimitHint() override
+    {
+        return PollExit() ? limitHint : std::string();
+    }
+
+    virtual std::string GetName() const override
+    {
+        return command;
+    }
+
+    virtual int GetProcessId() const override
+    {
+        return process ? (int) process->get_id() : 0;
+    }
+};
+
+/// Restarts of crashed blocks in a supervised pipeline.
+struct RestartPolicy
+{
+    /// Delay before the first restart, doubled after each crash up to `max_delay`, in seconds.
+    double initial_delay = 0.1;
+    double max_delay = 30;
+    /// A group that crashes more than `max_restarts` times within `window` seconds is left down.
+    int max_restarts = 10;
+    double window = 600;
+    /// A group running this long without crashing starts again from `initial_delay`.
+    double stable = 60;
+};
+
+/// A block that exited with an error while its group was running.
+struct Crash
+{
+    const Block* block;
+    std::string name;
+    std::time_t time;
+    /// Exit status of a command, or the signal that killed it.
+    int status;
+    /// Resource limit that was hit, if any.
+    std::string limit;
+};
+
+/// Graceful stop of a pipeline: sources are stopped first, then each stage gets `drain_timeout` seconds to end by
+/// itself once everything upstream of it ended, then it is stopped, and killed `kill_timeout` seconds later.
+struct ShutdownPolicy
+{
+    double drain_timeout = 5;
+    double kill_timeout = 2;
+};
+
+/// How a block ended during a graceful stop.
+struct StopRecord
+{
+    enum Ending { Drained, Stopped, Killed };
+    std::string name;
+    Ending ending = Drained;
+    /// Seconds from the moment the block was expected to end to its exit.
+    double latency = 0;
+};
+
+/// Wakes the GUI when watched processes exit, from a single thread polling their pidfds. A pidfd refers to the
+/// process it was opened for even once it is reaped, so a reused pid is never mistaken for it.
+class ExitWatcher
+{
+    std::thread thread;
+    std::mutex mutex;
+    /// Signalled when pidfds are added or the thread must quit.
+    int event = -1;
+    std::vector<int> added;
+    bool quit = false;
+
+    void Run()
+    {
+        std::vector<pollfd> fds(1);
+        fds[0].fd = event;
+        fds[0].events = POLLIN;
+        for (;;)
+        {
+            if (poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            for (size_t i = 1; i < fds.size();)
+            {
+                if (fds[i].revents)
+                {
+                    close(fds[i].fd);
+                    fds[i] = fds.back();
+                    fds.pop_back();
+                    WakeGui();
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            if (fds[0].revents)
+            {
+                uint64_t count;
+                if (read(event, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    break;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (quit)
+                    break;
+                for (int fd : added)
+                    fds.push_back(pollfd{fd, POLLIN, 0});
+                added.clear();
+            }
+        }
+        for (size_t i = 1; i < fds.size(); i++)
+            close(fds[i].fd);
+    }
+
+    void Signal()
+    {
+        uint64_t one = 1;
+        if (write(event, &one, sizeof(one)) < 0)
+            perror("ExitWatcher");
+    }
+
+public:
+
+    ExitWatcher() = default;
+    ExitWatcher(const ExitWatcher&) = delete;
+    ExitWatcher& operator=(const ExitWatcher&) = delete;
+
+    ~ExitWatcher()
+    {
+        if (thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            Signal();
+            thread.join();
+        }
+        for (int fd : added)
+            close(fd);
+        if (event >= 0)
+            close(event);
+    }
+
+    /// Watches `pid`, a child that was not reaped yet. Returns false when it cannot be watched, e.g. on kernels
+    /// without pidfds (before Linux 5.3).
+    bool Watch(int pid)
+    {
+#ifdef SYS_pidfd_open
+        int fd = (int) syscall(SYS_pidfd_open, pid, 0);
+        if (fd < 0)
+            return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (event < 0)
+        {
+            event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (event < 0)
+            {
+                close(fd);
+                return false;
+            }
+            thread = std::thread([this] { Run(); });
+        }
+        added.push_back(fd);
+        Signal();
+        return true;
+#else
+        (void) pid;
+        return false;
+#endif
+    }
 };
 
 class Pipeline
 {
+    typedef std::chrono::steady_clock Clock;
+
+    /// Blocks of a group depend on each other's streams, so they are restarted together.
+    struct Group
+    {
+        enum State { Running, Stopping, Waiting, GaveUp, Stopped };
+        State state = Running;
+        double delay = 0;
+        Clock::time_point launched;
+        Clock::time_point restart;
+        std::deque<Clock::time_point> restarts;
+    };
+
 std::vector<Block*> blocks;
+std::vector<int> block_groups;
+std::map<int, Group> groups;
+bool supervised = false;
+RestartPolicy policy;
+std::function<void(int group)> restart_hook;
+std::vector<Crash> crashes;
+
+    /// State of a block during a graceful stop.
+    struct BlockShutdown
+    {
+        bool started = false;
+        bool done = false;
+        Clock::time_point start;
+        Clock::time_point stopped;
+        Clock::time_point killed;
+        StopRecord record;
+    };
+
+std::vector<int> block_ranks;
+bool shutting_down = false;
+ShutdownPolicy shutdown_policy;
+std::vector<BlockShutdown> endings;
+
+/// Exits of the commands, which the GUI waits for instead of polling them. `unwatched_exits` is set while a command
+/// that could not be watched may run.
+ExitWatcher exits;
+bool unwatched_exits = false;
+
+    /// Launches a block and watches the exit of its process, if any.
+    void LaunchBlock(Block* block)
+    {
+        block->Launch();
+        int pid = block->GetProcessId();
+        if (pid > 0 && HasWakeupHandler() && !exits.Watch(pid))
+            unwatched_exits = true;
+    }
+
+    static double Seconds(Clock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    bool IsGroupRunning(int group)
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            if (block_groups[i] == group && blocks[i]->IsRunning())
+                return true;
+        }
+        return false;
+    }
+
+    void UpdateGroup(int id, Group& group)
+    {
+        const auto now = Clock::now();
+        switch (group.state)
+        {
+        case Group::Running:
+        {
+            bool failed = false;
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                Block* b = blocks[i];
+                if (block_groups[i] != id || b->IsRunning() || !b->HasFailed())
+                    continue;
+                crashes.push_back(Crash{b, b->GetName(), std::time(nullptr), b->GetExitStatus(), b->GetLimitBreach()});
+                printf("supervisor: '%s' crashed (status %d)\n", b->GetName().c_str(), b->GetExitStatus());
+                failed = true;
+            }
+            if (!failed)
+                break;
+            // the streams of the group are broken, its other blocks cannot go on
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                if (block_groups[i] == id)
+                    blocks[i]->Stop();
+            }
+            group.state = Group::Stopping;
+            if (Seconds(now - group.launched) >= policy.stable)
+                group.delay = 0;
+            break;
+        }
+
+        case Group::Stopping:
+        {
+            if (IsGroupRunning(id))
+                break;
+            while (!group.restarts.empty() && Seconds(now - group.restarts.front()) > policy.window)
+                group.restarts.pop_front();
+            if ((int) group.restarts.size() >= policy.max_restarts)
+            {
+                printf("supervisor: %d restarts in %.0f s, giving up\n", (int) group.restarts.size(), policy.window);
+                group.state = Group::GaveUp;
+                break;
+            }
+            group.delay = group.delay == 0 ? policy.initial_delay : std::min(group.delay * 2, policy.max_delay);
+            group.restart = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(group.delay));
+            group.state = Group::Waiting;
+            break;
+        }
+
+        case Group::Waiting:
+        {
+            if (now < group.restart)
+                break;
+            printf("supervisor: restarting after %.1f s\n", group.delay);
+            if (restart_hook)
+                restart_hook(id);
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                if (block_groups[i] == id)
+                    LaunchBlock(blocks[i]);
+            }
+            group.restarts.push_back(now);
+            group.launched = now;
+            group.state = Group::Running;
+            break;
+        }
+
+        case Group::GaveUp:
+        case Group::Stopped:
+            break;
+        }
+    }
+
+    void UpdateShutdown()
+    {
+        const auto now = Clock::now();
+        bool done = true;
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            Block* b = blocks[i];
+            BlockShutdown& e = endings[i];
+            if (e.done)
+                continue;
+            if (!e.started && IsUpstreamDone(block_ranks[i]))
+            {
+                e.started = true;
+                e.start = now;
+                if (block_ranks[i] == 0 && b->IsRunning())
+                {
+                    // a source ends only when asked
+                    b->Stop();
+                    e.stopped = now;
+                    e.record.ending = StopRecord::Stopped;
+                }
+            }
+            if (!b->IsRunning())
+            {
+                e.done = true;
+                e.record.latency = e.started ? Seconds(now - e.start) : 0;
+                continue;
+            }
+            done = false;
+            if (!e.started)
+                continue;
+            if (e.record.ending == StopRecord::Drained && Seconds(now - e.start) > shutdown_policy.drain_timeout)
+            {
+                b->Stop();
+                e.stopped = now;
+                e.record.ending = StopRecord::Stopped;
+            }
+            else if (e.record.ending == StopRecord::Stopped && Seconds(now - e.stopped) > shutdown_policy.kill_timeout)
+            {
+                printf("'%s' did not stop, killing it\n", b->GetName().c_str());
+                b->Kill();
+                e.killed = now;
+                e.record.ending = StopRecord::Killed;
+            }
+        }
+        if (done)
+        {
+            shutting_down = false;
+            printf("%s", GetStopReport().c_str());
+        }
+    }
+
+    /// Whether every block of lower rank than `rank` ended.
+    bool IsUpstreamDone(int rank) const
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            if (block_ranks[i] < rank && !endings[i].done)
+                return false;
+        }
+        return true;
+    }
 
 public:
 
     void Launch()
     {
+        shutting_down = false;
+        endings.clear();
         for (auto b : blocks)
-            b->Launch();
+            LaunchBlock(b);
+        for (auto& g : groups)
+        {
+            g.second = Group();
+            g.second.launched = Clock::now();
+        }
     }
 
+    /// Stops every block at once.
     void Stop()
     {
+        for (auto& g : groups)
+            g.second.state = Group::Stopped;
         for (auto b : blocks)
             b->Stop();
     }
 
+    /// Starts a graceful stop, carried on by Update(). See ShutdownPolicy.
+    void Shutdown(const ShutdownPolicy& policy = ShutdownPolicy())
+    {
+        for (auto& g : groups)
+            g.second.state = Group::Stopped;
+        shutdown_policy = policy;
+        shutting_down = true;
+        endings.assign(blocks.size(), BlockShutdown());
+        for (size_t i = 0; i < blocks.size(); i++)
+            endings[i].record.name = blocks[i]->GetName();
+        UpdateShutdown();
+    }
+
+    /// Runs a graceful stop to its end, then deletes the blocks. Blocks for up to the timeouts of `policy` for each
+    /// rank, only for exit: otherwise call Shutdown() and Update() until IsShuttingDown() is false.
+    void ShutdownAndDelete(const ShutdownPolicy& policy = ShutdownPolicy())
+    {
+        Shutdown(policy);
+        while (shutting_down)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            UpdateShutdown();
+        }
+        DeleteBlocks();
+    }
+
+    bool IsShuttingDown() const
+    {
+        return shutting_down;
+    }
+
+    /// Whether Update() has something to do at a given time rather than when a block ends: a timeout of the graceful
+    /// stop, or the delay before a restart. Commands whose exit cannot be watched are polled as well.
+    bool HasDeadline() const
+    {
+        if (shutting_down || unwatched_exits)
+            return true;
+        for (const auto& g : groups)
+        {
+            if (g.second.state == Group::Waiting)
+                return true;
+        }
+        return false;
+    }
+
+    /// Stops a block on request, without restarting it.
+    void Stop(Block* block)
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            if (blocks[i] == block)
+                groups[block_groups[i]].state = Group::Stopped;
+        }
+        block->Stop();
+    }
+
     bool IsRunning()
     {
         for (auto b : blocks)
@@ -93,20 +676,151 @@ public:
             if (b->IsRunning())
                 return true;
         }
+        for (const auto& g : groups)
+        {
+            if (g.second.state == Group::Stopping || g.second.state == Group::Waiting)
+                return true;
+        }
+        return false;
+    }
+
+    bool HasFailed()
+    {
+        for (auto b : blocks)
+        {
+            if (b->HasFailed())
+                return true;
+        }
         return false;
     }
 
+    /// Restarts the groups with a crashed block, see RestartPolicy. Takes effect with Update().
+    void SetSupervised(bool supervise, const RestartPolicy& restart_policy = RestartPolicy())
+    {
+        supervised = supervise;
+        policy = restart_policy;
+    }
+
+    bool IsSupervised() const
+    {
+        return supervised;
+    }
+
+    /// Called before the blocks of a group are launched again, e.g. to reset the channels between them.
+    void SetRestartHook(const std::function<void(int group)>& hook)
+    {
+        restart_hook = hook;
+    }
+
+    /// Polls the blocks and restarts crashed groups when supervised. Should be called a few times per second.
+    void Update()
+    {
+        if (shutting_down)
+            UpdateShutdown();
+        if (unwatched_exits && !IsRunning())
+            unwatched_exits = false;
+        if (!supervised)
+            return;
+        for (auto& g : groups)
+            UpdateGroup(g.first, g.second);
+    }
+
+    /// Number of crashes of `block` seen by the supervisor, without copying them like GetCrashes().
+    size_t GetCrashCount(const Block* block) const
+    {
+        return std::count_if(crashes.begin(), crashes.end(), [block](const Crash& c) { return c.block == block; });
+    }
+
+    /// Crashes of `block` seen by the supervisor, all of them when null.
+    std::vector<Crash> GetCrashes(const Block* block = nullptr) const
+    {
+        std::vector<Crash> result;
+        for (const auto& c : crashes)
+        {
+            if (!block || c.block == block)
+                result.push_back(c);
+        }
+        return result;
+    }
+
+    /// How `block` ended in the last graceful stop, null if it was not stopped that way.
+    const StopRecord* GetStopRecord(const Block* block) const
+    {
+        for (size_t i = 0; i < blocks.size() && i < endings.size(); i++)
+        {
+            if (blocks[i] == block && endings[i].done)
+                return &endings[i].record;
+        }
+        return nullptr;
+    }
+
+    /// Stop latency of every block in the last graceful stop.
+    std::string GetStopReport() const
+    {
+        static const char* endings_names[] = {"drained", "stopped", "killed"};
+        std::string report;
+        char line[512];
+        for (const auto& e : endings)
+        {
+            if (e.record.name.empty())
+                continue;
+            snprintf(line, sizeof(line), "stop: %6.2f s  %-8s %s\n", e.record.latency,
+                     endings_names[e.record.ending], e.record.name.c_str());
+            report += line;
+        }
+        return report;
+    }
+
+    /// Output of every block, prefixed by the block names.
+    std::string GetLog() const
+    {
+        std::string log;
+        for (auto b : blocks)
+        {
+            std::string name = b->GetName();
+            if (!name.empty())
+                log += "$ " + name + "\n";
+            log += b->GetOutput();
+        }
+        return log;
+    }
+
     void Clear()
     {
         //for (auto b : blocks)
             //delete b;
         blocks.clear();
+        block_groups.clear();
+        block_ranks.clear();
+        groups.clear();
+        crashes.clear();
+        endings.clear();
+        shutting_down = false;
+    }
+
+    /// Deletes the blocks, which must not be running anymore. Blocks are deleted in reverse order, so that sinks
+    /// still holding frames go before the sources owning them.
+    void DeleteBlocks()
+    {
+        for (auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+            delete *it;
+        blocks.clear();
+        block_groups.clear();
+        block_ranks.clear();
+        groups.clear();
+        crashes.clear();
+        endings.clear();
+        shutting_down = false;
     }
 
-    void Add(Block* b)
+    /// Adds a block to `group`; groups are restarted independently when supervised. `rank` orders graceful stops:
+    /// blocks of rank 0 are the sources, and a block has a higher rank than the blocks it reads from.
+    void Add(Block* b, int group = 0, int rank = 0)
     {
         blocks.push_back(b);
+        block_groups.push_back(group);
+        block_ranks.push_back(rank);
+        groups[group];
     }
 
 };
-
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+
+// CPU placement of the commands of a graph, from the topology in /sys/devices/system/cpu.
+
+/// Parses a CPU list such as "0-3,8,10-11", as in sysfs and `taskset -c`. Returns false on syntax errors.
+inline bool ParseCpuList(const std::string& text, std::vector<int>& cpus)
+{
+    cpus.clear();
+    const char* s = text.c_str();
+    while (*s)
+    {
+        char* end;
+        long first = strtol(s, &end, 10);
+        if (end == s || first < 0)
+            return false;
+        long last = first;
+        s = end;
+        if (*s == '-')
+        {
+            last = strtol(s + 1, &end, 10);
+            if (end == s + 1 || last < first)
+                return false;
+            s = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            cpus.push_back((int) cpu);
+        if (*s == ',')
+            s++;
+        else if (*s && *s != '\n')
+            return false;
+        else
+            break;
+    }
+    return true;
+}
+
+inline std::string FormatCpuList(const std::vector<int>& cpus)
+{
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+        if (!text.empty())
+            text += ",";
+        text += std::to_string(cpus[i]);
+        if (j > i)
+            text += "-" + std::to_string(cpus[j]);
+        i = j;
+    }
+    return text;
+}
+
+/// Physical cores available to vpe.
+class CpuTopology
+{
+public:
+
+    struct Core
+    {
+        int node = 0;
+        /// Id of the L3 cache, or of the package when unknown.
+        int l3 = 0;
+        int package = 0;
+        int id = 0;
+        /// Hardware threads of the core.
+        std::vector<int> cpus;
+    };
+
+    /// Sorted by NUMA node, L3 cache and core id, so that neighbouring cores share caches.
+    std::vector<Core> cores;
+
+    static CpuTopology Read()
+    {
+        CpuTopology topology;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return topology;
+
+        std::map<std::tuple<int, int, int, int>, Core> cores;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (!CPU_ISSET(cpu, &allowed))
+                continue;
+            std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+            Core core;
+            core.package = ReadInt(dir + "/topology/physical_package_id", 0);
+            core.id = ReadInt(dir + "/topology/core_id", cpu);
+            core.l3 = ReadInt(dir + "/cache/index3/id", core.package);
+            core.node = ReadNode(dir);
+            Core& c = cores[std::make_tuple(core.node, core.l3, core.package, core.id)];
+            if (c.cpus.empty())
+                c = core;
+            c.cpus.push_back(cpu);
+        }
+        for (auto& c : cores)
+            topology.cores.push_back(c.second);
+        return topology;
+    }
+
+    /// Cores of `count` stages given in pipeline order. Consecutive stages get neighbouring cores, so that they share
+    /// a L3 cache and a NUMA node where possible; stages share cores only when there are more stages than cores, and
+    /// then it is neighbouring stages that share them.
+    std::vector<std::vector<int>> Place(int count) const
+    {
+        std::vector<std::vector<int>> placement(count);
+        if (cores.empty())
+            return placement;
+        for (int i = 0; i < count; i++)
+        {
+            size_t core = count <= (int) cores.size() ? i : (size_t) i * cores.size() / count;
+            placement[i] = cores[core].cpus;
+        }
+        return placement;
+    }
+
+private:
+
+    static int ReadInt(const std::string& filename, int fallback)
+    {
+        FILE* file = fopen(filename.c_str(), "r");
+        if (!file)
+            return fallback;
+        int value;
+        if (fscanf(file, "%d", &value) != 1)
+            value = fallback;
+        fclose(file);
+        return value;
+    }
+
+    /// The cpu directory has a `nodeN` link to its NUMA node.
+    static int ReadNode(const std::string& dir)
+    {
+        int node = 0;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+            return node;
+        while (dirent* entry = readdir(d))
+        {
+            if (sscanf(entry->d_name, "node%d", &node) == 1)
+                break;
+        }
+        closedir(d);
+        return node;
+    }
+};
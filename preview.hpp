@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "imgui.h"
+#include "imgui_impl_opengl3.h"
+#if defined(IMGUI_IMPL_OPENGL_LOADER_GL3W)
+#include <GL/gl3w.h>
+#elif defined(IMGUI_IMPL_OPENGL_LOADER_GLEW)
+#include <GL/glew.h>
+#elif defined(IMGUI_IMPL_OPENGL_LOADER_GLAD)
+#include <glad/glad.h>
+#else
+#include IMGUI_IMPL_OPENGL_LOADER_CUSTOM
+#endif
+
+#include "builtin.hpp"
+
+// Previews of connections: a tap samples frames going through the connection (see SamplingTapBlock) and downsamples
+// them to RGBA images on its thread. The GUI uploads the images into textures within a per-frame budget.
+
+/// Downsamples the sampled frames to RGBA images.
+class PreviewTapBlock : public SamplingTapBlock
+{
+    std::vector<float> samples;
+
+    mutable std::mutex image_mutex;
+    std::vector<uint8_t> image;
+    int width = 0;
+    int height = 0;
+    vpp::Format format;
+    uint64_t sequence = 0;
+    float low = 0;
+    float high = 0;
+    uint64_t generation = 0;
+
+public:
+
+    /// Largest side of the preview images.
+    static const int MaxSize = 256;
+
+    /// Map the range of each image to [0, 255] instead of clamping.
+    std::atomic<bool> stretch{false};
+
+    explicit PreviewTapBlock(FrameSink* next) : SamplingTapBlock(next, 3) {}
+
+    virtual ~PreviewTapBlock()
+    {
+        Join();
+    }
+
+    /// Copies the last image into `rgba` if it is newer than `last_generation`.
+    bool GetImage(uint64_t& last_generation, std::vector<uint8_t>& rgba, int& w, int& h) const
+    {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        if (generation == last_generation)
+            return false;
+        last_generation = generation;
+        rgba = image;
+        w = width;
+        h = height;
+        return true;
+    }
+
+    /// Describes the last image.
+    void GetInfo(vpp::Format& format, uint64_t& sequence, float& low, float& high) const
+    {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        format = this->format;
+        sequence = this->sequence;
+        low = this->low;
+        high = this->high;
+    }
+
+protected:
+
+    /// Box filter to at most MaxSize x MaxSize pixels. Frames of 3 channels or more show their first three channels.
+    virtual void Sample(const Frame* frame) override
+    {
+        const vpp::Format& f = frame->format;
+        if (f.Count() == 0)
+            return;
+        int factor = std::max(1, (std::max(f.w, f.h) + MaxSize - 1) / MaxSize);
+        int w = std::max(1, f.w / factor);
+        int h = std::max(1, f.h / factor);
+        int channels = f.d >= 3 ? 3 : 1;
+        samples.assign((size_t) w * h * channels, 0.f);
+        float lo = INFINITY;
+        float hi = -INFINITY;
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                float* out = &samples[((size_t) y * w + x) * channels];
+                int n = 0;
+                for (int dy = 0; dy < factor && y * factor + dy < f.h; dy++)
+                {
+                    const float* in = frame->data + ((size_t) (y * factor + dy) * f.w + x * factor) * f.d;
+                    for (int dx = 0; dx < factor && x * factor + dx < f.w; dx++, in += f.d, n++)
+                    {
+                        for (int c = 0; c < channels; c++)
+                            out[c] += std::isfinite(in[c]) ? in[c] : 0.f;
+                    }
+                }
+                for (int c = 0; c < channels; c++)
+                {
+                    out[c] /= n;
+                    lo = std::min(lo, out[c]);
+                    hi = std::max(hi, out[c]);
+                }
+            }
+        }
+
+        bool stretched = stretch && hi > lo;
+        float offset = stretched ? lo : 0.f;
+        float scale = stretched ? 255.f / (hi - lo) : 1.f;
+        std::lock_guard<std::mutex> lock(image_mutex);
+        image.resize((size_t) w * h * 4);
+        for (size_t i = 0; i < (size_t) w * h; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float v = (samples[i * channels + (channels == 3 ? c : 0)] - offset) * scale;
+                image[i * 4 + c] = (uint8_t) std::min(std::max(v, 0.f), 255.f);
+            }
+            image[i * 4 + 3] = 255;
+        }
+        width = w;
+        height = h;
+        format = f;
+        sequence = frame->sequence;
+        low = lo;
+        high = hi;
+        generation++;
+    }
+};
+
+/// Texture showing the images of a preview tap. Must be used on the thread of the GL context.
+class PreviewTexture
+{
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    uint64_t generation = 0;
+    std::vector<uint8_t> pixels;
+
+public:
+
+    /// Bytes uploaded per GUI frame over all previews; the other textures are updated on the next frames.
+    static const size_t UploadBudget = 1 << 20;
+
+    ~PreviewTexture()
+    {
+        if (texture)
+            glDeleteTextures(1, &texture);
+    }
+
+    PreviewTexture() = default;
+    PreviewTexture(const PreviewTexture&) = delete;
+    PreviewTexture& operator=(const PreviewTexture&) = delete;
+
+    /// Uploads the last image of `tap` if it is new and fits in `budget`, which is decreased accordingly.
+    void Update(const PreviewTapBlock& tap, size_t& budget)
+    {
+        if (budget < (size_t) PreviewTapBlock::MaxSize * PreviewTapBlock::MaxSize * 4)
+            return;
+        int w, h;
+        if (!tap.GetImage(generation, pixels, w, h))
+            return;
+
+        GLint last_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+        if (!texture)
+            glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+#ifdef GL_UNPACK_ROW_LENGTH
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+        if (w != width || h != height)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            width = w;
+            height = h;
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, last_texture);
+        budget -= pixels.size();
+    }
+
+    bool IsReady() const { return texture != 0; }
+    ImTextureID GetId() const { return (ImTextureID) (intptr_t) texture; }
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Scoped zones for the profiler overlay of the GUI (see RenderProfiler() in nodes.cpp). PROFILE_ZONE("name") records
+// the time spent until the end of the enclosing scope into a ring buffer of the current thread, so that the GUI thread
+// and the threads of the pipeline can be shown side by side. A zone costs two reads of the clock and no lock, and the
+// buffers are only read when the overlay is shown. Build with VPE_NO_PROFILER to compile the zones out.
+//
+// The GUI thread also keeps a history of its frames, delimited by ProfileBeginFrame() and ProfileEndFrame(), with
+// counters set by ProfileCount() during the frame.
+
+namespace profiler_detail
+{
+
+/// Nanoseconds of the steady clock.
+inline int64_t Now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/// A zone, written by its thread while the GUI may read it. `seq` is odd while the entry is being written.
+struct Entry
+{
+    std::atomic<uint64_t> seq{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin{0};
+    std::atomic<int64_t> end{0};
+    std::atomic<int> depth{0};
+};
+
+/// Last zones of a thread; older zones are overwritten.
+struct Ring
+{
+    static const int Capacity = 4096;
+    Entry entries[Capacity];
+    /// Zones ever written.
+    std::atomic<uint64_t> count{0};
+    std::atomic<const char*> name{nullptr};
+    /// Zones open on the thread, only used by the thread itself.
+    int depth = 0;
+};
+
+/// Rings of all threads, also of the threads which ended: their rings are reused by the next threads.
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring*> unused;
+};
+
+inline Registry& GetRegistry()
+{
+    // never destroyed, threads still running at exit may end zones
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+/// Ring of the current thread, given back to the registry when the thread ends.
+struct RingHandle
+{
+    Ring* ring = nullptr;
+
+    Ring& Get()
+    {
+        if (!ring)
+        {
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            if (!registry.unused.empty())
+            {
+                ring = registry.unused.back();
+                registry.unused.pop_back();
+                ring->name = nullptr;
+                ring->depth = 0;
+            }
+            else
+            {
+                registry.rings.emplace_back(new Ring);
+                ring = registry.rings.back().get();
+            }
+        }
+        return *ring;
+    }
+
+    ~RingHandle()
+    {
+        if (!ring)
+            return;
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.unused.push_back(ring);
+    }
+};
+
+inline Ring& CurrentRing()
+{
+    static thread_local RingHandle handle;
+    return handle.Get();
+}
+
+inline void Record(Ring& ring, const char* name, int64_t begin, int64_t end, int depth)
+{
+    uint64_t index = ring.count.load(std::memory_order_relaxed);
+    Entry& entry = ring.entries[index % Ring::Capacity];
+    uint64_t seq = entry.seq.load(std::memory_order_relaxed);
+    entry.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.name.store(name, std::memory_order_relaxed);
+    entry.begin.store(begin, std::memory_order_relaxed);
+    entry.end.store(end, std::memory_order_relaxed);
+    entry.depth.store(depth, std::memory_order_relaxed);
+    entry.seq.store(seq + 2, std::memory_order_release);
+    ring.count.store(index + 1, std::memory_order_release);
+}
+
+}   // namespace profiler_detail
+
+/// Records the time from its construction to its destruction. `name` must be a string literal or otherwise outlive
+/// the profiler. Use through PROFILE_ZONE().
+class ProfileZone
+{
+    profiler_detail::Ring& ring;
+    const char* name;
+    int64_t begin;
+
+public:
+    explicit ProfileZone(const char* name)
+        : ring(profiler_detail::CurrentRing()), name(name)
+    {
+        ring.depth++;
+        begin = profiler_detail::Now();
+    }
+
+    ~ProfileZone()
+    {
+        int64_t end = profiler_detail::Now();
+        ring.depth--;
+        profiler_detail::Record(ring, name, begin, end, ring.depth);
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#ifdef VPE_NO_PROFILER
+#   define PROFILE_ZONE(name) do {} while (0)
+#else
+#   define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#endif
+/// Zones of ImNodes, which includes this header through IMNODES_USER_CONFIG (see CMakeLists.txt).
+#define IMNODES_ZONE(name) PROFILE_ZONE(name)
+
+/// Names the current thread in the overlay. `name` must outlive the thread.
+inline void ProfileThreadName(const char* name)
+{
+    profiler_detail::CurrentRing().name = name;
+}
+
+/// A zone, in nanoseconds of the steady clock.
+struct ProfileZoneRecord
+{
+    const char* name;
+    int64_t begin;
+    int64_t end;
+    /// Zones open around this one on its thread.
+    int depth;
+};
+
+struct ProfileThreadZones
+{
+    /// nullptr when the thread is not named.
+    const char* name = nullptr;
+    std::vector<ProfileZoneRecord> zones;
+};
+
+/// Collects the zones of every thread which overlap [begin, end], in nanoseconds of the steady clock. The threads are
+/// always in the same order, including threads without zones. Thread-safe, zones being written are skipped.
+inline void CollectProfileZones(int64_t begin, int64_t end, std::vector<ProfileThreadZones>& threads)
+{
+    using namespace profiler_detail;
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    threads.resize(registry.rings.size());
+    for (size_t t = 0; t < registry.rings.size(); t++)
+    {
+        const Ring& ring = *registry.rings[t];
+        ProfileThreadZones& thread = threads[t];
+        thread.name = ring.name;
+        thread.zones.clear();
+        uint64_t count = ring.count.load(std::memory_order_acquire);
+        uint64_t first = count > (uint64_t) Ring::Capacity ? count - Ring::Capacity : 0;
+        for (uint64_t i = first; i < count; i++)
+        {
+            const Entry& entry = ring.entries[i % Ring::Capacity];
+            uint64_t seq = entry.seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue;
+            ProfileZoneRecord zone;
+            zone.name = entry.name.load(std::memory_order_relaxed);
+            zone.begin = entry.begin.load(std::memory_order_relaxed);
+            zone.end = entry.end.load(std::memory_order_relaxed);
+            zone.depth = entry.depth.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.seq.load(std::memory_order_relaxed) != seq)
+                continue;
+            if (zone.end >= begin && zone.begin <= end)
+                thread.zones.push_back(zone);
+        }
+    }
+}
+
+/// A frame of the GUI thread, in nanoseconds of the steady clock.
+struct ProfileFrame
+{
+    int64_t begin = 0;
+    int64_t end = 0;
+    std::vector<std::pair<const char*, double>> counters;
+};
+
+namespace profiler_detail
+{
+
+struct Frames
+{
+    static const int Capacity = 240;
+    ProfileFrame frames[Capacity];
+    /// Frames ever ended.
+    int count = 0;
+    ProfileFrame current;
+    bool overlay = false;
+};
+
+inline Frames& GetFrames()
+{
+    static Frames frames;
+    return frames;
+}
+
+}   // namespace profiler_detail
+
+/// Frames kept for the overlay.
+static const int ProfileFrameCapacity = profiler_detail::Frames::Capacity;
+
+/// Called by the GUI thread when it starts working on a frame, after waiting for events.
+inline void ProfileBeginFrame()
+{
+    profiler_detail::Frames& frames = profiler_detail::GetFrames();
+    frames.current.begin = profiler_detail::Now();
+    frames.current.counters.clear();
+}
+
+/// Sets a counter of the current frame of the GUI thread. `name` must be a string literal.
+inline void ProfileCount(const char* name, double value)
+{
+    profiler_detail::GetFrames().current.counters.emplace_back(name, value);
+}
+
+/// Called by the GUI thread when the frame is presented.
+inline void ProfileEndFrame()
+{
+    profiler_detail::Frames& frames = profiler_detail::GetFrames();
+    frames.current.end = profiler_detail::Now();
+    // the assignment reuses the counters of the frame it overwrites
+    frames.frames[frames.count % ProfileFrameCapacity] = frames.current;
+    frames.count++;
+}
+
+/// Number of frames kept, at most ProfileFrameCapacity. GUI thread only.
+inline int GetProfileFrameCount()
+{
+    return std::min(profiler_detail::GetFrames().count, ProfileFrameCapacity);
+}
+
+/// Frame `age` frames before the last ended frame, `age` < GetProfileFrameCount(). GUI thread only.
+inline const ProfileFrame& GetProfileFrame(int age)
+{
+    profiler_detail::Frames& frames = profiler_detail::GetFrames();
+    return frames.frames[(frames.count - 1 - age) % ProfileFrameCapacity];
+}
+
+/// Set by the overlay while it is shown, so that the main loop only gathers the counters which are not free when they
+/// are looked at.
+inline void SetProfilerShown(bool shown)
+{
+    profiler_detail::GetFrames().overlay = shown;
+}
+
+inline bool IsProfilerShown()
+{
+    return profiler_detail::GetFrames().overlay;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vpp.hpp"
+
+// Recordings of edges: a vpp stream followed by an index of its frames, so that it can be replayed from any frame.
+//
+//     "VPPF" w h d, then "FRAM" + w*h*d floats per frame       (the stream, as read by any vpp tool)
+//     "VPPX", then per frame {uint64 offset, uint64 bytes, int64 time_ns}
+//     uint64 index offset, uint64 frame count, "VPPX"          (trailer, the last 20 bytes of the file)
+//
+// `offset` is the position of the samples of the frame in the file and `time_ns` the time it went through the edge,
+// relative to the first frame. Readers of the stream stop at the index, whose tag is not "FRAM".
+
+struct RecordedFrame
+{
+    uint64_t offset;
+    uint64_t bytes;
+    int64_t time_ns;
+};
+
+class RecordingWriter
+{
+    FILE* file = nullptr;
+    vpp::Format format;
+    uint64_t offset = 0;
+    std::vector<RecordedFrame> index;
+    int64_t start_ns = 0;
+    bool ok = false;
+
+public:
+
+    ~RecordingWriter()
+    {
+        Finish();
+    }
+
+    bool Open(const std::string& path, const vpp::Format& format)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        this->format = format;
+        int dims[3] = {format.w, format.h, format.d};
+        ok = fwrite("VPPF", 4, 1, file) == 1 && fwrite(dims, sizeof(dims), 1, file) == 1;
+        offset = 4 + sizeof(dims);
+        index.clear();
+        return ok;
+    }
+
+    /// Appends a frame that went through the edge at `time_ns`, on any clock.
+    bool Write(const float* data, int64_t time_ns)
+    {
+        if (index.empty())
+            start_ns = time_ns;
+        RecordedFrame entry;
+        entry.offset = offset + 4;
+        entry.bytes = format.Bytes();
+        entry.time_ns = time_ns - start_ns;
+        ok = ok && fwrite("FRAM", 4, 1, file) == 1 && fwrite(data, entry.bytes, 1, file) == 1;
+        if (ok)
+        {
+            index.push_back(entry);
+            offset += 4 + entry.bytes;
+        }
+        return ok;
+    }
+
+    size_t GetCount() const
+    {
+        return index.size();
+    }
+
+    const vpp::Format& GetFormat() const
+    {
+        return format;
+    }
+
+    /// Appends the index and closes the file. Returns false when the recording is incomplete.
+    bool Finish()
+    {
+        if (!file)
+            return false;
+        uint64_t count = index.size();
+        ok = ok && fwrite("VPPX", 4, 1, file) == 1
+             && (index.empty() || fwrite(index.data(), sizeof(RecordedFrame), index.size(), file) == index.size())
+             && fwrite(&offset, sizeof(offset), 1, file) == 1 && fwrite(&count, sizeof(count), 1, file) == 1
+             && fwrite("VPPX", 4, 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+/// A recording mapped in memory. Recordings without index, e.g. cut short by a crash, are indexed by scanning the
+/// stream, without timing.
+class RecordingFile
+{
+    const char* base = nullptr;
+    size_t size = 0;
+    vpp::Format format;
+    std::vector<RecordedFrame> index;
+
+public:
+
+    ~RecordingFile()
+    {
+        if (base)
+            munmap((void*) base, size);
+    }
+
+    bool Open(const std::string& path, std::string& error)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            error = path + ": " + strerror(errno);
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        size = st.st_size;
+        void* map = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            error = path + ": cannot map the file";
+            return false;
+        }
+        base = (const char*) map;
+
+        int dims[3];
+        if (size < 16 || memcmp(base, "VPPF", 4))
+        {
+            error = path + ": not a vpp stream";
+            return false;
+        }
+        memcpy(dims, base + 4, sizeof(dims));
+        format.w = dims[0];
+        format.h = dims[1];
+        format.d = dims[2];
+        if (!format.IsValid())
+        {
+            error = path + ": invalid frame size";
+            return false;
+        }
+        if (!ReadIndex())
+            ScanStream();
+        if (index.empty())
+        {
+            error = path + ": no frames";
+            return false;
+        }
+        return true;
+    }
+
+    const vpp::Format& GetFormat() const { return format; }
+    size_t GetCount() const { return index.size(); }
+    int64_t GetTime(size_t i) const { return index[i].time_ns; }
+
+    const float* GetFrame(size_t i) const
+    {
+        return (const float*) (base + index[i].offset);
+    }
+
+    /// Asks the kernel to read frame `i` ahead.
+    void Prefetch(size_t i) const
+    {
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t begin = (uintptr_t) (base + index[i].offset) & ~(page - 1);
+        madvise((void*) begin, (uintptr_t) (base + index[i].offset + index[i].bytes) - begin, MADV_WILLNEED);
+    }
+
+private:
+
+    bool ReadIndex()
+    {
+        uint64_t offset, count;
+        if (size < 40 || memcmp(base + size - 4, "VPPX", 4))
+            return false;
+        memcpy(&offset, base + size - 20, sizeof(offset));
+        memcpy(&count, base + size - 12, sizeof(count));
+        if (offset + 4 + count * sizeof(RecordedFrame) + 20 != size || memcmp(base + offset, "VPPX", 4))
+            return false;
+        index.resize(count);
+        memcpy(index.data(), base + offset + 4, count * sizeof(RecordedFrame));
+        for (const auto& entry : index)
+        {
+            if (entry.bytes != format.Bytes() || entry.offset + entry.bytes > offset)
+            {
+                index.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ScanStream()
+    {
+        index.clear();
+        uint64_t offset = 16;
+        while (offset + 4 + format.Bytes() <= size && !memcmp(base + offset, "FRAM", 4))
+        {
+            index.push_back(RecordedFrame{offset + 4, format.Bytes(), 0});
+            offset += 4 + format.Bytes();
+        }
+    }
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "builtin.hpp"
+#include "vpe_shm.h"
+
+// Shared-memory edges: a connection whose both ends understand vpe_shm.h goes through a ring of frame slots in a
+// memfd instead of a fifo. Built-in nodes read the slots in place; external commands receive a "shm:..." slot name and
+// inherit the descriptors of the ring.
+//
+// Writing into a ring costs one copy: built-in nodes produce pooled frames, which ShmSinkBlock copies into a slot.
+// Producing into the slots directly would tie the frames of a node to the ring of one of its outputs, while a node can
+// have several outputs, and the copy is still one less than the write() and read() of a fifo.
+
+/// A ring created by vpe for one connection. Both ends open their own handle from the spec.
+class ShmRing
+{
+    vpe_shm_ring* ring = nullptr;
+    char spec[64] = {0};
+
+public:
+
+    /// Number of frames that can be in flight on a shared-memory edge.
+    static const unsigned SlotCount = 4;
+
+    ShmRing()
+    {
+        ring = vpe_shm_create(SlotCount, spec, sizeof(spec));
+        if (!ring)
+            perror("vpe_shm_create");
+    }
+
+    ~ShmRing()
+    {
+        if (ring)
+            vpe_shm_free(ring);
+    }
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /// The slot name for the command line, empty if the ring could not be created.
+    std::string GetSpec() const
+    {
+        return ring ? spec : "";
+    }
+
+    /// Empties the ring once both ends are closed, for a restart of the stages around it.
+    void Reset()
+    {
+        if (ring)
+            vpe_shm_reset(ring);
+    }
+
+    /// Descriptors a command must inherit to open the ring.
+    std::vector<int> GetDescriptors() const
+    {
+        if (!ring)
+            return {};
+        return {ring->memfd, ring->items, ring->spaces};
+    }
+};
+
+/// Frames of one run of a ShmSourceBlock, which point into the slots of its handle on the ring. A run that ends while
+/// frames are still held downstream leaves them with it: the ring is closed at once, so that it never signals a ring
+/// reset for the next run, and it is unmapped with the frames at the last Recycle().
+class ShmReadStream : public FrameOwner
+{
+    std::mutex mutex;
+    vpe_shm_ring* ring;
+    std::unique_ptr<Frame[]> frames;
+    std::vector<bool> recycled;
+    uint64_t issued = 0;
+    uint64_t released = 0;
+    bool detached = false;
+
+public:
+
+    explicit ShmReadStream(vpe_shm_ring* ring)
+        : ring(ring), frames(new Frame[vpe_shm_slot_count(ring)]), recycled(vpe_shm_slot_count(ring), false)
+    {
+    }
+
+    virtual ~ShmReadStream()
+    {
+        vpe_shm_free(ring);
+    }
+
+    /// Wraps the slot returned by vpe_shm_read_begin() into a frame with one reference.
+    Frame* Issue(float* data, int w, int h, int d)
+    {
+        Frame* frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frame = &frames[issued % vpe_shm_slot_count(ring)];
+            frame->sequence = issued++;
+        }
+        frame->format.w = w;
+        frame->format.h = h;
+        frame->format.d = d;
+        frame->data = data;
+        frame->capacity = frame->format.Count();
+        frame->owner = this;
+        frame->credits = nullptr;
+        frame->refs = 1;
+        return frame;
+    }
+
+    virtual void Recycle(Frame* frame) override
+    {
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            const unsigned nslots = vpe_shm_slot_count(ring);
+            recycled[frame - frames.get()] = true;
+            // the ring releases slots in order
+            while (released < issued && recycled[released % nslots])
+            {
+                recycled[released % nslots] = false;
+                if (!detached)
+                    vpe_shm_read_end(ring);
+                released++;
+            }
+            done = detached && released == issued;
+        }
+        if (done)
+            delete this;
+    }
+
+    /// Called by the reading thread when it is done. Deletes the stream, now or at the last Recycle().
+    void Detach()
+    {
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            vpe_shm_shutdown(ring, 0);
+            detached = true;
+            done = released == issued;
+        }
+        if (done)
+            delete this;
+    }
+};
+
+/// Reads frames from a ring and pushes them to a built-in node without copying: frames point into the ring, and a
+/// slot is handed back to the writer once its frame is released.
+class ShmSourceBlock : public ThreadBlock
+{
+    std::string spec;
+    FrameSink* sink;
+
+public:
+
+    ShmSourceBlock(const std::string& spec, FrameSink* sink) : spec(spec), sink(sink) {}
+
+    virtual void Run() override
+    {
+        // each run has its own handle and frames, the previous run may still have frames in flight
+        vpe_shm_ring* ring = vpe_shm_open(spec.c_str());
+        if (!ring)
+        {
+            log.Log("cannot open %s: %s\n", spec.c_str(), strerror(errno));
+            sink->Close();
+            return;
+        }
+        ShmReadStream* stream = new ShmReadStream(ring);
+
+        while (!stop)
+        {
+            int w, h, d;
+            float* data = vpe_shm_read_begin(ring, &w, &h, &d, vpp::PollTimeoutMs);
+            if (!data)
+            {
+                if (errno == ETIMEDOUT)
+                    continue;
+                if (errno)
+                    log.Log("%s: %s\n", spec.c_str(), strerror(errno));
+                break;
+            }
+            sink->Push(stream->Issue(data, w, h, d));
+        }
+        sink->Close();
+        stream->Detach();
+    }
+};
+
+/// Writes frames pushed by a built-in node into a ring, copying each frame into a slot.
+class ShmSinkBlock : public QueuedSinkBlock
+{
+    std::string spec;
+
+public:
+
+    explicit ShmSinkBlock(const std::string& spec) : spec(spec) {}
+
+    virtual void Run() override
+    {
+        vpe_shm_ring* ring = vpe_shm_open(spec.c_str());
+        if (!ring)
+            log.Log("cannot open %s: %s\n", spec.c_str(), strerror(errno));
+        bool ok = ring != nullptr;
+        while (Frame* frame = Next())
+        {
+            if (ok)
+            {
+                const vpp::Format& format = frame->format;
+                float* slot;
+                do
+                    slot = vpe_shm_write_begin(ring, format.w, format.h, format.d, vpp::PollTimeoutMs);
+                while (!slot && errno == ETIMEDOUT && !stop);
+                if (slot)
+                {
+                    memcpy(slot, frame->data, format.Bytes());
+                    vpe_shm_write_end(ring);
+                }
+                else
+                {
+                    ok = false;
+                }
+            }
+            FramePool::Release(frame);
+        }
+        vpe_shm_close(ring, 1);
+    }
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// VPE_SIMD_CLONES marks a kernel made of straight loops over floats (see RunBlock() in expr.cpp and the kernels of
+// stats.cpp). On x86-64 Linux with GCC or Clang, the kernel is compiled twice, for AVX2 and for the baseline SSE, and
+// the loader picks the clone for the CPU it runs on. Elsewhere the macro is empty.
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__linux__)
+#   define VPE_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#   define VPE_SIMD_CLONES
+#endif
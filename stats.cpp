@@ -0,0 +1,141 @@
+#include "stats.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+
+/// Rows between two flushes of the float sums into the double ones, which bounds the rounding error.
+const size_t RowsPerFlush = 64;
+
+VPE_SIMD_CLONES
+void AccumulateRows(const float* __restrict x, size_t rows, int width, float* __restrict mn, float* __restrict mx,
+                    float* __restrict sum, uint32_t* __restrict nan, uint32_t* __restrict inf)
+{
+    // selects instead of branches, so that the lanes stay independent
+    for (size_t r = 0; r < rows; r++)
+    {
+        const float* row = x + r * width;
+        for (int k = 0; k < width; k++)
+        {
+            float v = row[k];
+            float a = std::fabs(v);
+            bool finite = a <= FLT_MAX;
+            float low = finite ? v : INFINITY;
+            float high = finite ? v : -INFINITY;
+            mn[k] = low < mn[k] ? low : mn[k];
+            mx[k] = high > mx[k] ? high : mx[k];
+            sum[k] += finite ? v : 0.f;
+            nan[k] += v != v ? 1u : 0u;
+            inf[k] += a == INFINITY ? 1u : 0u;
+        }
+    }
+}
+
+/// Bin of each sample of a row, ChannelStats::Bins for non-finite samples.
+VPE_SIMD_CLONES
+void ComputeBins(const float* __restrict x, int width, const float* __restrict lo, const float* __restrict scale,
+                 uint16_t* __restrict bins)
+{
+    for (int k = 0; k < width; k++)
+    {
+        float v = x[k];
+        float b = (v - lo[k]) * scale[k];
+        b = b < 0.f ? 0.f : b;
+        b = b > ChannelStats::Bins - 1 ? ChannelStats::Bins - 1 : b;
+        bins[k] = std::fabs(v) <= FLT_MAX ? (uint16_t) (int) b : (uint16_t) ChannelStats::Bins;
+    }
+}
+
+}   // namespace
+
+void ComputeFrameStats(const float* data, int w, int h, int d, FrameStats& stats)
+{
+    stats.w = w;
+    stats.h = h;
+    stats.d = d;
+    stats.channels.assign(std::max(d, 0), ChannelStats());
+    if (w <= 0 || h <= 0 || d <= 0)
+        return;
+
+    // lane k of a row accumulates channel k % d
+    const int width = d * std::max(1, 256 / d);
+    const size_t total = (size_t) w * h * d;
+    const size_t rows = total / width;
+    const int tail = (int) (total - rows * width);
+
+    std::vector<float> mn(width, INFINITY);
+    std::vector<float> mx(width, -INFINITY);
+    std::vector<float> partial(width);
+    std::vector<double> sum(width, 0.);
+    std::vector<uint32_t> nan(width, 0);
+    std::vector<uint32_t> inf(width, 0);
+    auto flush = [&] {
+        for (int k = 0; k < width; k++)
+            sum[k] += partial[k];
+        std::fill(partial.begin(), partial.end(), 0.f);
+    };
+    std::fill(partial.begin(), partial.end(), 0.f);
+    for (size_t r = 0; r < rows; r += RowsPerFlush)
+    {
+        AccumulateRows(data + r * width, std::min(RowsPerFlush, rows - r), width, mn.data(), mx.data(),
+                       partial.data(), nan.data(), inf.data());
+        flush();
+    }
+    if (tail)
+    {
+        AccumulateRows(data + rows * width, 1, tail, mn.data(), mx.data(), partial.data(), nan.data(), inf.data());
+        flush();
+    }
+
+    std::vector<double> sums(d, 0.);
+    for (int c = 0; c < d; c++)
+    {
+        stats.channels[c].min = INFINITY;
+        stats.channels[c].max = -INFINITY;
+    }
+    for (int k = 0; k < width; k++)
+    {
+        ChannelStats& s = stats.channels[k % d];
+        s.min = std::min(s.min, mn[k]);
+        s.max = std::max(s.max, mx[k]);
+        s.nan += nan[k];
+        s.inf += inf[k];
+        sums[k % d] += sum[k];
+    }
+    for (int c = 0; c < d; c++)
+    {
+        ChannelStats& s = stats.channels[c];
+        s.finite = (uint64_t) w * h - s.nan - s.inf;
+        s.mean = s.finite ? sums[c] / s.finite : 0.;
+    }
+
+    // second pass: histograms over the range of each channel
+    std::vector<float> lo(width);
+    std::vector<float> scale(width);
+    std::vector<size_t> offset(width);
+    for (int k = 0; k < width; k++)
+    {
+        const ChannelStats& s = stats.channels[k % d];
+        lo[k] = s.finite ? s.min : 0.f;
+        scale[k] = s.finite && s.max > s.min ? ChannelStats::Bins / (s.max - s.min) : 0.f;
+        offset[k] = (size_t) (k % d) * (ChannelStats::Bins + 1);
+    }
+    std::vector<uint32_t> histograms((size_t) d * (ChannelStats::Bins + 1), 0);
+    std::vector<uint16_t> bins(width);
+    for (size_t r = 0; r <= rows; r++)
+    {
+        int n = r < rows ? width : tail;
+        ComputeBins(data + r * width, n, lo.data(), scale.data(), bins.data());
+        for (int k = 0; k < n; k++)
+            histograms[offset[k] + bins[k]]++;
+    }
+    for (int c = 0; c < d; c++)
+    {
+        const uint32_t* histogram = &histograms[(size_t) c * (ChannelStats::Bins + 1)];
+        std::copy_n(histogram, ChannelStats::Bins, stats.channels[c].histogram);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Statistics of frames for the connection taps: per-channel range, mean, non-finite counts and histogram.
+//
+// Samples are interleaved, so the kernels accumulate whole rows of a multiple of d samples into per-lane accumulators,
+// which are straight loops the compiler can vectorize (built for AVX2 and a baseline target, as the expressions), and
+// fold the lanes into channels at the end.
+
+struct ChannelStats
+{
+    static const int Bins = 256;
+
+    /// Range and mean of the finite samples; min > max when there is none.
+    float min = 0;
+    float max = 0;
+    double mean = 0;
+    uint64_t finite = 0;
+    uint64_t nan = 0;
+    uint64_t inf = 0;
+    /// Finite samples in Bins bins spanning [min, max].
+    uint32_t histogram[Bins] = {};
+};
+
+struct FrameStats
+{
+    int w = 0;
+    int h = 0;
+    int d = 0;
+    uint64_t sequence = 0;
+    std::vector<ChannelStats> channels;
+};
+
+/// Computes the statistics of a w*h*d frame into `stats`.
+void ComputeFrameStats(const float* data, int w, int h, int d, FrameStats& stats);
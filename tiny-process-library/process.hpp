@@ -18,6 +18,36 @@ struct Config {
   std::size_t buffer_size = 131072;
   /// Set to true to inherit file descriptors from parent process. Default is false. Only supported on Unix-like systems.
   bool inherit_file_descriptors = false;
+  /// File descriptors the child keeps when inherit_file_descriptors is false, e.g. shared memory or eventfds passed
+  /// by number on the command line. Only supported on Unix-like systems.
+  std::vector<int> keep_file_descriptors;
+
+  /// Scheduling policy of the process.
+  enum class Scheduling { inherit, other, batch, idle };
+  /// I/O scheduling class of the process, see ioprio_set(2).
+  enum class IOClass { inherit, realtime, best_effort, idle };
+
+  /// CPUs the process may run on, empty to inherit the affinity of the parent. Only supported on Linux.
+  std::vector<int> cpus;
+  /// Niceness added to the one of the parent. Only supported on Unix-like systems.
+  int nice = 0;
+  /// Only supported on Linux.
+  Scheduling scheduling = Scheduling::inherit;
+  /// Only supported on Linux.
+  IOClass io_class = IOClass::inherit;
+  /// Priority within the I/O class, from 0 (highest) to 7.
+  int io_priority = 4;
+
+  /// Maximum size of the virtual memory of the process in bytes, 0 for no limit. Only supported on Unix-like systems.
+  std::size_t max_address_space = 0;
+  /// CPU time after which the process gets SIGXCPU, and SIGKILL a second later, 0 for no limit.
+  /// Only supported on Unix-like systems.
+  std::size_t max_cpu_seconds = 0;
+  /// Maximum number of open files, 0 for no limit. Only supported on Unix-like systems.
+  std::size_t max_open_files = 0;
+  /// cgroup v2 directory the process moves into before running, e.g. to limit its memory with memory.max.
+  /// The cgroup must be writable by the calling process. Only supported on Linux.
+  std::string cgroup;
 };
 
 /// Platform independent class for creating processes.
@@ -111,6 +141,11 @@ public:
   void kill(bool force = false) noexcept;
   /// Kill a given process id. Use kill(bool force) instead if possible. force=true is only supported on Unix-like systems.
   static void kill(id_type id, bool force = false) noexcept;
+#ifndef _WIN32
+  /// Send a signal to the process group of the process, e.g. SIGKILL for processes ignoring SIGTERM.
+  /// Supported on Unix-like systems only.
+  void signal(int signum) noexcept;
+#endif
 
 private:
   Data data;
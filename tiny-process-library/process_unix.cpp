@@ -1,15 +1,70 @@
 #include "process.hpp"
+#include <algorithm>
 #include <bitset>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
 #include <poll.h>
 #include <set>
 #include <signal.h>
 #include <stdexcept>
+#include <sys/resource.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
 
 namespace TinyProcessLib {
 
+/// Applies the scheduling parameters of config to the calling process. Failures are ignored, the process then runs
+/// with the parameters of its parent.
+static void apply_scheduling(const Config &config) noexcept {
+  if(config.nice != 0) {
+    errno = 0;
+    if(nice(config.nice) == -1 && errno != 0)
+      perror("nice");
+  }
+#ifdef __linux__
+  if(!config.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : config.cpus) {
+      if(cpu >= 0 && cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    if(sched_setaffinity(0, sizeof(set), &set) != 0)
+      perror("sched_setaffinity");
+  }
+  if(config.scheduling != Config::Scheduling::inherit) {
+    int policy = SCHED_OTHER;
+    if(config.scheduling == Config::Scheduling::batch)
+      policy = SCHED_BATCH;
+    else if(config.scheduling == Config::Scheduling::idle)
+      policy = SCHED_IDLE;
+    sched_param param{};
+    if(sched_setscheduler(0, policy, &param) != 0)
+      perror("sched_setscheduler");
+  }
+  if(config.io_class != Config::IOClass::inherit) {
+    // see linux/ioprio.h, which is not always installed
+    const int ioprio_who_process = 1;
+    const int ioprio_class_shift = 13;
+    int io_class = 0;
+    if(config.io_class == Config::IOClass::realtime)
+      io_class = 1;
+    else if(config.io_class == Config::IOClass::best_effort)
+      io_class = 2;
+    else if(config.io_class == Config::IOClass::idle)
+      io_class = 3;
+    int level = std::min(std::max(config.io_priority, 0), 7);
+    if(syscall(SYS_ioprio_set, ioprio_who_process, 0, (io_class << ioprio_class_shift) | level) != 0)
+      perror("ioprio_set");
+  }
+#endif
+}
+
 Process::Data::Data() noexcept : id(-1) {}
 
 Process::Process(const std::function<void()> &function,
@@ -21,6 +76,31 @@ Process::Process(const std::function<void()> &function,
   async_read();
 }
 
+/// Applies the resource limits of config to the calling process, and moves it to the cgroup whose cgroup.procs file is
+/// given. Called between fork and exec, so it must not allocate.
+static void apply_limits(const Config &config, const char *cgroup_procs) noexcept {
+  auto set_limit = [](int resource, rlim_t soft, rlim_t hard, const char *name) {
+    struct rlimit limit;
+    limit.rlim_cur = soft;
+    limit.rlim_max = hard;
+    if(setrlimit(resource, &limit) != 0)
+      perror(name);
+  };
+  if(config.max_address_space)
+    set_limit(RLIMIT_AS, config.max_address_space, config.max_address_space, "setrlimit(RLIMIT_AS)");
+  if(config.max_cpu_seconds)
+    set_limit(RLIMIT_CPU, config.max_cpu_seconds, config.max_cpu_seconds + 1, "setrlimit(RLIMIT_CPU)");
+  if(config.max_open_files)
+    set_limit(RLIMIT_NOFILE, config.max_open_files, config.max_open_files, "setrlimit(RLIMIT_NOFILE)");
+  if(cgroup_procs[0]) {
+    int fd = ::open(cgroup_procs, O_WRONLY);
+    if(fd < 0 || write(fd, "0", 1) != 1)
+      perror(cgroup_procs);
+    if(fd >= 0)
+      close(fd);
+  }
+}
+
 Process::id_type Process::open(const std::function<void()> &function) noexcept {
   if(open_stdin)
     stdin_fd = std::unique_ptr<fd_type>(new fd_type);
@@ -29,6 +109,9 @@ Process::id_type Process::open(const std::function<void()> &function) noexcept {
   if(read_stderr)
     stderr_fd = std::unique_ptr<fd_type>(new fd_type);
 
+  // the child must not allocate
+  const std::string cgroup_procs = config.cgroup.empty() ? std::string() : config.cgroup + "/cgroup.procs";
+
   int stdin_p[2], stdout_p[2], stderr_p[2];
 
   if(stdin_fd && pipe(stdin_p) != 0)
@@ -93,11 +176,17 @@ Process::id_type Process::open(const std::function<void()> &function) noexcept {
       int fd_max = static_cast<int>(sysconf(_SC_OPEN_MAX)); // truncation is safe
       // Based on http://stackoverflow.com/a/899533/3808293
       // TODO: find a way to optimize, as this is slow on systems with high fd_max
-      for(int fd = 3; fd < fd_max; fd++)
-        close(fd);
+      for(int fd = 3; fd < fd_max; fd++) {
+        if(std::find(config.keep_file_descriptors.begin(), config.keep_file_descriptors.end(), fd) == config.keep_file_descriptors.end())
+          close(fd);
+      }
     }
+    for(int fd : config.keep_file_descriptors)
+      fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) & ~FD_CLOEXEC);
 
     setpgid(0, 0);
+    apply_scheduling(config);
+    apply_limits(config, cgroup_procs.c_str());
     //TODO: See here on how to emulate tty for colors: http://stackoverflow.com/questions/1401002/trick-an-application-into-thinking-its-stdin-is-interactive-not-a-pipe
     //TODO: One solution is: echo "command;exit"|script -q /dev/null
 
@@ -347,6 +436,12 @@ void Process::kill(bool force) noexcept {
   }
 }
 
+void Process::signal(int signum) noexcept {
+  std::lock_guard<std::mutex> lock(close_mutex);
+  if(data.id > 0 && !closed)
+    ::kill(-data.id, signum);
+}
+
 void Process::kill(id_type id, bool force) noexcept {
   if(id <= 0)
     return;
@@ -1,6 +1,13 @@
 #include "process.hpp"
 #include <cassert>
 #include <iostream>
+#ifndef _WIN32
+#include <csignal>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 using namespace std;
 using namespace TinyProcessLib;
@@ -74,6 +81,77 @@ int main() {
     assert(output->substr(0, 4) == "Test");
     output->clear();
   }
+
+  {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    Config config;
+    config.keep_file_descriptors.push_back(fds[1]);
+    Process process("echo Test >&" + to_string(fds[1]) + " && echo Test2 >&" + to_string(fds[0]), "", nullptr, nullptr, false, config);
+    close(fds[1]);
+    char buffer[16] = {0};
+    assert(read(fds[0], buffer, sizeof(buffer) - 1) > 0);
+    assert(string(buffer).substr(0, 4) == "Test");
+    // only the listed descriptors are kept
+    assert(process.get_exit_status() > 0);
+    close(fds[0]);
+  }
+
+  {
+    Config config;
+    config.nice = 5;
+    string expected = to_string(nice(0) + 5);
+#ifdef __linux__
+    // the first CPU the test may run on, CPU 0 can be excluded by the cpuset
+    cpu_set_t set;
+    assert(sched_getaffinity(0, sizeof(set), &set) == 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &set))
+      cpu++;
+    config.cpus = {cpu};
+    config.scheduling = Config::Scheduling::batch;
+    // niceness, allowed CPUs and scheduling policy (3 for SCHED_BATCH) of the child
+    expected += " " + to_string(cpu) + " 3";
+    Process process("echo $(nice) $(grep Cpus_allowed_list /proc/self/status | cut -f2) $(cut -d' ' -f41 /proc/self/stat)", "", [output](const char *bytes, size_t n) {
+#else
+    Process process("nice", "", [output](const char *bytes, size_t n) {
+#endif
+      *output += string(bytes, n);
+    }, nullptr, false, config);
+    assert(process.get_exit_status() == 0);
+    assert(output->substr(0, expected.size()) == expected);
+    output->clear();
+  }
+
+  {
+    Process process("trap '' TERM; sleep 5");
+    this_thread::sleep_for(chrono::milliseconds(500));
+    process.kill(true);
+    this_thread::sleep_for(chrono::milliseconds(500));
+    int exit_status;
+    assert(!process.try_get_exit_status(exit_status));
+    process.signal(SIGKILL);
+    assert(process.get_exit_status() == SIGKILL);
+  }
+
+  {
+    Config config;
+    config.max_open_files = 16;
+    config.max_cpu_seconds = 1;
+    Process process("ulimit -n && ulimit -t", "", [output](const char *bytes, size_t n) {
+      *output += string(bytes, n);
+    }, nullptr, false, config);
+    assert(process.get_exit_status() == 0);
+    assert(output->substr(0, 5) == "16\n1\n");
+    output->clear();
+  }
+
+  {
+    Config config;
+    config.max_cpu_seconds = 1;
+    Process process("while true; do :; done", "", nullptr, nullptr, false, config);
+    assert((process.get_exit_status() & 0x7f) == SIGXCPU);
+  }
 #endif
 
   {
@@ -0,0 +1,310 @@
+#ifndef VPE_SHM_H
+#define VPE_SHM_H
+
+/*
+ * Shared-memory ring transport for vpp frames between stages managed by vpe.
+ *
+ * When both ends of a connection support it (built-in nodes, or commands whose node has the "shared memory" setting),
+ * vpe substitutes the slot with "shm:<memfd>,<items>,<spaces>" instead of a fifo path. The ring lives in a memfd and
+ * is signalled with two semaphore eventfds; frames are read and written in place, without going through the kernel.
+ *
+ * A command built with this header can accept both forms:
+ *
+ *     if (vpe_shm_is_spec(name)) { ring = vpe_shm_open(name); ... } else { ... fopen(name) as usual ... }
+ *
+ * Writer:  float* slot = vpe_shm_write_begin(ring, w, h, d, -1);  fill w*h*d floats;  vpe_shm_write_end(ring);
+ * Reader:  float* slot = vpe_shm_read_begin(ring, &w, &h, &d, -1);  use it;  vpe_shm_read_end(ring);
+ *          (up to slot_count frames may be held at once, vpe_shm_read_end() releases the oldest one)
+ * Both:    vpe_shm_close(ring, writer) when done, with `writer` 1 on the writing end and 0 on the reading end.
+ *          On the writer, it marks the end of the stream: the reader gets its remaining frames, then NULL with errno 0.
+ *          On the reader, it tells the writer nobody reads anymore: vpe_shm_write_begin() then returns NULL with EPIPE.
+ *
+ * *_begin() return NULL at the end of the stream (errno 0), when the other end went away (EPIPE) or after
+ * `timeout_ms` milliseconds (ETIMEDOUT, pass -1 to wait forever).
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define VPE_SHM_MAGIC 0x53455056u /* "VPES" */
+#define VPE_SHM_HEADER_SIZE 4096
+#define VPE_SHM_ALIGN 64
+
+struct vpe_shm_header
+{
+    uint32_t magic;
+    uint32_t slot_count;
+    int32_t w, h, d;
+    /* set by the writer once the geometry is known and the memfd is sized */
+    uint32_t ready;
+    uint64_t slot_bytes;
+    /* frames committed by the writer, released by the reader */
+    uint64_t written;
+    uint64_t released;
+    uint32_t writer_closed;
+    uint32_t reader_closed;
+};
+
+struct vpe_shm_ring
+{
+    int memfd;
+    int items;  /* counts committed slots */
+    int spaces; /* counts free slots */
+    struct vpe_shm_header* header;
+    char* slots;
+    size_t mapped;
+    uint64_t next_read;
+    uint64_t next_release;
+    uint64_t next_write;
+};
+
+static inline int vpe_shm_is_spec(const char* name)
+{
+    return name && strncmp(name, "shm:", 4) == 0;
+}
+
+static inline int vpe_shm__wait(int efd, int timeout_ms)
+{
+    struct pollfd pfd;
+    uint64_t value;
+    pfd.fd = efd;
+    pfd.events = POLLIN;
+    for (;;)
+    {
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r == 0)
+            errno = ETIMEDOUT;
+        if (r <= 0)
+            return -1;
+        if (read(efd, &value, sizeof(value)) == sizeof(value))
+            return 0;
+        if (errno != EAGAIN && errno != EINTR)
+            return -1;
+    }
+}
+
+static inline void vpe_shm__post(int efd, uint64_t count)
+{
+    while (write(efd, &count, sizeof(count)) < 0 && errno == EINTR)
+        ;
+}
+
+static inline int vpe_shm__map_slots(struct vpe_shm_ring* ring)
+{
+    size_t size = VPE_SHM_HEADER_SIZE + (size_t) ring->header->slot_count * ring->header->slot_bytes;
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    munmap(ring->header, VPE_SHM_HEADER_SIZE);
+    ring->header = (struct vpe_shm_header*) p;
+    ring->slots = (char*) p + VPE_SHM_HEADER_SIZE;
+    ring->mapped = size;
+    return 0;
+}
+
+static inline struct vpe_shm_ring* vpe_shm__attach(int memfd, int items, int spaces)
+{
+    struct vpe_shm_ring* ring = (struct vpe_shm_ring*) calloc(1, sizeof(*ring));
+    void* p;
+    if (!ring)
+        return NULL;
+    p = mmap(NULL, VPE_SHM_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (p == MAP_FAILED)
+    {
+        free(ring);
+        return NULL;
+    }
+    ring->memfd = memfd;
+    ring->items = items;
+    ring->spaces = spaces;
+    ring->header = (struct vpe_shm_header*) p;
+    ring->mapped = VPE_SHM_HEADER_SIZE;
+    return ring;
+}
+
+/* Creates an empty ring and writes its spec into `spec`. Used by vpe. */
+static inline struct vpe_shm_ring* vpe_shm_create(unsigned slot_count, char* spec, size_t spec_size)
+{
+    struct vpe_shm_ring* ring;
+    int memfd = (int) syscall(SYS_memfd_create, "vpe-ring", 0);
+    int items = eventfd(0, EFD_SEMAPHORE);
+    int spaces = eventfd(slot_count, EFD_SEMAPHORE);
+    if (memfd < 0 || items < 0 || spaces < 0 || ftruncate(memfd, VPE_SHM_HEADER_SIZE) != 0
+        || !(ring = vpe_shm__attach(memfd, items, spaces)))
+    {
+        if (memfd >= 0) close(memfd);
+        if (items >= 0) close(items);
+        if (spaces >= 0) close(spaces);
+        return NULL;
+    }
+    ring->header->magic = VPE_SHM_MAGIC;
+    ring->header->slot_count = slot_count;
+    snprintf(spec, spec_size, "shm:%d,%d,%d", memfd, items, spaces);
+    return ring;
+}
+
+/* Opens a ring from its "shm:..." spec. The descriptors are duplicated, so the spec stays valid. */
+static inline struct vpe_shm_ring* vpe_shm_open(const char* spec)
+{
+    int memfd, items, spaces;
+    struct vpe_shm_ring* ring;
+    if (!vpe_shm_is_spec(spec) || sscanf(spec + 4, "%d,%d,%d", &memfd, &items, &spaces) != 3)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    memfd = dup(memfd);
+    items = dup(items);
+    spaces = dup(spaces);
+    ring = memfd >= 0 && items >= 0 && spaces >= 0 ? vpe_shm__attach(memfd, items, spaces) : NULL;
+    if (!ring || ring->header->magic != VPE_SHM_MAGIC)
+    {
+        if (ring)
+        {
+            munmap(ring->header, ring->mapped);
+            free(ring);
+        }
+        if (memfd >= 0) close(memfd);
+        if (items >= 0) close(items);
+        if (spaces >= 0) close(spaces);
+        errno = EINVAL;
+        return NULL;
+    }
+    return ring;
+}
+
+static inline unsigned vpe_shm_slot_count(const struct vpe_shm_ring* ring)
+{
+    return ring->header->slot_count;
+}
+
+static inline float* vpe_shm_write_begin(struct vpe_shm_ring* ring, int w, int h, int d, int timeout_ms)
+{
+    struct vpe_shm_header* header = ring->header;
+    if (!__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE))
+    {
+        size_t bytes = (size_t) w * h * d * sizeof(float);
+        header->w = w;
+        header->h = h;
+        header->d = d;
+        header->slot_bytes = (bytes + VPE_SHM_ALIGN - 1) / VPE_SHM_ALIGN * VPE_SHM_ALIGN;
+        if (ftruncate(ring->memfd, VPE_SHM_HEADER_SIZE + header->slot_count * header->slot_bytes) != 0
+            || vpe_shm__map_slots(ring) != 0)
+            return NULL;
+        header = ring->header;
+        __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+    }
+    else if (header->w != w || header->h != h || header->d != d)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (vpe_shm__wait(ring->spaces, timeout_ms) != 0)
+        return NULL;
+    if (__atomic_load_n(&header->reader_closed, __ATOMIC_ACQUIRE))
+    {
+        errno = EPIPE;
+        return NULL;
+    }
+    return (float*) (ring->slots + (ring->next_write % header->slot_count) * header->slot_bytes);
+}
+
+static inline void vpe_shm_write_end(struct vpe_shm_ring* ring)
+{
+    ring->next_write++;
+    __atomic_store_n(&ring->header->written, ring->next_write, __ATOMIC_RELEASE);
+    vpe_shm__post(ring->items, 1);
+}
+
+static inline float* vpe_shm_read_begin(struct vpe_shm_ring* ring, int* w, int* h, int* d, int timeout_ms)
+{
+    struct vpe_shm_header* header = ring->header;
+    if (vpe_shm__wait(ring->items, timeout_ms) != 0)
+        return NULL;
+    if (__atomic_load_n(&header->written, __ATOMIC_ACQUIRE) <= ring->next_read)
+    {
+        /* woken up without a frame: end of stream */
+        vpe_shm__post(ring->items, 1);
+        errno = 0;
+        return NULL;
+    }
+    if (!ring->slots && vpe_shm__map_slots(ring) != 0)
+        return NULL;
+    header = ring->header;
+    *w = header->w;
+    *h = header->h;
+    *d = header->d;
+    return (float*) (ring->slots + (ring->next_read++ % header->slot_count) * header->slot_bytes);
+}
+
+static inline void vpe_shm_read_end(struct vpe_shm_ring* ring)
+{
+    ring->next_release++;
+    __atomic_store_n(&ring->header->released, ring->next_release, __ATOMIC_RELEASE);
+    vpe_shm__post(ring->spaces, 1);
+}
+
+/* Empties a ring that no end uses anymore, so that a new stream can go through it. Used by vpe to restart stages. */
+static inline void vpe_shm_reset(struct vpe_shm_ring* ring)
+{
+    struct vpe_shm_header* header = ring->header;
+    while (vpe_shm__wait(ring->items, 0) == 0)
+        ;
+    while (vpe_shm__wait(ring->spaces, 0) == 0)
+        ;
+    header->written = 0;
+    header->released = 0;
+    header->writer_closed = 0;
+    header->reader_closed = 0;
+    __atomic_store_n(&header->ready, 0, __ATOMIC_RELEASE);
+    vpe_shm__post(ring->spaces, header->slot_count);
+}
+
+/* Unmaps the ring and closes its descriptors, without signalling the other end. */
+static inline void vpe_shm_free(struct vpe_shm_ring* ring)
+{
+    munmap(ring->header, ring->mapped);
+    close(ring->memfd);
+    close(ring->items);
+    close(ring->spaces);
+    free(ring);
+}
+
+/* Closes the writing end of the ring when `writer` is nonzero, the reading end otherwise, but keeps it mapped, for a
+ * reader whose frames are still in use. vpe_shm_free() unmaps it later. */
+static inline void vpe_shm_shutdown(struct vpe_shm_ring* ring, int writer)
+{
+    if (writer)
+    {
+        __atomic_store_n(&ring->header->writer_closed, 1, __ATOMIC_RELEASE);
+        vpe_shm__post(ring->items, 1);
+    }
+    else
+    {
+        __atomic_store_n(&ring->header->reader_closed, 1, __ATOMIC_RELEASE);
+        vpe_shm__post(ring->spaces, ring->header->slot_count);
+    }
+}
+
+/* Closes the writing end of the ring when `writer` is nonzero, the reading end otherwise, then frees it. */
+static inline void vpe_shm_close(struct vpe_shm_ring* ring, int writer)
+{
+    if (!ring)
+        return;
+    vpe_shm_shutdown(ring, writer);
+    vpe_shm_free(ring);
+}
+
+#endif /* VPE_SHM_H */
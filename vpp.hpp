@@ -0,0 +1,237 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Minimal reader/writer for vpp streams ("VPPF" w h d, then "FRAM" + w*h*d floats per frame).
+// All blocking operations poll with a short timeout so that they can be interrupted with `stop`.
+
+namespace vpp
+{
+
+struct Format
+{
+    int w = 0;
+    int h = 0;
+    int d = 0;
+
+    size_t Count() const { return (size_t) w * h * d; }
+    size_t Bytes() const { return Count() * sizeof(float); }
+    /// Whether the dimensions are positive and Bytes() does not overflow, for formats read from a stream.
+    bool IsValid() const
+    {
+        return w > 0 && h > 0 && d > 0 && (size_t) w * h <= SIZE_MAX / sizeof(float) / d;
+    }
+    bool operator==(const Format& o) const { return w == o.w && h == o.h && d == o.d; }
+    bool operator!=(const Format& o) const { return !operator==(o); }
+};
+
+static const int PollTimeoutMs = 100;
+
+/// Writes to a fifo whose reader may vanish must not kill vpe: block SIGPIPE on the calling (I/O) thread.
+inline void BlockSigpipe()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+/// Discards a SIGPIPE that became pending on this thread after an EPIPE.
+inline void ConsumeSigpipe()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    struct timespec zero = {0, 0};
+    sigtimedwait(&set, nullptr, &zero);
+}
+
+/// Opens a fifo for reading or writing without blocking forever on the other end.
+inline int OpenFifo(const std::string& path, bool write, const std::atomic<bool>& stop)
+{
+    while (!stop)
+    {
+        int fd = open(path.c_str(), (write ? O_WRONLY : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+        if (fd >= 0)
+            return fd;
+        // writers get ENXIO until a reader opened the fifo
+        if (errno != ENXIO && errno != EINTR)
+        {
+            perror(path.c_str());
+            return -1;
+        }
+        usleep(PollTimeoutMs * 1000);
+    }
+    return -1;
+}
+
+/// Reads exactly `n` bytes. Returns false on EOF, error or stop request.
+inline bool ReadFull(int fd, void* buf, size_t n, const std::atomic<bool>& stop)
+{
+    char* p = (char*) buf;
+    while (n > 0)
+    {
+        ssize_t r = read(fd, p, n);
+        if (r > 0)
+        {
+            p += r;
+            n -= r;
+            continue;
+        }
+        if (r == 0)
+        {
+            // EOF, or no writer connected yet
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (stop || poll(&pfd, 1, PollTimeoutMs) < 0)
+                return false;
+            if ((pfd.revents & POLLHUP) && !(pfd.revents & POLLIN))
+                return false;
+            continue;
+        }
+        if (errno == EAGAIN || errno == EINTR)
+        {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (stop)
+                return false;
+            poll(&pfd, 1, PollTimeoutMs);
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/// Writes exactly `n` bytes. Returns false when the reader went away or on stop request.
+inline bool WriteFull(int fd, const void* buf, size_t n, const std::atomic<bool>& stop)
+{
+    const char* p = (const char*) buf;
+    while (n > 0)
+    {
+        ssize_t r = write(fd, p, n);
+        if (r > 0)
+        {
+            p += r;
+            n -= r;
+            continue;
+        }
+        if (r < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            if (stop)
+                return false;
+            poll(&pfd, 1, PollTimeoutMs);
+            continue;
+        }
+        if (r < 0 && errno == EPIPE)
+            ConsumeSigpipe();
+        return false;
+    }
+    return true;
+}
+
+class Reader
+{
+    int fd = -1;
+
+public:
+    Format format;
+
+    ~Reader() { Close(); }
+
+    bool Open(const std::string& path, const std::atomic<bool>& stop)
+    {
+        fd = OpenFifo(path, false, stop);
+        return fd >= 0 && ReadHeader(stop);
+    }
+
+    /// Takes ownership of an already opened descriptor.
+    bool Attach(int fd, const std::atomic<bool>& stop)
+    {
+        this->fd = fd;
+        return ReadHeader(stop);
+    }
+
+    bool ReadHeader(const std::atomic<bool>& stop)
+    {
+        char tag[4];
+        int dims[3];
+        if (!ReadFull(fd, tag, 4, stop) || memcmp(tag, "VPPF", 4) || !ReadFull(fd, dims, sizeof(dims), stop))
+            return false;
+        format.w = dims[0];
+        format.h = dims[1];
+        format.d = dims[2];
+        return format.IsValid();
+    }
+
+    /// Reads the next frame into `data`, which must hold format.Count() floats.
+    bool ReadFrame(float* data, const std::atomic<bool>& stop)
+    {
+        char tag[4];
+        if (!ReadFull(fd, tag, 4, stop) || memcmp(tag, "FRAM", 4))
+            return false;
+        return ReadFull(fd, data, format.Bytes(), stop);
+    }
+
+    int GetFd() const { return fd; }
+
+    void Close()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+};
+
+class Writer
+{
+    int fd = -1;
+
+public:
+    Format format;
+
+    ~Writer() { Close(); }
+
+    bool Open(const std::string& path, const Format& format, const std::atomic<bool>& stop)
+    {
+        fd = OpenFifo(path, true, stop);
+        return fd >= 0 && WriteHeader(format, stop);
+    }
+
+    bool Attach(int fd, const Format& format, const std::atomic<bool>& stop)
+    {
+        this->fd = fd;
+        return WriteHeader(format, stop);
+    }
+
+    bool WriteHeader(const Format& format, const std::atomic<bool>& stop)
+    {
+        this->format = format;
+        int dims[3] = {format.w, format.h, format.d};
+        return WriteFull(fd, "VPPF", 4, stop) && WriteFull(fd, dims, sizeof(dims), stop);
+    }
+
+    bool WriteFrame(const float* data, const std::atomic<bool>& stop)
+    {
+        return WriteFull(fd, "FRAM", 4, stop) && WriteFull(fd, data, format.Bytes(), stop);
+    }
+
+    int GetFd() const { return fd; }
+
+    void Close()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+};
+
+}   // namespace vpp
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Wakeups of the GUI, which sleeps while nothing changes (see main.cpp). Blocks call WakeGui() from their threads when
+// something the GUI shows changes: a block ended, a command printed something, a tap has a new sample. The GUI
+// installs a handler posting an event to its loop; without one (batch and daemon modes) wakeups do nothing.
+//
+// Wakeups are coalesced: the handler is called once until the GUI calls ClearWakeup() at its next frame, so a busy
+// graph cannot flood the event queue.
+
+typedef void (*WakeupHandler)();
+
+namespace wakeup_detail
+{
+
+inline std::atomic<WakeupHandler>& Handler()
+{
+    static std::atomic<WakeupHandler> handler{nullptr};
+    return handler;
+}
+
+inline std::atomic<bool>& Pending()
+{
+    static std::atomic<bool> pending{false};
+    return pending;
+}
+
+inline std::atomic<int64_t>& LastMetrics()
+{
+    static std::atomic<int64_t> last{0};
+    return last;
+}
+
+/// Set by WakeGuiForMetrics() until the GUI renders a frame, also when the wakeup itself was throttled.
+inline std::atomic<bool>& MetricsDirty()
+{
+    static std::atomic<bool> dirty{false};
+    return dirty;
+}
+
+inline int64_t NowMs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+}   // namespace wakeup_detail
+
+/// Minimum time between two wakeups for metrics, which may change at every frame, in milliseconds.
+static const int MetricsWakeupMs = 33;
+
+/// Called once at startup by the GUI.
+inline void SetWakeupHandler(WakeupHandler handler)
+{
+    wakeup_detail::Handler() = handler;
+}
+
+/// Whether WakeGui() does anything, to skip the work of watching for something only the GUI waits for.
+inline bool HasWakeupHandler()
+{
+    return wakeup_detail::Handler() != nullptr;
+}
+
+/// Wakes the GUI. Thread-safe.
+inline void WakeGui()
+{
+    WakeupHandler handler = wakeup_detail::Handler();
+    if (handler && !wakeup_detail::Pending().exchange(true))
+        handler();
+}
+
+/// Wakes the GUI for new metrics or previews, at most every MetricsWakeupMs. A throttled wakeup is deferred rather
+/// than dropped, see GetMetricsWakeupDelay(). Thread-safe.
+inline void WakeGuiForMetrics()
+{
+    if (!wakeup_detail::Handler())
+        return;
+    wakeup_detail::MetricsDirty() = true;
+    int64_t now = wakeup_detail::NowMs();
+    int64_t last = wakeup_detail::LastMetrics();
+    if (now - last < MetricsWakeupMs || !wakeup_detail::LastMetrics().compare_exchange_strong(last, now))
+        return;
+    WakeGui();
+}
+
+/// Milliseconds until the GUI should render metrics whose wakeup was throttled, -1 when none changed since the last
+/// frame.
+inline int GetMetricsWakeupDelay()
+{
+    if (!wakeup_detail::MetricsDirty())
+        return -1;
+    int64_t elapsed = wakeup_detail::NowMs() - wakeup_detail::LastMetrics();
+    return elapsed < MetricsWakeupMs ? (int) (MetricsWakeupMs - elapsed) : 0;
+}
+
+/// Called by the GUI before it renders a frame, which shows everything that changed up to this point.
+inline void ClearWakeup()
+{
+    wakeup_detail::Pending() = false;
+    wakeup_detail::MetricsDirty() = false;
+}